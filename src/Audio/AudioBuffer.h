@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "../Core/Common.h"
+
+// Planar block of samples: each channel is contiguous, channel c starts at c * stride
+struct AudioBuffer
+{
+    u32 channels = 0;
+    u32 frames   = 0;
+    u32 stride   = 0;
+    std::vector<f64> data;
+
+    // Only grows, so a steady block size never reallocates on the audio thread
+    void Resize(u32 channel_count, u32 frame_count)
+    {
+        if (channel_count != channels || frame_count > stride)
+        {
+            channels = channel_count;
+            stride   = std::max(frame_count, stride);
+            data.assign(size_t(channels) * stride, 0.0);
+        }
+        frames = frame_count;
+    }
+
+    f64* Channel(u32 channel) { return data.data() + size_t(channel) * stride; }
+    const f64* Channel(u32 channel) const { return data.data() + size_t(channel) * stride; }
+};
+
+// Constant power pan law, pan in [-1, 1] from left to right
+// https://www.cs.cmu.edu/~music/icm-online/readings/panlaws/
+static void pan_gains(f64 pan, f64& left, f64& right)
+{
+    f64 angle = (std::clamp(pan, -1.0, 1.0) + 1.0) * 0.25 * PI;
+    left  = std::cos(angle);
+    right = std::sin(angle);
+}
+
+// Planar f64 to interleaved f32 for the sound card, vectorized for mono and stereo
+static void interleave_f32(const AudioBuffer& buffer, u32 channels, u32 frame_count, f32* output)
+{
+    u32 frame = 0;
+    if (channels == 1)
+    {
+        const f64* mono = buffer.Channel(0);
+#if defined(SYNTH_SSE2)
+        for (; frame + 4 <= frame_count; frame += 4)
+        {
+            __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(mono + frame));
+            __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(mono + frame + 2));
+            _mm_storeu_ps(output + frame, _mm_movelh_ps(lo, hi));
+        }
+#elif defined(SYNTH_NEON)
+        for (; frame + 4 <= frame_count; frame += 4)
+            vst1q_f32(output + frame, vcombine_f32(vcvt_f32_f64(vld1q_f64(mono + frame)), vcvt_f32_f64(vld1q_f64(mono + frame + 2))));
+#endif
+        for (; frame < frame_count; frame++)
+            output[frame] = static_cast<f32>(mono[frame]);
+    }
+    else if (channels == 2)
+    {
+        const f64* left  = buffer.Channel(0);
+        const f64* right = buffer.Channel(1);
+#if defined(SYNTH_SSE2)
+        for (; frame + 4 <= frame_count; frame += 4)
+        {
+            __m128 l = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(left + frame)),  _mm_cvtpd_ps(_mm_loadu_pd(left + frame + 2)));
+            __m128 r = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(right + frame)), _mm_cvtpd_ps(_mm_loadu_pd(right + frame + 2)));
+            _mm_storeu_ps(output + 2 * frame,     _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(output + 2 * frame + 4, _mm_unpackhi_ps(l, r));
+        }
+#elif defined(SYNTH_NEON)
+        for (; frame + 4 <= frame_count; frame += 4)
+        {
+            float32x4x2_t lr;
+            lr.val[0] = vcombine_f32(vcvt_f32_f64(vld1q_f64(left + frame)),  vcvt_f32_f64(vld1q_f64(left + frame + 2)));
+            lr.val[1] = vcombine_f32(vcvt_f32_f64(vld1q_f64(right + frame)), vcvt_f32_f64(vld1q_f64(right + frame + 2)));
+            vst2q_f32(output + 2 * frame, lr);
+        }
+#endif
+        for (; frame < frame_count; frame++)
+        {
+            output[2 * frame]     = static_cast<f32>(left[frame]);
+            output[2 * frame + 1] = static_cast<f32>(right[frame]);
+        }
+    }
+    else
+    {
+        for (u32 channel = 0; channel < channels; channel++)
+        {
+            const f64* samples = buffer.Channel(channel);
+            for (frame = 0; frame < frame_count; frame++)
+                output[frame * channels + channel] = static_cast<f32>(samples[frame]);
+        }
+    }
+}
\ No newline at end of file
@@ -8,9 +8,34 @@ AudioEngine::AudioEngine()
 
 }
 
-bool AudioEngine::Init(u32 sample_rate, u32 channels, u32 blocks, u32 block_samples)
+bool AudioEngine::Init(u32 sample_rate, u32 channels, u32 blocks, u32 block_samples, std::unique_ptr<AudioDriver> driver)
+{
+    m_driver = driver ? std::move(driver) : std::make_unique<MiniAudio>(this);
+    Configure(sample_rate, channels, blocks, block_samples);
+
+    if (m_render_ahead)           StartRenderAhead();
+    if (m_realtime.lock_memory)   LockCoreBuffers();
+
+    // The render-ahead worker is already running: stop it with the device that failed
+    if (!m_driver->Open() || !m_driver->Start())
+    {
+        StopRenderAhead();
+        return false;
+    }
+
+    return true;
+}
+
+bool AudioEngine::InitOffline(u32 sample_rate, u32 channels, u32 block_samples)
+{
+    m_driver.reset();
+    Configure(sample_rate, channels, 1, block_samples);
+
+    return true;
+}
+
+void AudioEngine::Configure(u32 sample_rate, u32 channels, u32 blocks, u32 block_samples)
 {
-    m_driver = std::make_unique<MiniAudio>(this);
     m_sample_rate = sample_rate;
     m_channels = channels;
     m_blocks = blocks;
@@ -19,91 +44,698 @@ bool AudioEngine::Init(u32 sample_rate, u32 channels, u32 blocks, u32 block_samp
     m_time_per_sample = 1.0 / f64(sample_rate);
     m_global_time = 0.0;
 
-    m_driver->Open();
-    m_driver->Start();
+    // Tuning tables limited to the Nyquist frequency of this rate
+    Tuning::Instance().SetSampleRate(f64(sample_rate));
 
-    return true;
+    // Block processing writes one sample per frame into the wave data
+    if (synth.wave_data.samples.size() < block_samples)
+    {
+        synth.wave_data.times.resize(block_samples, 0.0);
+        synth.wave_data.samples.resize(block_samples, 0.0);
+    }
+
+    // The synth always renders a stereo pair, mapped to the device channels per block
+    m_output.Resize(std::max(channels, 2u), block_samples);
 }
 
 void AudioEngine::Update(f64 time_step)
 {
     synth.Update(time_step);
+
+    ReportThread("audio", m_audio_thread, m_realtime.audio_cpu);
+    if (m_render_ahead) ReportThread("render-ahead", m_worker_thread, m_realtime.worker_cpu);
 }
 
 void AudioEngine::Shutdown()
 {
-    m_driver->Close();
+    if (m_driver) m_driver->Close();
+    StopRenderAhead();
+}
+
+void AudioEngine::SetRealtimeOptions(const RealtimeOptions& options)
+{
+    m_realtime = options;
+}
+
+const RealtimeOptions& AudioEngine::GetRealtimeOptions() const
+{
+    return m_realtime;
+}
+
+// Runs on the thread being configured
+void AudioEngine::SetupThread(ThreadSetup& setup, s32 cpu)
+{
+    if (m_realtime.realtime_priority)
+        setup.priority_ok = set_thread_realtime_priority(m_realtime.priority, setup.priority_error);
+    if (cpu >= 0)
+        setup.affinity_ok = set_thread_affinity(cpu, setup.affinity_error);
+    setup.ready.store(true, std::memory_order_release);
+}
+
+void AudioEngine::PrepareAudioThread()
+{
+    if (!m_realtime.realtime_priority && m_realtime.audio_cpu < 0) return;
+    if (m_audio_thread.claimed.load(std::memory_order_relaxed))   return;
+    if (m_audio_thread.claimed.exchange(true))                    return;
+
+    SetupThread(m_audio_thread, m_realtime.audio_cpu);
+}
+
+// Print the outcome once the thread has configured itself, from the Update after it did
+void AudioEngine::ReportThread(const char* name, ThreadSetup& setup, s32 cpu)
+{
+    if (!m_realtime.realtime_priority && cpu < 0) return;
+    if (!setup.ready.load(std::memory_order_acquire)) return;
+    if (setup.reported.exchange(true)) return;
+
+    if (m_realtime.realtime_priority)
+    {
+        if (setup.priority_ok) std::printf("INFO: Realtime: %s thread priority: real-time (%d)\n", name, m_realtime.priority);
+        else                   std::printf("ERROR: Realtime: %s thread priority: %s\n", name, setup.priority_error.c_str());
+    }
+    if (cpu >= 0)
+    {
+        if (setup.affinity_ok) std::printf("INFO: Realtime: %s thread pinned to core %d\n", name, cpu);
+        else                   std::printf("ERROR: Realtime: %s thread affinity: %s\n", name, setup.affinity_error.c_str());
+    }
+}
+
+// Lock and prefault the buffers the engine core owns: reverb and delay lines, the waveguide pool, the wave data
+// and the output and render-ahead buffers. The state the other voice engines and the EQ and multiband stages
+// allocate themselves, when a patch, sample or design loads, is not covered.
+void AudioEngine::LockCoreBuffers()
+{
+    struct Region
+    {
+        std::string name;
+        void* data;
+        size_t bytes;
+    };
+    std::vector<Region> regions;
+    auto add = [&regions](std::string name, auto& v) { regions.push_back({ name, v.data(), v.capacity() * sizeof(v[0]) }); };
+
+    // Largest room the GUI allows, and the delay line for the current tempo
+    synth.m_reverb.Reserve(10.0);
+    synth.m_delay.Resize(bpm_to_sample(synth.m_delay.beat, synth.m_delay.beat_per_bar, synth.m_delay.bpm, SAMPLE_RATE));
+
+    for (s32 c = 0; c < Reverb::NUM_CHANNELS; c++)
+    {
+        for (s32 i = 0; i < Reverb::NUM_COMB_FILTERS; i++)
+            add("reverb comb " + std::to_string(c) + "." + std::to_string(i), synth.m_reverb.comb_filters[c][i].history.storage);
+        for (s32 i = 0; i < Reverb::NUM_ALLPASS_FILTERS; i++)
+            add("reverb allpass " + std::to_string(c) + "." + std::to_string(i), synth.m_reverb.allpass_filters[c][i].history.storage);
+    }
+    for (s32 c = 0; c < Delay::NUM_CHANNELS; c++)
+        add("delay history " + std::to_string(c), synth.m_delay.history[c]);
+    add("wave data", synth.wave_data.samples);
+    add("waveguide delay lines", synth.m_waveguide.pool);
+    add("output buffer", m_output.data);
+    add("render-ahead interleave", m_render_interleaved);
+    regions.push_back({ "render-ahead ring", m_render_ring.Data(), m_render_ring.Capacity() * sizeof(f32) });
+
+    size_t locked_bytes = 0;
+    u32 locked = 0;
+    for (auto& region : regions)
+    {
+        std::string error;
+        if (lock_buffer(region.data, region.bytes, error))
+        {
+            locked_bytes += region.bytes;
+            locked++;
+        }
+        else
+        {
+            std::printf("ERROR: Realtime: could not lock %s: %s\n", region.name.c_str(), error.c_str());
+        }
+    }
+
+    std::printf("INFO: Realtime: locked and prefaulted %d/%zu core buffers (%.1f KB)\n", locked, regions.size(), locked_bytes / 1024.0);
+}
+
+void AudioEngine::SetRenderAhead(bool enable)
+{
+    m_render_ahead = enable;
+}
+
+bool AudioEngine::IsRenderAhead() const
+{
+    return m_render_ahead;
+}
+
+u64 AudioEngine::RenderAheadUnderruns() const
+{
+    return m_render_underruns;
+}
+
+// The ring rounds its capacity up to a power of two; the producer fills only Blocks() blocks of it,
+// so the latency is the one configured
+u32 AudioEngine::RenderAheadRoom() const
+{
+    const u32 depth  = m_blocks * m_block_samples * m_channels;
+    const u32 filled = m_render_ring.Capacity() - m_render_ring.WriteAvailable();
+    return depth - std::min(filled, depth);
+}
+
+void AudioEngine::StartRenderAhead()
+{
+    const u32 block_size = m_block_samples * m_channels;
+    m_render_ring.Resize(m_blocks * block_size);
+    m_render_interleaved.assign(block_size, 0.0f);
+    m_render_underruns = 0;
+    m_render_reads = 0;
+
+    // Prefill before the driver starts pulling
+    while (RenderAheadRoom() >= block_size)
+    {
+        interleave_f32(ProcessOutputBlock(m_block_samples), m_channels, m_block_samples, m_render_interleaved.data());
+        m_render_ring.Write(m_render_interleaved.data(), block_size);
+    }
+
+    m_render_running = true;
+    m_render_thread = std::thread(&AudioEngine::RenderAheadThread, this);
+
+    std::printf("INFO: Render-ahead:  %d blocks x %d samples (%.1f ms)\n", m_blocks, m_block_samples, 1000.0 * m_blocks * m_block_samples * m_time_per_sample);
+}
+
+void AudioEngine::StopRenderAhead()
+{
+    m_render_running = false;
+    m_render_reads.fetch_add(1);
+    m_render_reads.notify_one();
+    if (m_render_thread.joinable())
+    {
+        m_render_thread.join();
+        std::printf("INFO: Render-ahead underruns: %llu\n", (unsigned long long)m_render_underruns.load());
+    }
+}
+
+// Producer: keep the ring topped up in whole blocks, wait for the consumer while it is full
+void AudioEngine::RenderAheadThread()
+{
+    if (m_realtime.realtime_priority || m_realtime.worker_cpu >= 0)
+        SetupThread(m_worker_thread, m_realtime.worker_cpu);
+
+    const u32 block_size = m_block_samples * m_channels;
+    while (m_render_running)
+    {
+        // Read the count before the room, so a read in between wakes the wait at once
+        const u64 reads = m_render_reads.load(std::memory_order_acquire);
+        if (RenderAheadRoom() >= block_size)
+        {
+            interleave_f32(ProcessOutputBlock(m_block_samples), m_channels, m_block_samples, m_render_interleaved.data());
+            m_render_ring.Write(m_render_interleaved.data(), block_size);
+        }
+        else
+        {
+            m_render_reads.wait(reads, std::memory_order_acquire);
+        }
+    }
+}
+
+void AudioEngine::SetBlockCallback(std::function<void(f64 time)> callback)
+{
+    m_block_callback = std::move(callback);
+}
+
+// Consumer: called inside the driver callback, copies only in render-ahead mode
+void AudioEngine::PullOutputBlock(f32* output, u32 frame_count)
+{
+    if (!m_render_ahead)
+    {
+        interleave_f32(ProcessOutputBlock(frame_count), m_channels, frame_count, output);
+        return;
+    }
+
+    u32 sample_count = frame_count * m_channels;
+    u32 read = m_render_ring.Read(output, sample_count);
+    m_render_reads.fetch_add(1, std::memory_order_release);
+    m_render_reads.notify_one();
+    if (read < sample_count)
+    {
+        std::fill(output + read, output + sample_count, 0.0f);
+        m_render_underruns++;
+    }
 }
 
 // Called inside the: driver.FillOutputBuffer(void* pOutput, u32 frameCount)
-std::vector<f64>& AudioEngine::ProcessOutputBlock(u32 frame_count)
+AudioBuffer& AudioEngine::ProcessOutputBlock(u32 frame_count)
 {
-    for (u32 frame = 0; frame < frame_count; frame++)
+    if (m_block_callback) m_block_callback(m_global_time);
+
+    // Periods larger than the configured block grow the buffers once
+    if (synth.wave_data.samples.size() < frame_count)
+        synth.wave_data.samples.resize(frame_count, 0.0);
+    m_output.Resize(std::max(m_channels, 2u), frame_count);
+
+    f64* output_left  = m_output.Channel(0);
+    f64* output_right = m_output.Channel(1);
+
+    // Voices added meanwhile start next block
+    const size_t note_count = synth.notes.size();
+    const size_t osc_count  = synth.OscillatorCount();
+    const bool fm           = synth.m_synthesis == Synthesizer::Synthesis::FREQUENCY_MODULATION;
+    const bool tonewheel    = synth.m_synthesis == Synthesizer::Synthesis::TONEWHEEL;
+    const bool additive     = synth.m_synthesis == Synthesizer::Synthesis::ADDITIVE;
+    const bool sampler      = synth.m_synthesis == Synthesizer::Synthesis::SAMPLER;
+    const bool granular     = synth.m_synthesis == Synthesizer::Synthesis::GRANULAR;
+    const bool waveguide    = synth.m_synthesis == Synthesizer::Synthesis::WAVEGUIDE;
+    const bool modal        = synth.m_synthesis == Synthesizer::Synthesis::MODAL;
+    const bool capture      = synth.m_granular.Capturing();
+    const bool ladder       = synth.ladder;
+    const bool distortion   = synth.distortion;
+    // The per-voice stages take the voice mixed to mono and enveloped at control rate
+    const bool voice_mono   = ladder || distortion;
+    // Pan gain pairs per voice: one per oscillator, or one for a voice rendered as a whole,
+    // none when the voices are summed into a shared bus
+    // Output rows per oscillator, fixed for the block: a unison with stereo spread renders two
+    u32 osc_channels[Synthesizer::MAX_OSCILLATORS] = {};
+    size_t osc_rows = 0;
+    for (size_t j = 0; j < osc_count; j++)
     {
-        f64 mixed_output = 0.0;
-        for (auto& n : synth.notes)
+        osc_channels[j] = synth.oscillators[j].Channels();
+        osc_rows += osc_channels[j];
+    }
+    const size_t voice_slots = tonewheel ? 0 : ((fm || additive || sampler || granular || waveguide || modal) ? 1 : osc_rows);
+    // Mix normalization counts oscillators, not rows
+    const f64 voice_norm = (fm || additive || sampler || granular || waveguide || modal) ? 1.0 : static_cast<f64>(std::max<size_t>(osc_count, 1));
+    const size_t voice_count = tonewheel ? 0 : note_count;
+    m_pan_gains.resize(note_count * voice_slots * 2);
+    m_voice_block.resize(note_count * voice_slots * CONTROL_RATE);
+
+    ModMatrix& matrix = synth.m_mod_matrix;
+    matrix.Update();
+    const bool filter_modulated = matrix.Targets(ModMatrix::Destination::CUTOFF) || matrix.Targets(ModMatrix::Destination::RESONANCE);
+
+    // A tuning loaded meanwhile applies from this block on
+    Tuning::Instance().Update();
+
+    // Custom waveform programs compiled meanwhile apply from this block on
+    for (size_t j = 0; j < osc_count; j++)
+        synth.oscillators_cold[j].custom.Acquire();
+
+    // A spectrum loaded meanwhile applies from this block on
+    if (additive) synth.m_additive.Update();
+
+    // A bank or preset chosen meanwhile applies from this block on
+    if (sampler) synth.m_sampler.Update();
+
+    // A recording loaded meanwhile applies from this block on, idle grains return to the pool
+    if (granular) synth.m_granular.Update();
+
+    // Modes chosen meanwhile apply to the next strike
+    if (modal) synth.m_modal.Update();
+
+    for (u32 sub_block = 0; sub_block < frame_count; sub_block += CONTROL_RATE)
+    {
+        const u32 sub_block_end = std::min(frame_count, sub_block + CONTROL_RATE);
+        const u32 control_samples = sub_block_end - sub_block;
+
+        // Control rate: evaluate the modulators at the end of the sub-block, voices ramp towards them
+        const f64 control_dt   = control_samples * m_time_per_sample;
+        const f64 control_time = m_global_time + control_dt;
+
+        LfoControl& lfo = synth.m_lfo_control;
+        const f64 lfo_rate = lfo.Rate(synth.m_lfo.m_wave.frequency);
+        lfo.phase = LfoControl::Advance(lfo.phase, lfo_rate, control_dt);
+        // Tremolo depth: the LFO amplitude times its volume
+        const f64 tremolo_depth = synth.m_lfo.m_wave.amplitude * synth.m_lfo.m_volume;
+        const f64 lfo_shared = synth.m_lfo.LfoShape(lfo.phase, synth.m_lfo_cold);
+
+        // Voice sources of the newest note drive the shared filter and effects
+        f64 global_sources[ModMatrix::SOURCE_COUNT] = {};
+        global_sources[static_cast<s32>(ModMatrix::Source::LFO)] = lfo_shared;
+        f64 newest_on = -std::numeric_limits<f64>::max();
+
+        if (tonewheel) synth.m_tonewheel.BeginBlock();
+
+        for (size_t i = 0; i < note_count; i++)
         {
-            f64 sample = 0.0;
-            bool note_finished = false;
+            note& n = synth.notes[i];
+
+            // Low Frequency Oscillator: one shared phase, or the voice's own phase when key synced
+            f64 lfo_output = lfo_shared;
+            if (lfo.key_sync)
+            {
+                n.lfo_phase = LfoControl::Advance(n.lfo_phase, lfo_rate, control_dt);
+                lfo_output  = synth.m_lfo.LfoShape(n.lfo_phase, synth.m_lfo_cold);
+            }
 
             // Amplitude Envelope
-            f64 amplitude = synth.m_amp_envelope.GenerateAmplitude(m_global_time, n.on, n.off);
-            if (amplitude <= 0.0000001)
-                note_finished = true;
+            f64 amplitude = synth.m_amp_envelope.GenerateAmplitude(control_time, n.on, n.off);
+
+            // Modulation matrix
+            f64 sources[ModMatrix::SOURCE_COUNT] = {};
+            sources[static_cast<s32>(ModMatrix::Source::LFO)]          = lfo_output;
+            sources[static_cast<s32>(ModMatrix::Source::AMP_ENVELOPE)] = amplitude;
+            sources[static_cast<s32>(ModMatrix::Source::VELOCITY)]     = n.velocity;
+            sources[static_cast<s32>(ModMatrix::Source::NOTE)]         = n.id / 127.0;
+            if (matrix.Uses(ModMatrix::Source::FILTER_ENVELOPE))
+                sources[static_cast<s32>(ModMatrix::Source::FILTER_ENVELOPE)] = synth.m_filter_envelope.GenerateAmplitude(control_time, n.on, n.off);
 
-            // Low Frequency Oscillator
-            f64 lfo_output = synth.m_lfo.GenerateWave(m_global_time, synth.m_lfo.m_wave.amplitude, synth.m_lfo.m_wave.frequency);
+            f64 mod[ModMatrix::DESTINATION_COUNT] = {};
+            matrix.Evaluate(matrix.voice_connections, sources, mod);
 
-            // Oscillators
-            for (auto& [id, osc] : synth.oscillators)
+            if (n.on > newest_on)
             {
-                // TODO: Frequency Modulation
+                newest_on = n.on;
+                std::copy(std::begin(sources), std::end(sources), global_sources);
+            }
 
-                // Generate wave
-                f64 sound = osc.GenerateWave(m_global_time - n.on, n);
+            f64 semitones = lfo_output * lfo.vibrato_depth + mod[static_cast<s32>(ModMatrix::Destination::PITCH)];
+            f64 gain = std::max(0.0, 1.0 + mod[static_cast<s32>(ModMatrix::Destination::VOLUME)]);
+
+            f64 pitch_from = n.pitch.value;
+            n.envelope.Target((fm || waveguide || modal ? 1.0 : amplitude) * gain, control_samples);
+            n.tremolo.Target(lfo_output * tremolo_depth, control_samples);
+            n.pitch.Target(std::exp2(semitones / 12.0), control_samples);
+
+            // Pan gains per oscillator, held for the sub-block
+            n.pan_mod = mod[static_cast<s32>(ModMatrix::Destination::PAN)];
+            // Engines rendering the voice themselves skip the pitch ramp, the voice clock still integrates it
+            // so the oscillators stay in time after an engine switch
+            if (tonewheel)
+            {
+                // Tonewheel organ: the key only raises the levels of the wheels it taps, rendered once below
+                synth.m_tonewheel.AddKey(n.id, amplitude * gain);
+                n.envelope.Skip(control_samples);
+                n.tremolo.Skip(control_samples);
+                n.clock += m_time_per_sample * n.pitch.Skip(control_samples);
+            }
+            else if (fm)
+            {
+                f64* gains = &m_pan_gains[i * 2];
+                pan_gains(n.pan + n.pan_mod, gains[0], gains[1]);
 
-                // Amplitude Modulation
-                sound = (sound * (1.0 + lfo_output)) * amplitude;
+                // Frequency Modulation: the operator envelopes shape the voice instead of the amplitude envelope
+                amplitude = synth.m_fm.Render(n.fm, &m_voice_block[i * CONTROL_RATE], control_samples, note_freq(n.id),
+                    pitch_from, pitch_from + control_samples * n.pitch.step, n.velocity, control_time, n.on, n.off, m_sample_rate);
+                n.clock += m_time_per_sample * n.pitch.Skip(control_samples);
+            }
+            else if (additive)
+            {
+                f64* gains = &m_pan_gains[i * 2];
+                pan_gains(n.pan + n.pan_mod, gains[0], gains[1]);
 
-                // Filter
-                if (synth.vafilter) sound = synth.m_vafilter.FilterWave(sound);
-                else                sound = synth.m_filter.FilterWave(sound);
+                // Additive: partial envelopes from the spectrum, shaped by the amplitude envelope
+                synth.m_additive.Render(n.id, n.on, &m_voice_block[i * CONTROL_RATE], control_samples, note_freq(n.id),
+                    pitch_from, pitch_from + control_samples * n.pitch.step, m_sample_rate);
+                n.clock += m_time_per_sample * n.pitch.Skip(control_samples);
+            }
+            else if (waveguide)
+            {
+                f64* gains = &m_pan_gains[i * 2];
+                pan_gains(n.pan + n.pan_mod, gains[0], gains[1]);
 
-                // Mix Oscillators
-                sample += sound;
+                // Physical model: the amplitude envelope is the breath of a tube, a released string is damped
+                amplitude = synth.m_waveguide.Render(n.id, n.on, n.off > n.on, amplitude, n.velocity, &m_voice_block[i * CONTROL_RATE],
+                    control_samples, note_freq(n.id), pitch_from + control_samples * n.pitch.step, m_sample_rate);
+                n.clock += m_time_per_sample * n.pitch.Skip(control_samples);
             }
+            else if (modal)
+            {
+                f64* gains = &m_pan_gains[i * 2];
+                pan_gains(n.pan + n.pan_mod, gains[0], gains[1]);
 
-            // Normalize
-            sample /= static_cast<f64>(synth.oscillators.size());
-            
-            // Clamp
-            sample = std::clamp(sample * synth.m_master_volume, -1.0, 1.0);
+                // Struck modes: the strike and the decay of the resonators are the envelope
+                amplitude = synth.m_modal.Render(n.id, n.on, n.off > n.on, n.velocity, &m_voice_block[i * CONTROL_RATE],
+                    control_samples, note_freq(n.id), pitch_from + control_samples * n.pitch.step, m_sample_rate);
+                n.clock += m_time_per_sample * n.pitch.Skip(control_samples);
+            }
+            else if (granular)
+            {
+                f64* gains = &m_pan_gains[i * 2];
+                pan_gains(n.pan + n.pan_mod, gains[0], gains[1]);
 
-            // Mix all
-            mixed_output += sample;
+                // Granular: the voice's grain cloud at the key pitch, shaped by the amplitude envelope
+                synth.m_granular.Render(n.id, n.on, &m_voice_block[i * CONTROL_RATE], control_samples, note_freq(n.id),
+                    pitch_from, pitch_from + control_samples * n.pitch.step, m_sample_rate);
+                n.clock += m_time_per_sample * n.pitch.Skip(control_samples);
+            }
+            else if (sampler)
+            {
+                f64* gains = &m_pan_gains[i * 2];
+                pan_gains(n.pan + n.pan_mod, gains[0], gains[1]);
+
+                // Sampler: the regions of the key resampled from the preload and the streams, shaped by the amplitude envelope
+                synth.m_sampler.Render(n.id, n.on, n.velocity, &m_voice_block[i * CONTROL_RATE], control_samples, note_freq(n.id),
+                    pitch_from, pitch_from + control_samples * n.pitch.step, m_sample_rate);
+                n.clock += m_time_per_sample * n.pitch.Skip(control_samples);
+            }
+            else
+            {
+                // Frequency Modulation: the voice clock runs at the LFO frequency ratio
+                f64 times[CONTROL_RATE];
+                for (u32 k = 0; k < control_samples; k++)
+                {
+                    times[k] = n.clock;
+                    n.clock += m_time_per_sample * n.pitch.Next();
+                }
+
+                // Oscillators: one block kernel each, mixed at audio rate below
+                size_t row = i * voice_slots;
+                for (size_t j = 0; j < osc_count; j++)
+                {
+                    Oscillator& osc = synth.oscillators[j];
+                    f64* gains = &m_pan_gains[row * 2];
+                    f64 pan = n.pan + n.pan_mod + osc.m_pan;
+                    if (osc_channels[j] == 2)
+                    {
+                        // Unison copies split to either side of the oscillator pan
+                        pan_gains(pan - osc.m_spread, gains[0], gains[1]);
+                        pan_gains(pan + osc.m_spread, gains[2], gains[3]);
+                    }
+                    else
+                    {
+                        pan_gains(pan, gains[0], gains[1]);
+                    }
+                    osc.GenerateBlock(synth.oscillators_cold[j], times, &m_voice_block[row * CONTROL_RATE], control_samples, n.id,
+                        m_sample_per_time, n.seed, osc_channels[j], CONTROL_RATE);
+                    row += osc_channels[j];
+                }
+            }
+
+            // Distortion and ladder filter: one per voice, on the mono mix of the voice enveloped here instead of at audio rate
+            if (voice_mono && !tonewheel)
+            {
+                f64* block = &m_voice_block[i * voice_slots * CONTROL_RATE];
+                for (u32 k = 0; k < control_samples; k++)
+                {
+                    f64 sound = 0.0;
+                    for (size_t j = 0; j < voice_slots; j++)
+                        sound += block[j * CONTROL_RATE + k];
+                    block[k] = (sound * (1.0 + n.tremolo.Next())) * n.envelope.Next();
+                }
+
+                // Shaped before the filter
+                if (distortion)
+                    synth.m_distortion.Process(n.distortion, block, control_samples);
+
+                // A modulated cutoff follows the sources of the voice itself: its own filter envelope sweep.
+                // Without the ladder the shared filter runs at audio rate
+                if (ladder && filter_modulated)
+                {
+                    f64 voice_filter[ModMatrix::DESTINATION_COUNT] = {};
+                    matrix.Evaluate(matrix.global_connections, sources, voice_filter);
+                    f64 octaves   = voice_filter[static_cast<s32>(ModMatrix::Destination::CUTOFF)];
+                    f64 resonance = voice_filter[static_cast<s32>(ModMatrix::Destination::RESONANCE)];
+
+                    LadderFilter f = synth.m_ladder;
+                    f.SetCutoffFast(std::clamp(f.frequency * std::exp2(octaves), 20.0, 0.49 * m_sample_rate), std::clamp(f.resonance + resonance, 0.0, 1.0));
+                    f.Process(n.ladder, block, control_samples);
+                }
+                else if (ladder)
+                {
+                    synth.m_ladder.Process(n.ladder, block, control_samples);
+                }
+
+                f64* gains = &m_pan_gains[i * voice_slots * 2];
+                pan_gains(n.pan + n.pan_mod, gains[0], gains[1]);
+            }
 
             // If the note has finished playing, deactivate it
-            if (note_finished && n.off > n.on)
+            if (amplitude <= 0.0000001 && n.off > n.on)
                 n.active = false;
         }
 
-        // Delay
-        if (!synth.delay) mixed_output = synth.m_delay.Process(mixed_output);
+        // Tonewheel bus: the wheels are shared, so vibrato and tremolo apply to the whole organ
+        if (tonewheel)
+        {
+            synth.m_tonewheel.Render(m_bus_block, control_samples, std::exp2(lfo_shared * lfo.vibrato_depth / 12.0), m_sample_rate);
+            m_bus_tremolo.Target(lfo_shared * tremolo_depth, control_samples);
+
+            if (distortion)
+                synth.m_distortion.Process(m_bus_distortion, m_bus_block, control_samples);
+
+            if (ladder)
+            {
+                for (u32 k = 0; k < control_samples; k++)
+                    m_bus_block[k] *= 1.0 + m_bus_tremolo.Next();
+
+                // The oversampling of the bus follows the settings, restarting the filter when it changes
+                if (m_bus_ladder.factor != synth.m_ladder.Factor())
+                    m_bus_ladder = {};
+                synth.m_ladder.Process(m_bus_ladder, m_bus_block, control_samples);
+            }
+        }
+
+        // Shared filter and effects
+        f64 global_mod[ModMatrix::DESTINATION_COUNT] = {};
+        matrix.Evaluate(matrix.global_connections, global_sources, global_mod);
+
+        if (filter_modulated)
+        {
+            // The shared filters follow the newest voice, the VA filter gliding there over the sub-block
+            f64 octaves   = global_mod[static_cast<s32>(ModMatrix::Destination::CUTOFF)];
+            f64 resonance = global_mod[static_cast<s32>(ModMatrix::Destination::RESONANCE)];
+            if (ladder)
+            {
+                // Voices modulated their own copy above, the tonewheel bus takes this from the next sub-block
+                LadderFilter& f = synth.m_ladder;
+                f.SetCutoffFast(std::clamp(f.frequency * std::exp2(octaves), 20.0, 0.49 * m_sample_rate), std::clamp(f.resonance + resonance, 0.0, 1.0));
+            }
+            else if (synth.vafilter)
+            {
+                VAFilter& f = synth.m_vafilter;
+                f.SetCutoffFast(std::clamp(f.frequency * std::exp2(octaves), 20.0, 0.49 * m_sample_rate), std::clamp(f.resonance + resonance, 0.0, 1.0), control_samples);
+            }
+            else
+            {
+                BqFilter& f = synth.m_filter;
+                f.SetCutoffFast(std::clamp(f.frequency * std::exp2(octaves), 20.0, 0.49 * m_sample_rate), std::clamp(f.resonance + 10.0 * resonance, 0.0, 10.0));
+            }
+        }
+        else if (matrix.filter_modulated)
+        {
+            // Routes removed: back to the base coefficients
+            synth.m_vafilter.CalcCoefs(synth.m_vafilter.frequency, synth.m_vafilter.resonance);
+            synth.m_filter.CalcCoefs(synth.m_filter.frequency, synth.m_filter.resonance);
+            synth.m_ladder.CalcCoefs(synth.m_ladder.frequency, synth.m_ladder.resonance);
+        }
+        matrix.filter_modulated = filter_modulated;
+
+        synth.m_delay.feedback_mod = global_mod[static_cast<s32>(ModMatrix::Destination::DELAY_FEEDBACK)];
+        synth.m_reverb.wet_mod     = global_mod[static_cast<s32>(ModMatrix::Destination::REVERB_WET)];
+
+        // Audio rate
+        for (u32 frame = sub_block; frame < sub_block_end; frame++)
+        {
+            f64 mixed_left  = 0.0;
+            f64 mixed_right = 0.0;
+            const f64* gains = m_pan_gains.data();
+
+            // Modulated VA cutoff, gliding one step per frame
+            if (synth.vafilter) synth.m_vafilter.Step();
+
+            if (tonewheel)
+            {
+                f64 sound = m_bus_block[frame - sub_block];
+
+                // Filter, the ladder ran at control rate
+                if (!ladder)
+                {
+                    sound *= 1.0 + m_bus_tremolo.Next();
+                    if (synth.vafilter) sound = synth.m_vafilter.FilterWave(sound);
+                    else                sound = synth.m_filter.FilterWave(sound);
+                }
+
+                // Centered, a mono organ
+                sound = std::clamp(sound * synth.m_master_volume, -1.0, 1.0) * std::sqrt(0.5);
+                mixed_left  += sound;
+                mixed_right += sound;
+            }
+            for (size_t i = 0; i < voice_count; i++)
+            {
+                note& n = synth.notes[i];
+                f64 left  = 0.0;
+                f64 right = 0.0;
+
+                // Oscillator or voice blocks rendered at control rate
+                const f64* samples = m_voice_block.data() + i * voice_slots * CONTROL_RATE + (frame - sub_block);
+                if (voice_mono)
+                {
+                    // Enveloped at control rate and mixed into the first slot, the ladder filtered there too
+                    f64 sound = samples[0];
+                    if (!ladder)
+                    {
+                        if (synth.vafilter) sound = synth.m_vafilter.FilterWave(sound);
+                        else                sound = synth.m_filter.FilterWave(sound);
+                    }
+                    left  = sound * gains[0];
+                    right = sound * gains[1];
+                    gains += voice_slots * 2;
+                }
+                else
+                {
+                    f64 amplitude = n.envelope.Next();
+                    f64 tremolo   = n.tremolo.Next();
+                    for (size_t j = 0; j < voice_slots; j++)
+                    {
+                        f64 sound = samples[j * CONTROL_RATE];
+
+                        // Amplitude Modulation
+                        sound = (sound * (1.0 + tremolo)) * amplitude;
+
+                        // Filter
+                        if (synth.vafilter) sound = synth.m_vafilter.FilterWave(sound);
+                        else                sound = synth.m_filter.FilterWave(sound);
+
+                        // Pan and mix Oscillators
+                        left  += sound * gains[0];
+                        right += sound * gains[1];
+                        gains += 2;
+                    }
+                }
+
+                // Normalize
+                left  /= voice_norm;
+                right /= voice_norm;
+
+                // Clamp
+                left  = std::clamp(left  * synth.m_master_volume, -1.0, 1.0);
+                right = std::clamp(right * synth.m_master_volume, -1.0, 1.0);
+
+                // Mix all
+                mixed_left  += left;
+                mixed_right += right;
+            }
+
+            // Distortion
+            if (synth.master_distortion) synth.m_master_distortion.Process(mixed_left, mixed_right);
+
+            // Delay
+            if (!synth.delay) synth.m_delay.Process(mixed_left, mixed_right);
+
+            // Reverb
+            if (!synth.reverb) synth.m_reverb.Process(mixed_left, mixed_right);
 
-        // Reverb
-        if (!synth.reverb) mixed_output = synth.m_reverb.Process(mixed_output);
+            // Equalizer
+            if (!synth.eq) synth.m_eq.Process(mixed_left, mixed_right);
 
-        // Equalizer
-        if (!synth.eq) mixed_output = synth.m_eq.Process(mixed_output);
+            // Multiband dynamics
+            if (synth.multiband) synth.m_multiband.Process(mixed_left, mixed_right);
 
-        mixed_output = std::clamp(mixed_output, -1.0, 1.0);
-        synth.UpdateWaveData(frame, mixed_output);
+            output_left[frame]  = std::clamp(mixed_left,  -1.0, 1.0);
+            output_right[frame] = std::clamp(mixed_right, -1.0, 1.0);
+            synth.UpdateWaveData(frame, 0.5 * (output_left[frame] + output_right[frame]));
 
-        // Update time
-        m_global_time += m_time_per_sample;
+            // Live grain source: the recent output, whatever the synthesis
+            if (capture) synth.m_granular.Capture(0.5 * (output_left[frame] + output_right[frame]));
+
+            // Update time
+            m_global_time += m_time_per_sample;
+        }
     }
 
-    return synth.wave_data.samples;
+    // Map the stereo pair to the device: mono downmix, or left/right repeated over extra channels
+    if (m_channels == 1)
+    {
+        for (u32 frame = 0; frame < frame_count; frame++)
+            output_left[frame] = 0.5 * (output_left[frame] + output_right[frame]);
+    }
+    for (u32 channel = 2; channel < m_channels; channel++)
+        std::copy(m_output.Channel(channel % 2), m_output.Channel(channel % 2) + frame_count, m_output.Channel(channel));
+
+    return m_output;
 }
 
 const f64 AudioEngine::Timestep() const
@@ -133,15 +765,22 @@ const u32 AudioEngine::BlockSamples() const
 
 const std::vector<std::string> AudioEngine::GetOutputDeviceNames()
 {
+    if (!m_driver) return {};
     return m_driver->GetOutputDevices();
 }
 
 void AudioEngine::SetOutputDevice(s32 index)
 {
-    m_driver->SetOutputDevice(index);
+    if (m_driver) m_driver->SetOutputDevice(index);
 }
 
 const s32 AudioEngine::GetOutputDevice()
 {
+    if (!m_driver) return 0;
     return m_driver->GetOutputDevice();
+}
+
+AudioDriver* AudioEngine::GetDriver()
+{
+    return m_driver.get();
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
 #include <cmath>
 #include <string>
 #include <vector>
@@ -13,7 +16,10 @@
 #include "miniaudio.h"
 
 #include "../Core/Common.h"
+#include "../Core/RingBuffer.h"
 #include "Driver/AudioDriver.h"
+#include "AudioBuffer.h"
+#include "Realtime.h"
 #include "Synth/Synthesizer.h"
 
 
@@ -21,13 +27,17 @@ class AudioEngine
 {
 public:
     AudioEngine();
-    friend class MiniAudio;
+    friend class AudioDriver;
+    friend class OfflineRenderer;
 
 public: // Synthesizers, synthesizers, synthesizers
     Synthesizer synth;
 
 public: // Audio Engine Interface
-    bool Init(u32 sample_rate = 44100, u32 channels = 1, u32 blocks = 8, u32 block_samples = 512);
+    // Opens and starts the given driver, or the miniaudio backend when none is given
+    bool Init(u32 sample_rate = 44100, u32 channels = 1, u32 blocks = 8, u32 block_samples = 512, std::unique_ptr<AudioDriver> driver = nullptr);
+    // Configure the engine without opening an audio device, for offline rendering
+    bool InitOffline(u32 sample_rate = 44100, u32 channels = 1, u32 block_samples = 512);
     void Update(f64 time);
     void Shutdown();
 
@@ -41,6 +51,27 @@ public: // Accessors
     const std::vector<std::string> GetOutputDeviceNames();
     void SetOutputDevice(s32 index);
     const s32 GetOutputDevice();
+    AudioDriver* GetDriver();
+
+public: // Real-time
+    // Thread priority, CPU affinity and memory locking. Call before Init. The thread options are
+    // reported by the first Update after each thread has run.
+    void SetRealtimeOptions(const RealtimeOptions& options);
+    const RealtimeOptions& GetRealtimeOptions() const;
+
+public: // Render-ahead
+    // Playback-only mode: a render thread keeps Blocks() blocks of BlockSamples() frames ready
+    // in a lock-free ring and the driver callback only copies them out. This trades latency for
+    // robustness against scheduling jitter; live input should keep the direct path.
+    // Call before Init.
+    void SetRenderAhead(bool enable);
+    bool IsRenderAhead() const;
+    u64 RenderAheadUnderruns() const;
+
+public: // Sequencing
+    // Called on the thread rendering the blocks, before each block, with the engine time. Notes sent
+    // from here reach the synth without racing the audio thread. Call before Init.
+    void SetBlockCallback(std::function<void(f64 time)> callback);
 
 private: // Audio Engine Internal
     u32 m_sample_rate     = 44100;
@@ -51,9 +82,59 @@ private: // Audio Engine Internal
     f64 m_time_per_sample = 1.0 / 44100.0;
     f64 m_global_time     = 0.0;
 
+private: // Audio Engine Config
+    void Configure(u32 sample_rate, u32 channels, u32 blocks, u32 block_samples);
+
 private: // Audio Driver Internal
-    // Generate samples for FillOutputBuffer in AudioDriver
-    std::vector<f64>& ProcessOutputBlock(u32 frame_count);
+    // Generate a planar block of Channels() channels for FillOutputBuffer in AudioDriver
+    AudioBuffer& ProcessOutputBlock(u32 frame_count);
+    // Interleaved f32 frames for the driver callback: rendered directly, or copied from the render-ahead ring
+    void PullOutputBlock(f32* output, u32 frame_count);
+    // Applies the real-time options to the driver callback thread on its first call
+    void PrepareAudioThread();
     // Audio Driver
     std::unique_ptr<AudioDriver> m_driver;
+    // Planar output, at least a stereo pair, and the per block voice x oscillator pan gains
+    AudioBuffer m_output;
+    std::vector<f64> m_pan_gains;
+    std::vector<f64> m_voice_block; // CONTROL_RATE samples per voice for engines rendering whole voices
+    f64 m_bus_block[CONTROL_RATE] = {}; // engines summing all keys into one bus (tonewheel organ)
+    ControlRamp m_bus_tremolo;
+    LadderVoice m_bus_ladder;
+    DistortionVoice m_bus_distortion;
+    std::function<void(f64 time)> m_block_callback;
+
+private: // Render-ahead Internal
+    void StartRenderAhead();
+    void StopRenderAhead();
+    void RenderAheadThread();
+    u32 RenderAheadRoom() const;
+
+    bool m_render_ahead = false;
+    std::atomic<bool> m_render_running = false;
+    std::atomic<u64> m_render_underruns = 0;
+    std::atomic<u64> m_render_reads = 0; // bumped by the consumer after each read, the producer waits on it
+    std::thread m_render_thread;
+    RingBuffer<f32> m_render_ring;
+    std::vector<f32> m_render_interleaved;
+
+private: // Real-time Internal
+    struct ThreadSetup
+    {
+        std::atomic<bool> claimed  = false;
+        std::atomic<bool> ready    = false;
+        std::atomic<bool> reported = false;
+        bool priority_ok = false;
+        bool affinity_ok = false;
+        std::string priority_error;
+        std::string affinity_error;
+    };
+
+    void SetupThread(ThreadSetup& setup, s32 cpu);
+    void ReportThread(const char* name, ThreadSetup& setup, s32 cpu);
+    void LockCoreBuffers();
+
+    RealtimeOptions m_realtime;
+    ThreadSetup m_audio_thread;
+    ThreadSetup m_worker_thread;
 };
\ No newline at end of file
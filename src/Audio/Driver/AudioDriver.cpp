@@ -49,6 +49,14 @@ void AudioDriver::SetOutputDevice(s32 index)
 
 }
 
+void AudioDriver::FillOutputBuffer(void* pOutput, u32 frameCount)
+{
+    m_host->PrepareAudioThread();
+
+    // Render the planar block and convert it to interleaved f32 for the sound card
+    m_host->PullOutputBlock(static_cast<f32*>(pOutput), frameCount);
+}
+
 // miniaudio backend
 MiniAudio::MiniAudio(AudioEngine* host) : AudioDriver(host)
 {
@@ -64,6 +72,8 @@ bool MiniAudio::Open()
 {
     // Initialize audio context
     m_context_config = ma_context_config_init();
+    if (m_host->GetRealtimeOptions().realtime_priority)
+        m_context_config.threadPriority = ma_thread_priority_realtime;
     if (ma_context_init(nullptr, 0, &m_context_config, &m_context) != MA_SUCCESS)
     {
         std::printf("ERROR: Failed to initialize context");
@@ -78,6 +88,8 @@ bool MiniAudio::Open()
     m_device_config.sampleRate = m_host->SampleRate();
     m_device_config.dataCallback = MiniAudio_Callback;
     m_device_config.pUserData = this;
+    if (m_host->GetRealtimeOptions().realtime_priority)
+        m_device_config.wasapi.usage = ma_wasapi_usage_pro_audio;
 
     if (ma_device_init(&m_context, &m_device_config, &m_device) != MA_SUCCESS)
     {
@@ -193,24 +205,175 @@ const s32 MiniAudio::GetOutputDevice()
     return (it != m_output_devices.end()) ? std::distance(m_output_devices.begin(), it) : 0;
 }
 
-void MiniAudio::FillOutputBuffer(void* pOutput, u32 frameCount)
+void MiniAudio::MiniAudio_Callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
+{
+    MiniAudio* driver = (MiniAudio*)pDevice->pUserData;
+    driver->FillOutputBuffer(pOutput, frameCount);
+}
+
+// Loopback backend
+LoopbackDriver::LoopbackDriver(AudioEngine* host) : AudioDriver(host)
 {
-    // Generate mixed samples for sound card
-    std::vector<f64>& mixed_outputs = m_host->ProcessOutputBlock(frameCount);
-    u32 channels = m_host->Channels();
 
-    // Fill output buffer with mixed samples for each channel, interleaved
-    f32* pFramesOutF32 = (f32*)pOutput;
-    for (u32 frame = 0; frame < frameCount; frame++)
+}
+
+LoopbackDriver::~LoopbackDriver()
+{
+    Stop();
+}
+
+bool LoopbackDriver::Open()
+{
+    if (config.period_frames == 0)
     {
-        f32 mixed_output = static_cast<f32>(mixed_outputs[frame]);
-        for (u32 channel = 0; channel < channels; channel++)
-            pFramesOutF32[frame * channels + channel] = mixed_output;
+        std::printf("ERROR: Loopback period must be at least one frame.\n");
+        return false;
     }
+
+    m_period.assign(config.period_frames * m_host->Channels(), 0.0f);
+    m_capture.clear();
+    m_stats = Stats();
+    m_rand.seed(config.seed);
+    m_current_device = "Loopback";
+
+    std::printf("INFO: Audio device initialized\n");
+    std::printf("INFO: Device: %s\n", m_current_device.c_str());
+    std::printf("INFO: Backend: loopback | %s\n", config.paced ? "paced" : "as fast as possible");
+    std::printf("INFO: Channels:      %d\n", m_host->Channels());
+    std::printf("INFO: Sample rate:   %d Hz\n", m_host->SampleRate());
+    std::printf("INFO: Periods size:  %d\n", config.period_frames);
+
+    EnumerateOutputDevices();
+
+    return true;
 }
 
-void MiniAudio::MiniAudio_Callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
+void LoopbackDriver::Close()
 {
-    MiniAudio* driver = (MiniAudio*)pDevice->pUserData;
-    driver->FillOutputBuffer(pOutput, frameCount);
+    Stop();
+
+    Stats stats = GetStats();
+    f64 average = stats.periods ? stats.callback_total / stats.periods : 0.0;
+    std::printf("INFO: Audio device closed.\n");
+    std::printf("INFO: Loopback periods:  %llu (%.3f s simulated)\n", (unsigned long long)stats.periods, stats.simulated_time);
+    std::printf("INFO: Loopback xruns:    %llu\n", (unsigned long long)stats.xruns);
+    std::printf("INFO: Callback time:     min %.1f us | avg %.1f us | max %.1f us\n", stats.callback_min * 1e6, average * 1e6, stats.callback_max * 1e6);
+}
+
+bool LoopbackDriver::Start()
+{
+    if (m_running) return true;
+
+    m_running = true;
+    m_thread = std::thread(&LoopbackDriver::Run, this);
+    return true;
+}
+
+void LoopbackDriver::Stop()
+{
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void LoopbackDriver::EnumerateOutputDevices()
+{
+    m_output_devices = { m_current_device };
+}
+
+const s32 LoopbackDriver::GetOutputDevice()
+{
+    return 0;
+}
+
+LoopbackDriver::Stats LoopbackDriver::GetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::vector<f32> LoopbackDriver::GetCapture()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_capture;
+}
+
+bool LoopbackDriver::IsRunning() const
+{
+    return m_running;
+}
+
+bool LoopbackDriver::Wait()
+{
+    if (config.max_periods == 0)
+    {
+        std::printf("ERROR: Loopback runs until Stop without max_periods, nothing to wait for.\n");
+        return false;
+    }
+
+    if (m_thread.joinable())
+        m_thread.join();
+    return true;
+}
+
+// Device model: period slot s starts at s * T and its data must be ready by (s + 1) * T.
+// A late period is an xrun: the slot plays silence and the late block is played in the next slot.
+void LoopbackDriver::Run()
+{
+    using clock = std::chrono::steady_clock;
+
+    const u32 frames = config.period_frames;
+    const u32 channels = m_host->Channels();
+    const f64 period_time = f64(frames) / f64(m_host->SampleRate());
+    const auto start = clock::now();
+
+    u64 slot = 0;
+    u64 period = 0;
+    while (m_running)
+    {
+        if (config.max_periods && period >= config.max_periods)
+            break;
+
+        // Injected scheduling jitter and deadline misses
+        f64 delay = 0.0;
+        if (config.jitter > 0.0)
+            delay += m_rand.uniform(0.0, config.jitter);
+        if (config.miss_probability > 0.0 && m_rand.bernoulli(config.miss_probability))
+            delay += period_time;
+
+        f64 wake_time = slot * period_time + delay;
+        if (config.paced)
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<f64>(wake_time)));
+
+        auto t1 = clock::now();
+        FillOutputBuffer(m_period.data(), frames);
+        auto t2 = clock::now();
+
+        f64 callback_time = std::chrono::duration<f64>(t2 - t1).count();
+        f64 completion_time = config.paced ? std::chrono::duration<f64>(t2 - start).count() : wake_time + callback_time;
+        bool xrun = completion_time > (slot + 1) * period_time;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stats.periods == 0 || callback_time < m_stats.callback_min) m_stats.callback_min = callback_time;
+            if (callback_time > m_stats.callback_max) m_stats.callback_max = callback_time;
+            m_stats.callback_total += callback_time;
+            m_stats.periods++;
+
+            if (xrun)
+            {
+                m_stats.xruns++;
+                if (config.capture) m_capture.insert(m_capture.end(), frames * channels, 0.0f);
+                slot++;
+            }
+
+            if (config.capture) m_capture.insert(m_capture.end(), m_period.begin(), m_period.end());
+            slot++;
+            m_stats.simulated_time = slot * period_time;
+        }
+
+        period++;
+    }
+
+    m_running = false;
 }
\ No newline at end of file
@@ -6,10 +6,12 @@
 #include <atomic>
 #include <thread>
 #include <algorithm>
+#include <chrono>
 
 #include "miniaudio.h"
 
 #include "../../Core/Common.h"
+#include "../../Core/Random.h"
 
 class AudioEngine;
 
@@ -31,6 +33,10 @@ public:
     virtual const s32 GetOutputDevice();
     virtual void SetOutputDevice(s32 index);
 
+public:
+    // Pull a block from the host and write it interleaved as f32 into pOutput
+    void FillOutputBuffer(void* pOutput, u32 frameCount);
+
 protected:
     AudioEngine* m_host = nullptr;
 
@@ -56,9 +62,6 @@ public:
     void SetOutputDevice(s32 index) override;
     const s32 GetOutputDevice() override;
 
-public:
-    void FillOutputBuffer(void* pOutput, u32 frameCount);
-
 private: // miniaudio specific implementations
     static void MiniAudio_Callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
 
@@ -73,4 +76,66 @@ private: // miniaudio specific implementations
 
     ma_device_info* m_capture_device_infos;
     ma_uint32 m_capture_device_count;
+};
+
+
+// Device-less backend: pulls blocks from the host on its own thread against a simulated clock,
+// either as fast as possible or paced to real time, and captures the output to memory.
+// Jitter and deadline misses can be injected to exercise xrun handling.
+class LoopbackDriver : public AudioDriver
+{
+public:
+    LoopbackDriver(AudioEngine* host);
+    ~LoopbackDriver();
+
+public:
+    bool Open() override;
+    void Close() override;
+    bool Start() override;
+    void Stop() override;
+
+public:
+    void EnumerateOutputDevices() override;
+    const s32 GetOutputDevice() override;
+
+public:
+    struct Config
+    {
+        u32 period_frames     = 441;   // frames per callback
+        bool paced            = false; // sleep until each period deadline instead of running as fast as possible
+        f64 jitter            = 0.0;   // max random wake-up delay per period (seconds)
+        f64 miss_probability  = 0.0;   // chance that a period is delayed past its deadline
+        u64 max_periods       = 0;     // stop after this many periods, 0 runs until Stop
+        bool capture          = true;  // keep the output in memory
+        u32 seed              = 1;
+    } config;
+
+    struct Stats
+    {
+        u64 periods         = 0;
+        u64 xruns           = 0;
+        f64 callback_min    = 0.0;     // seconds
+        f64 callback_max    = 0.0;     // seconds
+        f64 callback_total  = 0.0;     // seconds
+        f64 simulated_time  = 0.0;     // seconds of device time
+    };
+
+    Stats GetStats();
+    std::vector<f32> GetCapture();
+    bool IsRunning() const;
+    // Block until the driver has stopped by itself (max_periods reached).
+    // Refuses with max_periods 0, where only Stop ends the run.
+    bool Wait();
+
+private:
+    void Run();
+
+    std::thread m_thread;
+    std::atomic<bool> m_running = false;
+    std::mutex m_mutex;
+
+    Stats m_stats;
+    std::vector<f32> m_period;
+    std::vector<f32> m_capture;
+    randf64 m_rand;
 };
\ No newline at end of file
@@ -13,6 +13,7 @@
 		(.mid) Standard MIDI File Format: https://faydoc.tripod.com/formats/mid.htm
 		Standard MIDI-File Format Spec. 1.1, updated: https://www.music.mcgill.ca/~ich/classes/mumt306/StandardMIDIfileformat.html
 */
+#pragma once
 
 #include <iostream>
 #include <string>
@@ -24,6 +25,7 @@
 using u8  = uint8_t;
 using u16 = uint16_t;
 using u32 = uint32_t;
+using f64 = double;
 
 struct MidiEvent
 {
@@ -141,6 +143,7 @@ struct MidiFile
 		std::cout << "INFO: Format: " << h.format << "\n";
 		std::cout << "INFO: Number of Tracks: " << h.track_chunks << "\n";
 		std::cout << "INFO: Division: " << h.division << "\n";
+		division = h.division;
 
 		// Parse Track Chunk
 		for (u16 chunk = 0; chunk < h.track_chunks; chunk++)
@@ -193,6 +196,14 @@ struct MidiFile
 	}
 
 public: // Helper functions
+	// Convert ticks to seconds using the division and the first tempo event (120 BPM if none)
+	f64 ticks_to_sec(u32 ticks)
+	{
+		f64 us_per_quarter = tempo ? tempo : 500000.0;
+		f64 ticks_per_quarter = division ? division : 96.0;
+		return ticks * us_per_quarter / (ticks_per_quarter * 1000000.0);
+	}
+
 	// Swap endianness of 32-bit and 16-bit integer
 	u32 swap_endian32(u32 n) { return ((n & 0xFF000000) >> 24) | ((n & 0x00FF0000) >> 8) | ((n & 0x0000FF00) << 8) | ((n & 0x000000FF) << 24); }
 	u16 swap_endian16(u16 n) { return (n >> 8) | (n << 8); }
@@ -438,6 +449,7 @@ public:
 	std::vector<MidiTrack> tracks;
 	u32 tempo = 0;
 	u32 BPM = 0;
+	u16 division = 0;
 
 	u8 status = 0;
 	u8 prev_status = 0;
@@ -0,0 +1,245 @@
+#include <sstream>
+#include <cmath>
+
+#include "OfflineRenderer.h"
+
+OfflineRenderer::OfflineRenderer(AudioEngine* host) : m_host(host)
+{
+}
+
+bool OfflineRenderer::LoadScript(const std::string& filename)
+{
+    std::ifstream f(filename);
+    if (!f.is_open())
+    {
+        std::printf("ERROR: Could not open the file: %s\n", filename.c_str());
+        return false;
+    }
+
+    std::string line;
+    u32 line_number = 0;
+    while (std::getline(f, line))
+    {
+        line_number++;
+
+        // '#' starts a comment unless it is part of a note name, e.g. C#4
+        for (size_t i = 0; i < line.size(); i++)
+        {
+            if (line[i] == '#' && (i == 0 || std::isspace(static_cast<unsigned char>(line[i - 1]))))
+            {
+                line.resize(i);
+                break;
+            }
+        }
+
+        std::istringstream ss(line);
+        f64 start = 0.0, duration = 0.0;
+        std::string name;
+        if (!(ss >> start))
+            continue;
+
+        if (!(ss >> duration >> name) || duration <= 0.0)
+        {
+            std::printf("ERROR: %s:%d: expected <start> <duration> <note>\n", filename.c_str(), line_number);
+            return false;
+        }
+
+        s32 note_id = note_from_name(name);
+        if (note_id < 0 || note_id > 127)
+        {
+            std::printf("ERROR: %s:%d: invalid note '%s'\n", filename.c_str(), line_number, name.c_str());
+            return false;
+        }
+
+        f64 velocity = 127.0;
+        ss >> velocity;
+        AddNote(start, duration, note_id, std::clamp(velocity, 0.0, 127.0) / 127.0);
+    }
+
+    std::printf("INFO: Loaded %zu events from %s\n", m_events.size(), filename.c_str());
+    return true;
+}
+
+bool OfflineRenderer::LoadMidi(const std::string& filename)
+{
+    MidiFile midi;
+    if (!midi.Parse(filename))
+        return false;
+
+    for (auto& track : midi.tracks)
+        for (auto& n : track.notes)
+            AddNote(midi.ticks_to_sec(n.start_time), midi.ticks_to_sec(n.duration), n.key, n.vel / 127.0);
+
+    std::printf("INFO: Loaded %zu events from %s\n", m_events.size(), filename.c_str());
+    return true;
+}
+
+bool OfflineRenderer::Load(const std::string& filename)
+{
+    std::string ext = filename.substr(filename.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    if (ext == "mid" || ext == "midi") return LoadMidi(filename);
+    else                               return LoadScript(filename);
+}
+
+void OfflineRenderer::AddNote(f64 start, f64 duration, s32 note_id, f64 velocity)
+{
+    m_events.push_back({ start, note_id, true, velocity });
+    m_events.push_back({ start + duration, note_id, false, velocity });
+}
+
+const std::vector<OfflineRenderer::Event>& OfflineRenderer::GetEvents() const
+{
+    return m_events;
+}
+
+// Note offs go before note ons at the same time, so back to back notes retrigger
+void OfflineRenderer::SortEvents()
+{
+    std::stable_sort(m_events.begin(), m_events.end(), [](const Event& a, const Event& b) {
+        if (a.time != b.time) return a.time < b.time;
+        return !a.on && b.on;
+    });
+}
+
+bool OfflineRenderer::Render(const std::string& filename, u16 bits_per_sample, f64 tail)
+{
+    SortEvents();
+
+    const u32 channels = m_host->Channels();
+    const u32 block_samples = m_host->BlockSamples();
+    const f64 sample_rate = f64(m_host->SampleRate());
+
+    WavFile wav(m_host->SampleRate(), channels, bits_per_sample);
+    if (!wav.Open(filename))
+        return false;
+
+    std::vector<f64> interleaved(block_samples * channels, 0.0);
+    Synthesizer& synth = m_host->synth;
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    size_t next_event = 0;
+    f64 tail_end = -1.0;
+    while (true)
+    {
+        f64 now = m_host->m_global_time;
+
+        // Dispatch events due within this sample
+        while (next_event < m_events.size() && m_events[next_event].time < now + 0.5 * m_host->m_time_per_sample)
+        {
+            const Event& e = m_events[next_event++];
+            if (e.on) synth.NoteOn(e.time, e.note_id, e.velocity);
+            else      synth.NoteOff(e.time, e.note_id);
+        }
+
+        // Split the block at the next event so notes start on their own sample
+        u32 frame_count = block_samples;
+        if (next_event < m_events.size())
+        {
+            f64 until_event = std::ceil((m_events[next_event].time - now) * sample_rate);
+            frame_count = u32(std::clamp(until_event, 1.0, f64(block_samples)));
+        }
+        else if (synth.notes.empty())
+        {
+            // Let delay and reverb ring out once every voice has finished
+            if (tail_end < 0.0) tail_end = now + tail;
+            if (now >= tail_end) break;
+            frame_count = u32(std::clamp(std::ceil((tail_end - now) * sample_rate), 1.0, f64(block_samples)));
+        }
+
+        AudioBuffer& block = m_host->ProcessOutputBlock(frame_count);
+        for (u32 channel = 0; channel < channels; channel++)
+        {
+            const f64* samples = block.Channel(channel);
+            for (u32 frame = 0; frame < frame_count; frame++)
+                interleaved[frame * channels + channel] = samples[frame];
+        }
+        wav.Write(interleaved.data(), frame_count);
+
+        // Remove finished notes
+        m_host->Update(m_host->m_time_per_sample);
+    }
+
+    auto t2 = std::chrono::steady_clock::now();
+    f64 wall_time = std::chrono::duration<f64>(t2 - t1).count();
+    f64 audio_time = wav.frames_written / sample_rate;
+
+    if (!wav.Close())
+    {
+        std::printf("ERROR: Failed to write %s\n", filename.c_str());
+        return false;
+    }
+
+    std::printf("INFO: Rendered:        %s\n", filename.c_str());
+    std::printf("INFO: Audio time:      %.3f s (%u frames)\n", audio_time, wav.frames_written);
+    std::printf("INFO: Render time:     %.3f s\n", wall_time);
+    std::printf("INFO: Real-time factor: %.2fx\n", wall_time > 0.0 ? audio_time / wall_time : 0.0);
+
+    return true;
+}
+
+bool OfflineRenderer::RenderLoopback(const std::string& filename, const LoopbackDriver::Config& config, u16 bits_per_sample, f64 tail, u32 render_ahead)
+{
+    SortEvents();
+
+    const u32 channels = m_host->Channels();
+    const f64 sample_rate = f64(m_host->SampleRate());
+    const f64 end_time = (m_events.empty() ? 0.0 : m_events.back().time) + tail;
+
+    WavFile wav(m_host->SampleRate(), channels, bits_per_sample);
+    if (!wav.Open(filename))
+        return false;
+
+    auto driver = std::make_unique<LoopbackDriver>(m_host);
+    LoopbackDriver* loopback = driver.get();
+    loopback->config = config;
+    loopback->config.capture = true;
+    loopback->config.max_periods = u64(std::ceil(end_time * sample_rate / std::max(config.period_frames, 1u)));
+
+    // Events due within the next sample, then remove finished notes, all on the rendering thread
+    size_t next_event = 0;
+    Synthesizer& synth = m_host->synth;
+    m_host->SetBlockCallback([this, &synth, &next_event](f64 now) {
+        while (next_event < m_events.size() && m_events[next_event].time < now + 0.5 * m_host->m_time_per_sample)
+        {
+            const Event& e = m_events[next_event++];
+            if (e.on) synth.NoteOn(e.time, e.note_id, e.velocity);
+            else      synth.NoteOff(e.time, e.note_id);
+        }
+        m_host->Update(m_host->m_time_per_sample);
+    });
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    m_host->SetRenderAhead(render_ahead > 0);
+    bool ok = m_host->Init(m_host->SampleRate(), channels, std::max(render_ahead, 1u), m_host->BlockSamples(), std::move(driver)) && loopback->Wait();
+
+    auto t2 = std::chrono::steady_clock::now();
+    f64 wall_time = std::chrono::duration<f64>(t2 - t1).count();
+
+    std::vector<f32> capture = loopback->GetCapture();
+    m_host->Shutdown();
+    m_host->SetBlockCallback(nullptr);
+    m_host->SetRenderAhead(false);
+    if (!ok)
+        return false;
+
+    std::vector<f64> interleaved(capture.begin(), capture.end());
+    wav.Write(interleaved.data(), u32(interleaved.size() / channels));
+    f64 audio_time = wav.frames_written / sample_rate;
+
+    if (!wav.Close())
+    {
+        std::printf("ERROR: Failed to write %s\n", filename.c_str());
+        return false;
+    }
+
+    std::printf("INFO: Rendered:        %s (loopback)\n", filename.c_str());
+    std::printf("INFO: Audio time:      %.3f s (%u frames)\n", audio_time, wav.frames_written);
+    std::printf("INFO: Render time:     %.3f s\n", wall_time);
+    std::printf("INFO: Real-time factor: %.2fx\n", wall_time > 0.0 ? audio_time / wall_time : 0.0);
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "../Core/Common.h"
+#include "AudioEngine.h"
+#include "MIDI/MidiFile.h"
+#include "WAV/WavFile.h"
+
+// Drives the engine block processing without an audio device and writes the output to a WAV file
+// as fast as the CPU allows. Notes come from a note script or a MIDI file.
+//
+// Note script format, one note per line, '#' after whitespace starts a comment:
+//     <start time (s)> <duration (s)> <note name or MIDI number> [velocity 0-127]
+//     0.0  1.0  C4
+//     0.5  0.5  69  100
+class OfflineRenderer
+{
+public:
+    OfflineRenderer(AudioEngine* host);
+
+public:
+    bool LoadScript(const std::string& filename);
+    bool LoadMidi(const std::string& filename);
+    bool Load(const std::string& filename);
+
+    // Render all loaded notes, then keep rendering for tail seconds after the last voice finished
+    bool Render(const std::string& filename, u16 bits_per_sample = 16, f64 tail = 2.0);
+    // Render the same notes through a loopback driver instead, for tail seconds after the last event, so the
+    // driver callback, render-ahead and xrun accounting run as with a sound card. Notes are sent from the
+    // rendering thread, at block boundaries. With render_ahead blocks, a worker renders them ahead of the callback.
+    bool RenderLoopback(const std::string& filename, const LoopbackDriver::Config& config, u16 bits_per_sample = 16, f64 tail = 2.0, u32 render_ahead = 0);
+
+public:
+    struct Event
+    {
+        f64 time;
+        s32 note_id;
+        bool on;
+        f64 velocity = 1.0;
+    };
+
+    void AddNote(f64 start, f64 duration, s32 note_id, f64 velocity = 1.0);
+    const std::vector<Event>& GetEvents() const;
+
+private:
+    void SortEvents();
+
+    AudioEngine* m_host = nullptr;
+    std::vector<Event> m_events;
+};
\ No newline at end of file
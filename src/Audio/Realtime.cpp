@@ -0,0 +1,113 @@
+#include <algorithm>
+
+#include "Realtime.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <avrt.h>
+#pragma comment(lib, "Avrt.lib")
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <cerrno>
+#endif
+
+bool set_thread_realtime_priority(s32 priority, std::string& error)
+{
+#if defined(_WIN32)
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+    {
+        error = "SetThreadPriority failed (" + std::to_string(GetLastError()) + ")";
+        return false;
+    }
+
+    DWORD task_index = 0;
+    if (!AvSetMmThreadCharacteristicsA("Pro Audio", &task_index))
+    {
+        error = "AvSetMmThreadCharacteristics failed (" + std::to_string(GetLastError()) + ")";
+        return false;
+    }
+    return true;
+#elif defined(__linux__) || defined(__APPLE__)
+    sched_param param = {};
+    param.sched_priority = std::clamp(priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+
+    s32 result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (result != 0)
+    {
+        error = std::string("SCHED_FIFO: ") + std::strerror(result);
+        return false;
+    }
+    return true;
+#else
+    error = "not supported on this platform";
+    return false;
+#endif
+}
+
+bool set_thread_affinity(s32 cpu, std::string& error)
+{
+#if defined(_WIN32)
+    if (cpu < 0 || cpu >= 64 || !SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu))
+    {
+        error = "SetThreadAffinityMask failed for core " + std::to_string(cpu);
+        return false;
+    }
+    return true;
+#elif defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        error = "invalid core " + std::to_string(cpu);
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    s32 result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result != 0)
+    {
+        error = std::string("core ") + std::to_string(cpu) + ": " + std::strerror(result);
+        return false;
+    }
+    return true;
+#else
+    error = "not supported on this platform";
+    return false;
+#endif
+}
+
+bool lock_buffer(void* data, size_t bytes, std::string& error)
+{
+    if (data == nullptr || bytes == 0) return true;
+
+    bool locked = true;
+#if defined(_WIN32)
+    if (!VirtualLock(data, bytes))
+    {
+        error = "VirtualLock failed (" + std::to_string(GetLastError()) + ")";
+        locked = false;
+    }
+    size_t page_size = 4096;
+#else
+    if (mlock(data, bytes) != 0)
+    {
+        error = std::string("mlock: ") + std::strerror(errno);
+        locked = false;
+    }
+    size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+#endif
+
+    // Prefault: touch every page without changing its contents
+    volatile u8* bytes_ptr = static_cast<volatile u8*>(data);
+    for (size_t offset = 0; offset < bytes; offset += page_size)
+        bytes_ptr[offset] = bytes_ptr[offset];
+    bytes_ptr[bytes - 1] = bytes_ptr[bytes - 1];
+
+    return locked;
+}
\ No newline at end of file
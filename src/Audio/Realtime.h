@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+#include "../Core/Common.h"
+
+// Real-time scheduling, CPU affinity and memory locking for the audio path
+// Linux:   SCHED_FIFO, pthread_setaffinity_np, mlock (needs rtprio/memlock limits, e.g. /etc/security/limits.conf)
+// Windows: THREAD_PRIORITY_TIME_CRITICAL + MMCSS "Pro Audio", SetThreadAffinityMask, VirtualLock
+struct RealtimeOptions
+{
+    bool realtime_priority = false; // request real-time scheduling for the audio and worker threads
+    s32  priority          = 70;    // SCHED_FIFO priority (1-99)
+    s32  audio_cpu         = -1;    // core for the driver callback thread, -1 leaves it unpinned
+    s32  worker_cpu        = -1;    // core for the render-ahead thread, -1 leaves it unpinned
+    bool lock_memory       = false; // lock and prefault the engine core buffers at Init (effects, waveguide, output)
+};
+
+// Apply to the calling thread, on failure error holds the reason
+bool set_thread_realtime_priority(s32 priority, std::string& error);
+bool set_thread_affinity(s32 cpu, std::string& error);
+
+// Lock the pages of a buffer in RAM and touch each one so the audio thread never page faults on it
+bool lock_buffer(void* data, size_t bytes, std::string& error);
\ No newline at end of file
@@ -0,0 +1,549 @@
+#pragma once
+
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <complex>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+#include "../../Core/Published.h"
+#include "FFT.h"
+#include "FrequencyModulator.h"
+
+// Additive synthesis and resynthesis: hundreds of partials per voice, each with its own amplitude and
+// frequency envelope. Partials are drawn into a spectrum and turned into sound with an inverse FFT and
+// windowed overlap-add, so the cost per frame is a few bins per partial plus one FFT instead of one sine
+// per partial per sample. Strictly harmonic spectra can take a recurrence path that sums sin(k theta)
+// without any trigonometry per partial.
+// FFT^-1 additive synthesis: https://hal.science/hal-01161348/document (Rodet, Depalle)
+// Spectral modeling synthesis: https://ccrma.stanford.edu/~jos/sasp/Spectral_Modeling_Synthesis.html
+// Chebyshev recurrence for harmonics: https://en.wikipedia.org/wiki/Chebyshev_polynomials#Trigonometric_definition
+
+// Partial envelopes as frames: frame f holds every partial at time f * frame_time, the last frame is held
+struct AdditiveSpectrum
+{
+    enum class Preset : u8
+    {
+        SAWTOOTH,
+        SQUARE,
+        BELL,
+        SWEEP,
+        COUNT
+    };
+    static constexpr const char* PRESET_NAMES[] = { "Sawtooth", "Square", "Bell", "Sweep" };
+
+    std::string name;
+    f64 frame_time = 0.0;
+    u32 partials   = 0;
+    u32 frames     = 0;
+    std::vector<f64> amplitude; // [frame][partial]
+    std::vector<f64> ratio;     // [frame][partial], frequency over the note frequency
+    bool harmonic  = false;     // every ratio is the whole number partial + 1
+
+    void Resize(u32 frame_count, u32 partial_count)
+    {
+        frames   = std::max(frame_count, 1u);
+        partials = partial_count;
+        amplitude.assign(size_t(frames) * partials, 0.0);
+        ratio.assign(size_t(frames) * partials, 0.0);
+        for (u32 f = 0; f < frames; f++)
+            for (u32 p = 0; p < partials; p++)
+                ratio[size_t(f) * partials + p] = p + 1.0;
+    }
+
+    // Keep the lowest partials only
+    void Truncate(u32 partial_count)
+    {
+        if (partial_count >= partials) return;
+        for (u32 f = 0; f < frames; f++)
+            for (u32 p = 0; p < partial_count; p++)
+            {
+                amplitude[size_t(f) * partial_count + p] = amplitude[size_t(f) * partials + p];
+                ratio[size_t(f) * partial_count + p]     = ratio[size_t(f) * partials + p];
+            }
+        partials = partial_count;
+        amplitude.resize(size_t(frames) * partials);
+        ratio.resize(size_t(frames) * partials);
+    }
+
+    f64& Amplitude(u32 frame, u32 partial) { return amplitude[size_t(frame) * partials + partial]; }
+    f64& Ratio(u32 frame, u32 partial)     { return ratio[size_t(frame) * partials + partial]; }
+
+    // Partials at a time since note on, interpolated between frames
+    void Sample(f64 time, f64* amplitude_out, f64* ratio_out) const
+    {
+        f64 position = frame_time > 0.0 ? std::max(time, 0.0) / frame_time : 0.0;
+        u32 f0 = std::min(u32(position), frames - 1);
+        u32 f1 = std::min(f0 + 1, frames - 1);
+        f64 frac = (f0 == f1) ? 0.0 : position - f0;
+
+        const f64* a0 = &amplitude[size_t(f0) * partials];
+        const f64* a1 = &amplitude[size_t(f1) * partials];
+        const f64* r0 = &ratio[size_t(f0) * partials];
+        const f64* r1 = &ratio[size_t(f1) * partials];
+        for (u32 p = 0; p < partials; p++)
+        {
+            amplitude_out[p] = a0[p] + frac * (a1[p] - a0[p]);
+            ratio_out[p]     = r0[p] + frac * (r1[p] - r0[p]);
+        }
+    }
+
+    // Scale the loudest frame to the power of a sine at LEVEL, and find out whether the recurrence path applies
+    void Finish()
+    {
+        constexpr f64 LEVEL = 0.7;
+        f64 loudest = 0.0;
+        for (u32 f = 0; f < frames; f++)
+        {
+            f64 power = 0.0;
+            for (u32 p = 0; p < partials; p++) power += Amplitude(f, p) * Amplitude(f, p);
+            loudest = std::max(loudest, power);
+        }
+        if (loudest > 0.0)
+            for (f64& a : amplitude) a *= LEVEL / std::sqrt(loudest);
+
+        harmonic = true;
+        for (u32 f = 0; f < frames && harmonic; f++)
+            for (u32 p = 0; p < partials && harmonic; p++)
+                harmonic = Ratio(f, p) == p + 1.0;
+    }
+
+    static AdditiveSpectrum Make(Preset preset, u32 partial_count)
+    {
+        AdditiveSpectrum s;
+        s.name = PRESET_NAMES[static_cast<s32>(preset)];
+        switch (preset)
+        {
+        case Preset::SQUARE:
+            s.Resize(1, partial_count);
+            for (u32 p = 0; p < partial_count; p += 2)
+                s.Amplitude(0, p) = 1.0 / (p + 1);
+            break;
+
+        case Preset::BELL:
+        {
+            // Inharmonic modes, higher ones decay faster and sag slightly in pitch
+            // Bell partials: https://www.hibberts.co.uk/what-makes-a-bell-sound-like-a-bell/
+            const f64 modes[] = { 0.5, 1.0, 1.183, 1.506, 2.0, 2.514, 2.662, 3.011, 4.166, 5.433, 6.796, 8.215 };
+            const u32 mode_count = sizeof(modes) / sizeof(modes[0]);
+            s.Resize(80, partial_count);
+            s.frame_time = 0.05;
+            for (u32 f = 0; f < s.frames; f++)
+            {
+                f64 t = f * s.frame_time;
+                for (u32 p = 0; p < partial_count; p++)
+                {
+                    f64 mode = p < mode_count ? modes[p] : modes[mode_count - 1] * (1.0 + 0.31 * (p - mode_count + 1));
+                    s.Ratio(f, p)     = mode * (1.0 - 0.002 * p * (1.0 - std::exp(-t)));
+                    s.Amplitude(f, p) = std::exp(-t * (0.6 + 0.5 * p)) / (1.0 + 0.3 * p);
+                }
+            }
+        } break;
+
+        case Preset::SWEEP:
+        {
+            // Harmonic series under a resonant peak that sweeps up and back over four seconds
+            s.Resize(64, partial_count);
+            s.frame_time = 0.0625;
+            for (u32 f = 0; f < s.frames; f++)
+            {
+                f64 peak = 2.0 + 22.0 * 0.5 * (1.0 - std::cos(2.0 * PI * f / s.frames));
+                for (u32 p = 0; p < partial_count; p++)
+                {
+                    f64 distance = (p + 1.0 - peak) / 3.0;
+                    s.Amplitude(f, p) = (0.2 + std::exp(-distance * distance)) / (p + 1.0);
+                }
+            }
+        } break;
+
+        case Preset::SAWTOOTH:
+        default:
+            s.Resize(1, partial_count);
+            for (u32 p = 0; p < partial_count; p++)
+                s.Amplitude(0, p) = 1.0 / (p + 1);
+            break;
+        }
+        s.Finish();
+        return s;
+    }
+
+    // Resynthesis data from a recording: the fundamental is found once, then every frame of a short time
+    // Fourier transform is searched for a peak near each harmonic. Ratios are relative to that fundamental,
+    // so the sound plays back at the pitch of the key.
+    // Peak interpolation: https://ccrma.stanford.edu/~jos/sasp/Quadratic_Interpolation_Spectral_Peaks.html
+    // YIN fundamental estimation: http://audition.ens.fr/adc/pdf/2002_JASA_YIN.pdf
+    static bool Analyze(const std::vector<f64>& samples, f64 sample_rate, u32 partial_count,
+        AdditiveSpectrum& out, std::string& error)
+    {
+        constexpr u32 N   = 2048;
+        constexpr u32 HOP = 512;
+        constexpr f64 MAX_SECONDS = 10.0;
+
+        if (samples.size() < N)
+        {
+            error = "recording shorter than " + std::to_string(N) + " samples";
+            return false;
+        }
+        const size_t length = std::min(samples.size(), size_t(MAX_SECONDS * sample_rate));
+
+        f64 f0 = Fundamental(samples, length, sample_rate);
+        if (f0 <= 0.0)
+        {
+            error = "no pitch found";
+            return false;
+        }
+
+        FFT fft;
+        fft.Init(N);
+        std::vector<f64> window(N);
+        for (u32 i = 0; i < N; i++) window[i] = 0.5 - 0.5 * std::cos(2.0 * PI * i / N);
+
+        const u32 frame_count = u32((length - N) / HOP + 1);
+        out.Resize(frame_count, partial_count);
+        out.frame_time = HOP / sample_rate;
+
+        const f64 bin_hz = sample_rate / N;
+        std::vector<std::complex<f64>> spectrum(N);
+        std::vector<f64> magnitude(N / 2 + 1);
+        for (u32 f = 0; f < frame_count; f++)
+        {
+            const f64* x = samples.data() + size_t(f) * HOP;
+            for (u32 i = 0; i < N; i++) spectrum[i] = x[i] * window[i];
+            fft.Forward(spectrum.data());
+            for (u32 i = 0; i <= N / 2; i++) magnitude[i] = std::abs(spectrum[i]) + 1e-12;
+
+            for (u32 p = 0; p < partial_count; p++)
+            {
+                f64 expected = (p + 1) * f0 / bin_hz;
+                s32 lo = std::max(1, s32(expected - 0.4 * f0 / bin_hz));
+                s32 hi = std::min(s32(N / 2) - 1, s32(expected + 0.4 * f0 / bin_hz));
+                if (lo >= hi) break;
+
+                s32 peak = lo;
+                for (s32 i = lo; i <= hi; i++)
+                    if (magnitude[i] > magnitude[peak]) peak = i;
+                if (peak == lo || peak == hi) continue;
+
+                // Parabola through the log magnitudes around the peak
+                f64 a = std::log(magnitude[peak - 1]), b = std::log(magnitude[peak]), c = std::log(magnitude[peak + 1]);
+                f64 offset = 0.5 * (a - c) / (a - 2.0 * b + c);
+                f64 level  = std::exp(b - 0.25 * (a - c) * offset);
+
+                // Hann sum is N/2, a cosine of amplitude A peaks at A/2 * N/2
+                out.Amplitude(f, p) = 4.0 * level / N;
+                out.Ratio(f, p)     = (peak + offset) * bin_hz / f0;
+            }
+        }
+
+        out.Finish();
+        return true;
+    }
+
+    // Fundamental of the loudest stretch, YIN difference function with a 0.15 threshold, 40 Hz to 2 kHz
+    static f64 Fundamental(const std::vector<f64>& samples, size_t length, f64 sample_rate)
+    {
+        const u32 W = 2048;
+        const u32 tau_min = u32(sample_rate / 2000.0);
+        const u32 tau_max = u32(sample_rate / 40.0);
+        if (length < W + tau_max) return 0.0;
+
+        size_t start = 0;
+        f64 loudest = -1.0;
+        for (size_t s = 0; s + W + tau_max <= length; s += W)
+        {
+            f64 energy = 0.0;
+            for (u32 i = 0; i < W; i++) energy += samples[s + i] * samples[s + i];
+            if (energy > loudest) { loudest = energy; start = s; }
+        }
+
+        std::vector<f64> d(tau_max + 1, 0.0);
+        const f64* x = samples.data() + start;
+        for (u32 tau = 1; tau <= tau_max; tau++)
+            for (u32 i = 0; i < W; i++)
+            {
+                f64 diff = x[i] - x[i + tau];
+                d[tau] += diff * diff;
+            }
+
+        // Cumulative mean normalized difference
+        f64 running = 0.0;
+        std::vector<f64> cmnd(tau_max + 1, 1.0);
+        for (u32 tau = 1; tau <= tau_max; tau++)
+        {
+            running += d[tau];
+            cmnd[tau] = running > 0.0 ? d[tau] * tau / running : 1.0;
+        }
+
+        u32 best = 0;
+        for (u32 tau = tau_min; tau < tau_max; tau++)
+        {
+            if (cmnd[tau] < 0.15)
+            {
+                while (tau + 1 < tau_max && cmnd[tau + 1] < cmnd[tau]) tau++;
+                best = tau;
+                break;
+            }
+        }
+        if (best == 0)
+            best = u32(std::min_element(cmnd.begin() + tau_min, cmnd.begin() + tau_max) - cmnd.begin());
+
+        // Parabolic refinement of the lag
+        f64 a = cmnd[best - 1], b = cmnd[best], c = cmnd[best + 1];
+        f64 denominator = a - 2.0 * b + c;
+        f64 lag = best + (denominator != 0.0 ? 0.5 * (a - c) / denominator : 0.0);
+        return sample_rate / lag;
+    }
+};
+
+// Per-voice state, preallocated in a pool so the audio thread never allocates
+struct AdditiveVoice
+{
+    f64 on = -1.0;           // note on time of the owner, a new time restarts the voice
+    u64 block = 0;           // last block rendered, 0 never, a gap means the voice was free
+    u64 samples = 0;         // samples rendered since note on
+    u32 until_frame = 0;     // samples before the next overlap-add frame
+    u32 read = 0;            // read position in the overlap ring
+    bool recurrence = false; // harmonic fast path instead of the inverse FFT
+    u32 theta = 0;           // fundamental phase of the recurrence path, u32 fixed point cycles
+
+    std::vector<f64> phase;     // partial phase at the last frame centre, cycles
+    std::vector<f64> frequency; // partial frequency at the last frame, Hz
+    std::vector<f64> level;     // partial level reached at the end of the last block (recurrence path)
+    std::vector<f64> overlap;   // overlap-add ring, FFT_SIZE samples from read
+};
+
+struct Additive
+{
+    static constexpr u32 FFT_SIZE      = 512;
+    static constexpr u32 HOP           = FFT_SIZE / 4;  // Hann windows at a quarter overlap sum to 2
+    static constexpr u32 KERNEL        = 6;             // bins drawn on each side of a partial
+    static constexpr u32 OVERSAMPLE    = 64;            // window spectrum table steps per bin
+    static constexpr u32 MAX_PARTIALS  = 256;
+    static constexpr u32 MAX_VOICES    = 128;           // one per MIDI note
+    static constexpr u32 MAX_BLOCK     = 64;
+    static constexpr u32 RECURRENCE_MAX = 64;           // harmonic spectra up to this many partials skip the FFT
+
+public:
+    Additive()
+    {
+        fft.Init(FFT_SIZE);
+        bins.resize(FFT_SIZE);
+
+        // Spectrum of the zero phase Hann window at fractional bin offsets, real since the window is symmetric
+        kernel.resize(KERNEL * OVERSAMPLE + 2);
+        for (u32 i = 0; i < kernel.size(); i++)
+        {
+            f64 x = f64(i) / OVERSAMPLE;
+            f64 sum = 0.0;
+            for (s32 n = -s32(FFT_SIZE / 2) + 1; n < s32(FFT_SIZE / 2); n++)
+                sum += (0.5 + 0.5 * std::cos(2.0 * PI * n / FFT_SIZE)) * std::cos(2.0 * PI * x * n / FFT_SIZE);
+            kernel[i] = sum;
+        }
+
+        voices.resize(MAX_VOICES);
+        for (AdditiveVoice& v : voices)
+        {
+            v.phase.assign(MAX_PARTIALS, 0.0);
+            v.frequency.assign(MAX_PARTIALS, 0.0);
+            v.level.assign(MAX_PARTIALS, 0.0);
+            v.overlap.assign(FFT_SIZE, 0.0);
+        }
+
+        SetSpectrum(AdditiveSpectrum::Make(AdditiveSpectrum::Preset::SAWTOOTH, 128));
+    }
+
+    // Any thread but the audio thread: the new spectrum is picked up at the next block
+    void SetSpectrum(AdditiveSpectrum s)
+    {
+        s.Truncate(MAX_PARTIALS);
+        spectrum.Publish(std::make_shared<const AdditiveSpectrum>(std::move(s)));
+    }
+
+    std::shared_ptr<const AdditiveSpectrum> Spectrum() const { return spectrum.Latest(); }
+
+    // Samples a note lags its note on, at most: each overlap-add frame is centred half an FFT after it
+    // starts, so the first one fades in over FFT_SIZE / 2. The harmonic recurrence path has none.
+    u32 Latency() const
+    {
+        std::shared_ptr<const AdditiveSpectrum> s = spectrum.Latest();
+        bool fast = recurrence && s && s->harmonic && s->partials <= RECURRENCE_MAX;
+        return fast ? 0 : FFT_SIZE / 2;
+    }
+
+    // Audio thread, once per block
+    void Update()
+    {
+        spectrum.Acquire();
+        block++;
+    }
+
+    // Render one control block of the voice of a note, pitch ramps linearly from pitch_from to pitch_to
+    void Render(s32 note_id, f64 note_on, f64* output, u32 samples, f64 frequency, f64 pitch_from, f64 pitch_to, f64 sample_rate)
+    {
+        samples = std::min(samples, MAX_BLOCK);
+        const AdditiveSpectrum* s = spectrum.Current();
+        if (!s || s->partials == 0)
+        {
+            std::fill(output, output + samples, 0.0);
+            return;
+        }
+
+        AdditiveVoice& v = voices[note_id & (MAX_VOICES - 1)];
+        if (v.on != note_on)
+        {
+            // A new note, or the key pressed again: keep sounding through a retrigger, start fresh otherwise
+            bool continuing = v.block != 0 && v.block + 1 >= block;
+            v.on = note_on;
+            v.samples = 0;
+            if (!continuing)
+            {
+                std::fill(v.overlap.begin(), v.overlap.end(), 0.0);
+                std::fill(v.phase.begin(), v.phase.end(), 0.0);
+                std::fill(v.level.begin(), v.level.end(), 0.0);
+                std::fill(v.frequency.begin(), v.frequency.end(), 0.0);
+                v.until_frame = 0;
+                v.read = 0;
+                v.theta = 0;
+                v.recurrence = recurrence && s->harmonic && Harmonics(*s, frequency * pitch_to, sample_rate) <= RECURRENCE_MAX;
+            }
+        }
+        v.block = block;
+        if (v.recurrence && !s->harmonic) v.recurrence = false;
+
+        if (v.recurrence) RenderRecurrence(v, *s, output, samples, frequency, pitch_from, pitch_to, sample_rate);
+        else              RenderOverlapAdd(v, *s, output, samples, frequency, pitch_to, sample_rate);
+        v.samples += samples;
+    }
+
+private:
+    // Partials below Nyquist for a fundamental
+    static u32 Harmonics(const AdditiveSpectrum& s, f64 fundamental, f64 sample_rate)
+    {
+        return fundamental > 0.0 ? std::min(s.partials, u32(0.5 * sample_rate / fundamental)) : 0;
+    }
+
+    // Sum of a_k sin(k theta), with sin((k+1) theta) = 2 cos(theta) sin(k theta) - sin((k-1) theta)
+    void RenderRecurrence(AdditiveVoice& v, const AdditiveSpectrum& s, f64* output, u32 samples,
+        f64 frequency, f64 pitch_from, f64 pitch_to, f64 sample_rate)
+    {
+        const SineTable& sine = SineTable::Instance();
+        const u32 count = Harmonics(s, frequency * std::max(pitch_from, pitch_to), sample_rate);
+
+        s.Sample((v.samples + samples) / sample_rate, target, ratios);
+        for (u32 p = 0; p < count; p++)
+            step[p] = (target[p] - v.level[p]) / samples;
+
+        f64 increment = frequency / sample_rate * 4294967296.0;
+        f64 pitch_step = (pitch_to - pitch_from) / samples;
+        for (u32 k = 0; k < samples; k++)
+        {
+            f64 s1 = sine.Lookup(v.theta);
+            f64 c2 = 2.0 * sine.Lookup(v.theta + (1u << 30));
+            f64 previous = 0.0;
+            f64 current  = s1;
+            f64 sum = 0.0;
+            for (u32 p = 0; p < count; p++)
+            {
+                v.level[p] += step[p];
+                sum += v.level[p] * current;
+                f64 next = c2 * current - previous;
+                previous = current;
+                current  = next;
+            }
+            output[k] = sum;
+            v.theta += static_cast<u32>(increment * (pitch_from + (k + 1) * pitch_step));
+        }
+        for (u32 p = count; p < s.partials; p++)
+            v.level[p] = target[p];
+    }
+
+    // Windowed frames every HOP samples, each one drawn as a spectrum and inverse transformed
+    void RenderOverlapAdd(AdditiveVoice& v, const AdditiveSpectrum& s, f64* output, u32 samples,
+        f64 frequency, f64 pitch, f64 sample_rate)
+    {
+        for (u32 k = 0; k < samples; k++)
+        {
+            if (v.until_frame == 0)
+            {
+                // The frame is centred half an FFT ahead, its partials are taken at that time
+                f64 centre = (v.samples + k + FFT_SIZE / 2) / sample_rate;
+                Frame(v, s, centre, frequency * pitch, sample_rate);
+                v.until_frame = HOP;
+            }
+            output[k] = v.overlap[v.read];
+            v.overlap[v.read] = 0.0;
+            v.read = (v.read + 1) & (FFT_SIZE - 1);
+            v.until_frame--;
+        }
+    }
+
+    void Frame(AdditiveVoice& v, const AdditiveSpectrum& s, f64 time, f64 fundamental, f64 sample_rate)
+    {
+        s.Sample(time, target, ratios);
+        std::fill(bins.begin(), bins.end(), FFT::Complex(0.0, 0.0));
+
+        const f64 bin_hz  = sample_rate / FFT_SIZE;
+        const f64 nyquist = 0.5 * sample_rate;
+        for (u32 p = 0; p < s.partials; p++)
+        {
+            // Phase runs on at the mean frequency of the two frames, so glides stay continuous
+            f64 f = fundamental * ratios[p];
+            if (v.frequency[p] > 0.0)
+            {
+                v.phase[p] += 0.5 * (v.frequency[p] + f) * HOP / sample_rate;
+                v.phase[p] -= std::floor(v.phase[p]);
+            }
+            v.frequency[p] = f;
+
+            f64 a = target[p];
+            if (a < 1e-6 || f <= 0.0 || f >= nyquist) continue;
+
+            // Positive frequency kernel, mirrored as the conjugate so the frame comes out real.
+            // Sine phase, like the recurrence path
+            f64 b = f / bin_hz;
+            FFT::Complex rotation = std::polar(0.5 * a, 2.0 * PI * (v.phase[p] - 0.25));
+            s32 first = s32(std::ceil(b - KERNEL));
+            s32 last  = s32(std::floor(b + KERNEL));
+            for (s32 k = first; k <= last; k++)
+            {
+                FFT::Complex c = rotation * Window(std::abs(k - b));
+                bins[u32(k) & (FFT_SIZE - 1)]  += c;
+                bins[u32(-k) & (FFT_SIZE - 1)] += std::conj(c);
+            }
+        }
+
+        fft.Inverse(bins.data());
+
+        // Zero phase frame: sample n of the frame is bin (n - FFT_SIZE/2) of the transform
+        for (u32 n = 0; n < FFT_SIZE; n++)
+            v.overlap[(v.read + n) & (FFT_SIZE - 1)] += 0.5 * bins[(n + FFT_SIZE / 2) & (FFT_SIZE - 1)].real();
+    }
+
+    f64 Window(f64 offset) const
+    {
+        f64 position = offset * OVERSAMPLE;
+        u32 i = std::min(u32(position), KERNEL * OVERSAMPLE);
+        f64 frac = position - i;
+        return kernel[i] + frac * (kernel[i + 1] - kernel[i]);
+    }
+
+public:
+    bool recurrence = true;
+
+private:
+    Published<AdditiveSpectrum> spectrum;
+    u64 block = 1;
+
+    FFT fft;
+    std::vector<FFT::Complex> bins;
+    std::vector<f64> kernel;
+    std::vector<AdditiveVoice> voices;
+
+    // Audio thread scratch
+    f64 target[MAX_PARTIALS] = {};
+    f64 ratios[MAX_PARTIALS] = {};
+    f64 step[MAX_PARTIALS]   = {};
+};
\ No newline at end of file
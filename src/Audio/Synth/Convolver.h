@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "../../Core/Common.h"
+#include "FFT.h"
+
+// Uniformly partitioned convolution: the impulse response cut into partitions of PARTITION samples, each
+// transformed once. Every PARTITION input samples make one spectrum, pushed into a frequency-domain delay
+// line and multiplied with the partition spectra (overlap-save), so the cost per sample is independent of
+// the length of the response and the latency is one partition.
+// A real response convolves both channels in one complex transform, left in the real part, right in the
+// imaginary part: the spectra of the packed signal are not symmetric, but the products keep the channels apart.
+// Partitioned convolution: https://www.music.mcgill.ca/~gary/618/week3/node19.html
+// Overlap-save: https://en.wikipedia.org/wiki/Overlap%E2%80%93save_method
+
+// Spectra of the partitions of one impulse response, shared read only by the convolvers using it
+struct ConvolverKernel
+{
+    u32 partitions = 0;
+    std::vector<FFT::Complex> spectra; // partitions x Convolver::SIZE
+};
+
+struct Convolver
+{
+    using Complex = FFT::Complex;
+
+    static constexpr u32 PARTITION = 256;           // samples, the latency
+    static constexpr u32 SIZE      = 2 * PARTITION; // transform size
+
+public:
+    // Room for responses up to max_length samples, allocates
+    void Init(u32 max_length)
+    {
+        fft.Init(SIZE);
+        slots = std::max<u32>((max_length + PARTITION - 1) / PARTITION, 1);
+        delay_line.assign(slots * SIZE, Complex());
+        input.assign(SIZE, Complex());
+        output.assign(PARTITION, Complex());
+        work.assign(SIZE, Complex());
+        faded.assign(SIZE, Complex());
+        head = 0;
+        fill = 0;
+    }
+
+    // Partition spectra of a response, any thread. fft is a transform of SIZE
+    static std::shared_ptr<const ConvolverKernel> MakeKernel(const f64* response, u32 length, const FFT& fft)
+    {
+        auto kernel = std::make_shared<ConvolverKernel>();
+        kernel->partitions = std::max<u32>((length + PARTITION - 1) / PARTITION, 1);
+        kernel->spectra.assign(kernel->partitions * SIZE, Complex());
+        for (u32 p = 0; p < kernel->partitions; p++)
+        {
+            Complex* spectrum = &kernel->spectra[p * SIZE];
+            for (u32 i = 0; i < PARTITION && p * PARTITION + i < length; i++)
+                spectrum[i] = response[p * PARTITION + i];
+            fft.Forward(spectrum);
+        }
+        return kernel;
+    }
+
+    // Audio thread: the kernel from the next partition on, crossfaded from the current one over a partition.
+    // The caller keeps a reference to the kernels it hands over, so none is freed on the audio thread
+    void SetKernel(std::shared_ptr<const ConvolverKernel> next)
+    {
+        if (next == kernel || next == pending) return;
+        pending = std::move(next);
+    }
+
+    const std::shared_ptr<const ConvolverKernel>& Kernel() const { return pending ? pending : kernel; }
+
+    // A new partition starts with the next sample
+    bool Boundary() const { return fill == 0; }
+
+    // One stereo sample in, the output of one partition ago out
+    void Process(f64& left, f64& right)
+    {
+        input[PARTITION + fill] = Complex(left, right);
+        left  = output[fill].real();
+        right = output[fill].imag();
+        if (++fill == PARTITION)
+        {
+            fill = 0;
+            Block();
+        }
+    }
+
+    void Reset()
+    {
+        std::fill(delay_line.begin(), delay_line.end(), Complex());
+        std::fill(input.begin(), input.end(), Complex());
+        std::fill(output.begin(), output.end(), Complex());
+        fill = 0;
+    }
+
+private:
+    void Block()
+    {
+        // Spectrum of the last two partitions of input into the delay line
+        head = head == 0 ? slots - 1 : head - 1;
+        Complex* spectrum = &delay_line[head * SIZE];
+        std::copy(input.begin(), input.end(), spectrum);
+        fft.Forward(spectrum);
+        std::copy(input.begin() + PARTITION, input.end(), input.begin());
+
+        if (!kernel && !pending)
+        {
+            std::fill(output.begin(), output.end(), Complex());
+            return;
+        }
+
+        if (pending)
+        {
+            // Old and new kernel on the same input, the old one fading out across the partition
+            if (kernel) Convolve(*kernel, faded.data());
+            else        std::fill(faded.begin(), faded.end(), Complex());
+            Convolve(*pending, work.data());
+            for (u32 i = 0; i < PARTITION; i++)
+            {
+                f64 t = (i + 1.0) / PARTITION;
+                output[i] = faded[PARTITION + i] + (work[PARTITION + i] - faded[PARTITION + i]) * t;
+            }
+            kernel = std::move(pending);
+            pending.reset();
+            return;
+        }
+
+        Convolve(*kernel, work.data());
+        std::copy(work.begin() + PARTITION, work.end(), output.begin());
+    }
+
+    // Sum of the delayed input spectra times the partition spectra, back to time: the second half is valid
+    void Convolve(const ConvolverKernel& k, Complex* result) const
+    {
+        std::fill(result, result + SIZE, Complex());
+        f64* acc = reinterpret_cast<f64*>(result);
+        const u32 count = std::min(k.partitions, slots);
+        for (u32 p = 0; p < count; p++)
+        {
+            const f64* x = reinterpret_cast<const f64*>(&delay_line[((head + p) % slots) * SIZE]);
+            const f64* h = reinterpret_cast<const f64*>(&k.spectra[p * SIZE]);
+            for (u32 i = 0; i < 2 * SIZE; i += 2)
+            {
+                acc[i]     += x[i] * h[i]     - x[i + 1] * h[i + 1];
+                acc[i + 1] += x[i] * h[i + 1] + x[i + 1] * h[i];
+            }
+        }
+        fft.Inverse(result);
+    }
+
+private:
+    FFT fft;
+    std::shared_ptr<const ConvolverKernel> kernel;
+    std::shared_ptr<const ConvolverKernel> pending;
+
+    std::vector<Complex> delay_line; // slots input spectra, newest at head
+    std::vector<Complex> input;      // last partition and the one filling
+    std::vector<Complex> output;     // the partition being played
+    std::vector<Complex> work;
+    std::vector<Complex> faded;
+    u32 slots = 0;
+    u32 head  = 0;
+    u32 fill  = 0;
+};
\ No newline at end of file
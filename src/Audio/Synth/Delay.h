@@ -10,32 +10,43 @@ static u32 bpm_to_sample(s32 beat, s32 beat_per_bar, s32 bpm, f64 sample_rate) {
 
 struct Delay
 {
+	static constexpr s32 NUM_CHANNELS = 2;
+
 	s32 beat;
 	f64 feedback;
+	f64 feedback_mod = 0.0; // modulation offset
 	s32 bpm;
 	s32 beat_per_bar;
-	std::vector<f64> history;
+	bool ping_pong = false;
+	std::vector<f64> history[NUM_CHANNELS];
 	s32 offset;
 
 	void Resize(s32 size)
 	{
-		history.resize(size);
-		offset %= history.size();
+		for (auto& h : history)
+			h.resize(size);
+		offset %= size;
 	}
 
-	f64 Process(f64 sample)
+	// Stereo delay line, in ping-pong mode each side echoes into the other
+	void Process(f64& left, f64& right)
 	{
 		u32 history_size = bpm_to_sample(beat, beat_per_bar, bpm, SAMPLE_RATE);
-		if (history.size() != history_size)
+		if (history[0].size() != history_size)
 			Resize(history_size);
 
+		f64 echo_left  = history[0][offset];
+		f64 echo_right = history[1][offset];
+		if (ping_pong) std::swap(echo_left, echo_right);
+
 		// Compute delay and store in history
-		f64 output = sample + feedback * history[offset];
-		history[offset] = output;
+		f64 gain = std::clamp(feedback + feedback_mod, 0.0, 1.0);
+		left  = left  + gain * echo_left;
+		right = right + gain * echo_right;
+		history[0][offset] = left;
+		history[1][offset] = right;
 
 		// Increment offset
-		offset = wrap(offset + 1, u32(history.size()));
-
-		return output;
+		offset = wrap(offset + 1, u32(history_size));
 	}
 };
\ No newline at end of file
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "../../Core/Common.h"
+#include "Filter.h"
+
+// Waveshaping distortion with antiderivative anti-aliasing (ADAA). Instead of f(x[n]), the shaper outputs the
+// mean of f over the straight line from the previous input to this one, which the antiderivative F1 gives
+// exactly: (F1(x[n]) - F1(x[n-1])) / (x[n] - x[n-1]). The average is a lowpass applied to the continuous
+// shaped signal before sampling, so the harmonics folding back are attenuated without oversampling, at the cost
+// of half a sample of delay. The second order averages that once more, through the second antiderivative F2,
+// for one sample of delay and less aliasing again. When consecutive inputs are too close for the differences
+// to be accurate, f or F1 at the midpoint stands in.
+// Every curve keeps F1(0) = F2(0) = 0, so a state at rest is consistent with any of them.
+// Antiderivative anti-aliasing: https://dafx16.vutbr.cz/dafxpapers/20-DAFx-16_paper_41-PN.pdf
+// Second order: https://jatinchowdhury18.medium.com/practical-considerations-for-antiderivative-anti-aliasing-d5847167f510
+
+// Shaper state of one channel: the last inputs and the antiderivatives at them
+struct DistortionVoice
+{
+    f64 x1 = 0.0, x2 = 0.0; // last two inputs, after the drive
+    f64 f1 = 0.0;           // F1(x1)
+    f64 f2 = 0.0;           // F2(x1)
+    f64 d1 = 0.0;           // (F2(x1) - F2(x2)) / (x1 - x2)
+    f64 dc_x = 0.0, dc_y = 0.0;
+    s32 curve = 0;
+    s32 order = 0;
+};
+
+struct Distortion
+{
+    enum class Curve
+    {
+        TANH,
+        HARD_CLIP,
+        FOLDBACK,
+        ASYMMETRIC,
+        COUNT
+    };
+    static constexpr const char* CURVE_NAMES[] = { "Tanh", "Hard Clip", "Foldback", "Asymmetric" };
+    static constexpr const char* ORDER_NAMES[] = { "Naive", "ADAA 1st", "ADAA 2nd" };
+
+    static constexpr f64 EPSILON  = 1e-5; // inputs closer than this use the midpoint
+    static constexpr f64 DC_BLOCK = 10.0; // Hz, after the asymmetric curve
+
+    s32 curve     = static_cast<s32>(Curve::TANH);
+    s32 order     = 2;   // 0 naive, 1 or 2 antiderivative
+    f64 drive     = 0.0; // dB
+    f64 level     = 0.0; // dB
+    f64 asymmetry = 0.5; // bias of the asymmetric curve
+
+    // From the parameters
+    f64 gain   = 1.0;
+    f64 output = 1.0;
+
+public:
+    void Update()
+    {
+        gain   = dB_to_volume(drive);
+        output = dB_to_volume(level);
+
+        // The asymmetric curve is tanh(x + b) - tanh(b), its antiderivatives shifted to 0 at the origin
+        bias    = std::clamp(asymmetry, 0.0, 2.0);
+        bias_f  = std::tanh(bias);
+        bias_F1 = TanhF1(bias);
+        bias_F2 = TanhF2(bias);
+        dc_pole = 1.0 - 2.0 * PI * DC_BLOCK / SAMPLE_RATE;
+    }
+
+    // One voice block in place
+    void Process(DistortionVoice& v, f64* block, u32 samples) const
+    {
+        switch (static_cast<Curve>(curve))
+        {
+        case Curve::TANH:       Run<Curve::TANH>(v, block, samples);       break;
+        case Curve::HARD_CLIP:  Run<Curve::HARD_CLIP>(v, block, samples);  break;
+        case Curve::FOLDBACK:   Run<Curve::FOLDBACK>(v, block, samples);   break;
+        case Curve::ASYMMETRIC: Run<Curve::ASYMMETRIC>(v, block, samples); break;
+        default: break;
+        }
+    }
+
+    // One stereo sample of the master bus
+    void Process(f64& left, f64& right)
+    {
+        Process(channels[0], &left, 1);
+        Process(channels[1], &right, 1);
+    }
+
+private:
+    template <Curve C>
+    void Run(DistortionVoice& v, f64* block, u32 samples) const
+    {
+        // A new curve or order rebuilds the antiderivatives at the inputs kept
+        if (v.curve != curve || v.order != order)
+        {
+            v.f1 = F1<C>(v.x1);
+            v.f2 = F2<C>(v.x1);
+            v.d1 = Difference<C>(v.x1, v.x2, v.f2, F2<C>(v.x2));
+            v.curve = curve;
+            v.order = order;
+        }
+
+        switch (order)
+        {
+        case 0:
+            for (u32 i = 0; i < samples; i++)
+            {
+                const f64 x = gain * block[i];
+                v.x2 = v.x1;
+                v.x1 = x;
+                block[i] = Output<C>(v, Shape<C>(x));
+            }
+            break;
+
+        case 1:
+            for (u32 i = 0; i < samples; i++)
+            {
+                const f64 x  = gain * block[i];
+                const f64 F  = F1<C>(x);
+                const f64 dx = x - v.x1;
+                const f64 y  = std::abs(dx) < EPSILON ? Shape<C>(0.5 * (x + v.x1)) : (F - v.f1) / dx;
+                v.x2 = v.x1;
+                v.x1 = x;
+                v.f1 = F;
+                block[i] = Output<C>(v, y);
+            }
+            break;
+
+        default:
+            for (u32 i = 0; i < samples; i++)
+            {
+                const f64 x = gain * block[i];
+                const f64 F = F2<C>(x);
+                const f64 d = Difference<C>(x, v.x1, F, v.f2);
+                const f64 dx = x - v.x2;
+                f64 y;
+                if (std::abs(dx) >= EPSILON)
+                {
+                    y = 2.0 * (d - v.d1) / dx;
+                }
+                else
+                {
+                    // Back where it was two samples ago: the average about the midpoint of x and x2
+                    const f64 mid   = 0.5 * (x + v.x2);
+                    const f64 delta = mid - v.x1;
+                    y = std::abs(delta) < EPSILON
+                        ? Shape<C>(0.5 * (mid + v.x1))
+                        : 2.0 / delta * (F1<C>(mid) + (v.f2 - F2<C>(mid)) / delta);
+                }
+                v.x2 = v.x1;
+                v.x1 = x;
+                v.f2 = F;
+                v.d1 = d;
+                block[i] = Output<C>(v, y);
+            }
+            break;
+        }
+    }
+
+    // First difference of F2, F1 at the midpoint for close inputs
+    template <Curve C>
+    f64 Difference(f64 a, f64 b, f64 F2a, f64 F2b) const
+    {
+        const f64 dx = a - b;
+        return std::abs(dx) < EPSILON ? F1<C>(0.5 * (a + b)) : (F2a - F2b) / dx;
+    }
+
+    // Level, and the DC the asymmetric curve makes blocked
+    template <Curve C>
+    f64 Output(DistortionVoice& v, f64 y) const
+    {
+        if constexpr (C == Curve::ASYMMETRIC)
+        {
+            f64 blocked = y - v.dc_x + dc_pole * v.dc_y;
+            v.dc_x = y;
+            v.dc_y = blocked;
+            y = blocked;
+        }
+        return output * y;
+    }
+
+    template <Curve C>
+    f64 Shape(f64 x) const
+    {
+        if constexpr (C == Curve::TANH)       return std::tanh(x);
+        if constexpr (C == Curve::HARD_CLIP)  return std::clamp(x, -1.0, 1.0);
+        if constexpr (C == Curve::FOLDBACK)
+        {
+            f64 m = Fold(x);
+            return m <= 2.0 ? m - 1.0 : 3.0 - m;
+        }
+        if constexpr (C == Curve::ASYMMETRIC) return std::tanh(x + bias) - bias_f;
+        return x;
+    }
+
+    template <Curve C>
+    f64 F1(f64 x) const
+    {
+        if constexpr (C == Curve::TANH) return TanhF1(x);
+        if constexpr (C == Curve::HARD_CLIP)
+        {
+            f64 a = std::abs(x);
+            return a <= 1.0 ? 0.5 * x * x : a - 0.5;
+        }
+        if constexpr (C == Curve::FOLDBACK)
+        {
+            f64 m = Fold(x);
+            return (m <= 2.0 ? 0.5 * m * m - m : -0.5 * m * m + 3.0 * m - 4.0) + 0.5;
+        }
+        if constexpr (C == Curve::ASYMMETRIC) return TanhF1(x + bias) - bias_F1 - x * bias_f;
+        return 0.5 * x * x;
+    }
+
+    template <Curve C>
+    f64 F2(f64 x) const
+    {
+        if constexpr (C == Curve::TANH) return TanhF2(x);
+        if constexpr (C == Curve::HARD_CLIP)
+        {
+            f64 a = std::abs(x);
+            return a <= 1.0 ? x * x * x / 6.0 : std::copysign(0.5 * a * a - 0.5 * a + 1.0 / 6.0, x);
+        }
+        if constexpr (C == Curve::FOLDBACK)
+        {
+            // The fold is periodic with F1 averaging 1/2, so F2 rises by x / 2 beside its periodic part
+            f64 m = Fold(x);
+            f64 K = m <= 2.0 ? m * m * m / 6.0 - 0.5 * m * m : -m * m * m / 6.0 + 1.5 * m * m - 4.0 * m + 8.0 / 3.0;
+            return K + 1.0 / 3.0 + 0.5 * x;
+        }
+        if constexpr (C == Curve::ASYMMETRIC) return TanhF2(x + bias) - bias_F2 - x * bias_F1 - 0.5 * x * x * bias_f;
+        return x * x * x / 6.0;
+    }
+
+    // Phase of the triangle fold, period 4 with the linear part from -1 to 1
+    static f64 Fold(f64 x)
+    {
+        f64 p = x + 1.0;
+        return p - 4.0 * std::floor(0.25 * p);
+    }
+
+    // log(cosh(x)) = |x| + log(1 + e^-2|x|) - log(2), without overflow
+    static f64 TanhF1(f64 x)
+    {
+        f64 a = std::abs(x);
+        return a + std::log1p(std::exp(-2.0 * a)) - std::log(2.0);
+    }
+
+    // Integral of log(cosh(x)): x^2 / 2 - |x| log(2) + Li2(-e^-2|x|) / 2 + pi^2 / 24, odd.
+    // With v = e^-2|x| and z = log(1 + v), Li2(-v) = -Li2(v / (1 + v)) - z^2 / 2, and Li2(w) for w up to 1/2
+    // is the fast series in z = -log(1 - w) with Bernoulli number coefficients
+    static f64 TanhF2(f64 x)
+    {
+        f64 a  = std::abs(x);
+        f64 z  = std::log1p(std::exp(-2.0 * a));
+        f64 z2 = z * z;
+        f64 li = z * (1.0 + z2 * (1.0 / 36.0 + z2 * (-1.0 / 3600.0 + z2 * (1.0 / 211680.0 + z2 * (-1.0 / 10886400.0
+            + z2 * (1.0 / 526901760.0 + z2 * (-4.0647616451442256e-11 + z2 * 8.921691020456452e-13))))))) - 0.25 * z2;
+        f64 li_minus = -li - 0.5 * z2;
+        return std::copysign(0.5 * a * a - a * std::log(2.0) + 0.5 * li_minus + PI * PI / 24.0, x);
+    }
+
+private:
+    f64 bias    = 0.5;
+    f64 bias_f  = 0.0;
+    f64 bias_F1 = 0.0;
+    f64 bias_F2 = 0.0;
+    f64 dc_pole = 1.0;
+
+    DistortionVoice channels[2];
+};
\ No newline at end of file
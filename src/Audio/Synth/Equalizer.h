@@ -1,6 +1,18 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <complex>
+#include <memory>
+#include <thread>
+#include <vector>
+
 #include "../../Core/Common.h"
+#include "../../Core/Published.h"
 #include "Filter.h"
+#include "FFT.h"
+#include "Convolver.h"
 
 static f64 log_interpolate(f64 a, f64 b, f64 t) 
 {
@@ -14,13 +26,14 @@ struct Equalizer
 {
     struct Band
     {
-        s32 mode = 0;
+        s32 mode = 3; // peak, flat at no gain
 
         f64 frequency;
         f64 resonance = 0.1;
-        f64 gain;
+        f64 gain = 0.0;
 
         BqFilter filter;
+        BqFilter filter_right;
 
         Band(f64 freq) : frequency(freq) {}
     };
@@ -32,30 +45,193 @@ struct Equalizer
         6324.0 
     };
 
-    f64 Process(f64 sample)
+    // Linear phase: one symmetric FIR with the magnitude of all the bands in cascade, the response the
+    // equalizer view draws, designed by frequency sampling and windowed. Applied by partitioned convolution,
+    // so its cost does not grow with the taps; its latency is half the taps plus a partition.
+    // The designer thread redesigns only when a band changed, the convolver crossfades to the new kernel.
+    // The biquads keep playing until the first kernel is there.
+    // Frequency sampling: https://ccrma.stanford.edu/~jos/sasp/Frequency_Sampling_Method_FIR.html
+    static constexpr u32 TAPS   = 4095; // odd, the delay is a whole (TAPS - 1) / 2 samples
+    static constexpr u32 DESIGN = 8192; // frequency grid of the design, 5.4 Hz at 44.1 kHz
+
+public:
+    Equalizer()
     {
-        f64 output;
-        for (auto& band : bands) 
+        design_fft.Init(DESIGN);
+        kernel_fft.Init(Convolver::SIZE);
+        convolver.Init(TAPS);
+    }
+
+    ~Equalizer()
+    {
+        designer_running = false;
+        if (designer.joinable()) designer.join();
+    }
+
+    // Not on the audio thread. The designer thread starts the first time the linear phase is switched on,
+    // so a synthesizer that never uses it runs none
+    void SetLinearPhase(bool on)
+    {
+        if (on && background && !designer.joinable())
+        {
+            designer_running = true;
+            designer = std::thread(&Equalizer::Designer, this);
+        }
+        linear_phase = on;
+    }
+
+    void Process(f64& left, f64& right)
+    {
+        if (linear_phase)
         {
-            BqFilter::Type type;
-            switch (band.mode) 
+            // Switched on: no stale input from the last time
+            if (!convolving && (!background || kernels.Acquire()))
             {
-            case 0: type = BqFilter::Type::LOW_PASS;   break;
-            case 1: type = BqFilter::Type::HIGH_PASS;  break;
-            case 2: type = BqFilter::Type::BAND_PASS;  break;
-            case 3: type = BqFilter::Type::PEAK;       break;
-            case 4: type = BqFilter::Type::NOTCH;      break;
-            case 5: type = BqFilter::Type::LOW_SHELF;  break;
-            case 6: type = BqFilter::Type::HIGH_SHELF; break;
+                convolver.Reset();
+                convolving = true;
             }
 
-            band.filter.type = type;
+            if (convolving)
+            {
+                // New kernels are taken between partitions
+                if (convolver.Boundary())
+                {
+                    if (!background && Changed()) kernels.Publish(Design(designed));
+                    if (kernels.Acquire() && kernels.Shared() != convolver.Kernel()) convolver.SetKernel(kernels.Shared());
+                }
+                convolver.Process(left, right);
+                return;
+            }
+        }
+        else
+        {
+            convolving = false;
+        }
+
+        for (auto& band : bands) 
+        {
+            band.filter.type = BandType(band.mode);
             band.filter.CalcCoefs(band.frequency, band.resonance, band.gain);
+            band.filter_right.CopyCoefs(band.filter);
         }
 
+        // The bands in cascade, the same response as the linear phase kernel
         for (auto& band : bands)
-            output = band.filter.FilterWave(sample);
+        {
+            left  = band.filter.FilterWave(left);
+            right = band.filter_right.FilterWave(right);
+        }
+    }
+
+    // Samples the output lags the input
+    u32 Latency() const
+    {
+        return linear_phase ? Convolver::PARTITION + (TAPS - 1) / 2 : 0;
+    }
+
+    static BqFilter::Type BandType(s32 mode)
+    {
+        switch (mode) 
+        {
+        case 0:  return BqFilter::Type::LOW_PASS;
+        case 1:  return BqFilter::Type::HIGH_PASS;
+        case 2:  return BqFilter::Type::BAND_PASS;
+        case 3:  return BqFilter::Type::PEAK;
+        case 4:  return BqFilter::Type::NOTCH;
+        case 5:  return BqFilter::Type::LOW_SHELF;
+        case 6:  return BqFilter::Type::HIGH_SHELF;
+        default: return BqFilter::Type::OFF;
+        }
+    }
+
+private:
+    struct Setting
+    {
+        s32 mode;
+        f64 frequency;
+        f64 resonance;
+        f64 gain;
+
+        bool operator==(const Setting&) const = default;
+    };
+    using Settings = std::array<Setting, NUM_BANDS>;
 
-        return output;
+    // The bands as they are now against the last design, which they become
+    bool Changed()
+    {
+        Settings now;
+        for (s32 b = 0; b < NUM_BANDS; b++)
+            now[b] = { bands[b].mode, bands[b].frequency, bands[b].resonance, bands[b].gain };
+        if (has_design && now == designed) return false;
+        designed = now;
+        has_design = true;
+        return true;
     }
+
+    // Zero phase magnitude of the cascade on the design grid, back to time, centered and windowed
+    std::shared_ptr<const ConvolverKernel> Design(const Settings& settings) const
+    {
+        BqFilter filters[NUM_BANDS];
+        for (s32 b = 0; b < NUM_BANDS; b++)
+        {
+            filters[b].type = BandType(settings[b].mode);
+            filters[b].CalcCoefs(settings[b].frequency, settings[b].resonance, settings[b].gain);
+        }
+
+        std::vector<FFT::Complex> spectrum(DESIGN);
+        for (u32 k = 0; k <= DESIGN / 2; k++)
+        {
+            FFT::Complex z1 = std::polar(1.0, -2.0 * PI * k / DESIGN);
+            FFT::Complex z2 = z1 * z1;
+            f64 magnitude = 1.0;
+            for (const BqFilter& f : filters)
+            {
+                if (f.type == BqFilter::Type::OFF) continue;
+                magnitude *= std::abs((f.b0 + f.b1 * z1 + f.b2 * z2) / (1.0 + f.a1 * z1 + f.a2 * z2));
+            }
+            spectrum[k] = magnitude;
+            spectrum[(DESIGN - k) % DESIGN] = magnitude;
+        }
+        design_fft.Inverse(spectrum.data());
+
+        // Blackman window: https://en.wikipedia.org/wiki/Window_function#Blackman_window
+        const s32 center = (TAPS - 1) / 2;
+        std::vector<f64> response(TAPS);
+        for (s32 n = 0; n < static_cast<s32>(TAPS); n++)
+        {
+            f64 phase  = 2.0 * PI * n / (TAPS - 1);
+            f64 window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+            response[n] = spectrum[(n - center + DESIGN) % DESIGN].real() * window;
+        }
+        return Convolver::MakeKernel(response.data(), TAPS, kernel_fft);
+    }
+
+    // Polls the bands while the linear phase is on. Kernels replaced meanwhile are released by a later
+    // Publish here once the convolver let go of them, not on the audio thread
+    void Designer()
+    {
+        while (designer_running)
+        {
+            if (linear_phase && background && Changed()) kernels.Publish(Design(designed));
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+public:
+    std::atomic<bool> linear_phase = false; // switched with SetLinearPhase
+    // Design on the designer thread. Offline rendering runs faster than real time, so it designs
+    // between partitions instead and every render gets the same kernels at the same samples
+    bool background = true;
+
+private:
+    FFT design_fft;
+    FFT kernel_fft;
+    Convolver convolver;
+    bool convolving = false;
+    Settings designed = {};
+    bool has_design = false;
+    Published<ConvolverKernel> kernels;
+
+    std::thread designer;
+    std::atomic<bool> designer_running = false;
 };
\ No newline at end of file
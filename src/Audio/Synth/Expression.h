@@ -0,0 +1,485 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+
+// Waveform expressions: a small math language compiled once into register bytecode and evaluated
+// over whole blocks, one straight loop per instruction.
+//   variables: phase (cycles, [0, 1)), t (seconds since note on), freq (Hz), note (MIDI number), pi
+//   operators: + - * / ^ and unary -
+//   functions: sin cos tan tanh abs floor fract sqrt exp log sign min max pow
+//   e.g. "sin(2*pi*phase) + 0.3*sin(6*pi*phase)", "2*fract(phase)-1", "sin(2*pi*phase + exp(-4*t)*sin(4*pi*phase))"
+// Shunting-yard/recursive descent: https://www.engr.mun.ca/~theo/Misc/exp_parsing.htm
+// Register-based bytecode: https://www.lua.org/doc/jucs05.pdf
+struct Expression
+{
+    enum class Op : u8
+    {
+        CONST,
+        ADD, SUB, MUL, DIV, POW, MIN, MAX,
+        NEG, SIN, COS, TAN, TANH, ABS, FLOOR, FRACT, SQRT, EXP, LOG, SIGN,
+    };
+
+    enum Variable : u8 { PHASE, TIME, FREQ, NOTE, VARIABLE_COUNT };
+
+    struct Instruction
+    {
+        Op op;
+        u8 dst;
+        u8 a;   // register, or constant index for CONST
+        u8 b;
+    };
+
+    static constexpr u32 MAX_REGISTERS = 24;
+    static constexpr u32 MAX_BLOCK     = 64;
+
+public:
+    // Parse and compile, on failure error holds the reason and the expression evaluates to silence
+    bool Compile(const std::string& text, std::string& error)
+    {
+        source = text;
+        code.clear();
+        constants.clear();
+        nodes.clear();
+        uses = 0;
+        result = 0;
+        valid = false;
+
+        pos = 0;
+        s32 root = ParseExpression(error);
+        if (root < 0) return false;
+        SkipSpace();
+        if (pos < source.size())
+        {
+            error = "unexpected '" + std::string(1, source[pos]) + "' at " + std::to_string(pos);
+            return false;
+        }
+
+        s32 reg = Generate(root, VARIABLE_COUNT, error);
+        if (reg < 0) return false;
+        result = u8(reg);
+        nodes.clear();
+        valid = true;
+        return true;
+    }
+
+    bool Valid() const { return valid; }
+
+    // Depends only on phase, so one cycle describes it and it can be baked into a wavetable
+    bool Periodic() const { return !(uses & ((1 << TIME) | (1 << FREQ) | (1 << NOTE))); }
+
+    // Evaluate over a block: phase and time per sample, freq and note held for the block
+    void Evaluate(const f64* phase, const f64* time, f64 freq, f64 note, f64* output, u32 samples) const
+    {
+        if (!valid)
+        {
+            std::fill(output, output + samples, 0.0);
+            return;
+        }
+
+        f64 regs[MAX_REGISTERS][MAX_BLOCK];
+        for (u32 offset = 0; offset < samples; offset += MAX_BLOCK)
+        {
+            const u32 n = std::min(MAX_BLOCK, samples - offset);
+            std::copy(phase + offset, phase + offset + n, regs[PHASE]);
+            std::copy(time + offset,  time + offset + n,  regs[TIME]);
+            std::fill(regs[FREQ], regs[FREQ] + n, freq);
+            std::fill(regs[NOTE], regs[NOTE] + n, note);
+
+            for (const Instruction& in : code)
+            {
+                f64* d = regs[in.dst];
+                const f64* a = regs[in.a];
+                const f64* b = regs[in.b];
+                switch (in.op)
+                {
+                case Op::CONST: std::fill(d, d + n, constants[in.a]);                   break;
+                case Op::ADD:   for (u32 k = 0; k < n; k++) d[k] = a[k] + b[k];          break;
+                case Op::SUB:   for (u32 k = 0; k < n; k++) d[k] = a[k] - b[k];          break;
+                case Op::MUL:   for (u32 k = 0; k < n; k++) d[k] = a[k] * b[k];          break;
+                case Op::DIV:   for (u32 k = 0; k < n; k++) d[k] = a[k] / b[k];          break;
+                case Op::POW:   for (u32 k = 0; k < n; k++) d[k] = std::pow(a[k], b[k]); break;
+                case Op::MIN:   for (u32 k = 0; k < n; k++) d[k] = std::min(a[k], b[k]); break;
+                case Op::MAX:   for (u32 k = 0; k < n; k++) d[k] = std::max(a[k], b[k]); break;
+                case Op::NEG:   for (u32 k = 0; k < n; k++) d[k] = -a[k];                break;
+                case Op::SIN:   for (u32 k = 0; k < n; k++) d[k] = std::sin(a[k]);       break;
+                case Op::COS:   for (u32 k = 0; k < n; k++) d[k] = std::cos(a[k]);       break;
+                case Op::TAN:   for (u32 k = 0; k < n; k++) d[k] = std::tan(a[k]);       break;
+                case Op::TANH:  for (u32 k = 0; k < n; k++) d[k] = std::tanh(a[k]);      break;
+                case Op::ABS:   for (u32 k = 0; k < n; k++) d[k] = std::abs(a[k]);       break;
+                case Op::FLOOR: for (u32 k = 0; k < n; k++) d[k] = std::floor(a[k]);     break;
+                case Op::FRACT: for (u32 k = 0; k < n; k++) d[k] = a[k] - std::floor(a[k]); break;
+                case Op::SQRT:  for (u32 k = 0; k < n; k++) d[k] = std::sqrt(a[k]);      break;
+                case Op::EXP:   for (u32 k = 0; k < n; k++) d[k] = std::exp(a[k]);       break;
+                case Op::LOG:   for (u32 k = 0; k < n; k++) d[k] = std::log(a[k]);       break;
+                case Op::SIGN:  for (u32 k = 0; k < n; k++) d[k] = f64((a[k] > 0.0) - (a[k] < 0.0)); break;
+                }
+            }
+
+            // Non finite results (log of a negative, division by zero) become silence
+            const f64* r = regs[result];
+            for (u32 k = 0; k < n; k++)
+                output[offset + k] = std::isfinite(r[k]) ? r[k] : 0.0;
+        }
+    }
+
+public:
+    std::string source;
+    std::vector<Instruction> code;
+    std::vector<f64> constants;
+
+private:
+    struct Node
+    {
+        Op op;
+        bool leaf;      // variable or constant
+        bool constant;
+        u8 variable;
+        f64 value;
+        s32 a = -1;
+        s32 b = -1;
+    };
+
+    static bool IsUnary(Op op) { return op >= Op::NEG; }
+
+    s32 Leaf(f64 value)      { nodes.push_back({ Op::CONST, true, true, 0, value }); return s32(nodes.size()) - 1; }
+    s32 Variable(u8 v)       { uses |= u8(1 << v); nodes.push_back({ Op::CONST, true, false, v, 0.0 }); return s32(nodes.size()) - 1; }
+
+    // Operation node, folded to a constant when every operand is constant
+    s32 Operation(Op op, s32 a, s32 b = -1)
+    {
+        bool constant = nodes[a].constant && (b < 0 || nodes[b].constant);
+        if (constant)
+        {
+            f64 x = nodes[a].value;
+            f64 y = b < 0 ? 0.0 : nodes[b].value;
+            return Leaf(Fold(op, x, y));
+        }
+        nodes.push_back({ op, false, false, 0, 0.0, a, b });
+        return s32(nodes.size()) - 1;
+    }
+
+    static f64 Fold(Op op, f64 x, f64 y)
+    {
+        switch (op)
+        {
+        case Op::ADD:   return x + y;
+        case Op::SUB:   return x - y;
+        case Op::MUL:   return x * y;
+        case Op::DIV:   return x / y;
+        case Op::POW:   return std::pow(x, y);
+        case Op::MIN:   return std::min(x, y);
+        case Op::MAX:   return std::max(x, y);
+        case Op::NEG:   return -x;
+        case Op::SIN:   return std::sin(x);
+        case Op::COS:   return std::cos(x);
+        case Op::TAN:   return std::tan(x);
+        case Op::TANH:  return std::tanh(x);
+        case Op::ABS:   return std::abs(x);
+        case Op::FLOOR: return std::floor(x);
+        case Op::FRACT: return x - std::floor(x);
+        case Op::SQRT:  return std::sqrt(x);
+        case Op::EXP:   return std::exp(x);
+        case Op::LOG:   return std::log(x);
+        case Op::SIGN:  return f64((x > 0.0) - (x < 0.0));
+        default:        return 0.0;
+        }
+    }
+
+    // Stack allocation: a node's value goes to register next, its operands to next and next + 1.
+    // Variables live in fixed registers and emit nothing.
+    s32 Generate(s32 node, u32 next, std::string& error)
+    {
+        const Node& n = nodes[node];
+        if (next >= MAX_REGISTERS)
+        {
+            error = "expression too deep";
+            return -1;
+        }
+
+        if (n.leaf && !n.constant) return n.variable;
+        if (n.leaf)
+        {
+            if (constants.size() >= 256)
+            {
+                error = "too many constants";
+                return -1;
+            }
+            constants.push_back(n.value);
+            code.push_back({ Op::CONST, u8(next), u8(constants.size() - 1), 0 });
+            return next;
+        }
+
+        s32 a = Generate(n.a, next, error);
+        if (a < 0) return -1;
+        s32 b = a;
+        if (!IsUnary(n.op))
+        {
+            b = Generate(n.b, next + 1, error);
+            if (b < 0) return -1;
+        }
+        code.push_back({ n.op, u8(next), u8(a), u8(b) });
+        return next;
+    }
+
+    void SkipSpace()
+    {
+        while (pos < source.size() && std::isspace(static_cast<unsigned char>(source[pos]))) pos++;
+    }
+
+    bool Accept(char c)
+    {
+        SkipSpace();
+        if (pos < source.size() && source[pos] == c)
+        {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    // expression := term (('+' | '-') term)*
+    s32 ParseExpression(std::string& error)
+    {
+        s32 left = ParseTerm(error);
+        while (left >= 0)
+        {
+            if      (Accept('+')) { s32 r = ParseTerm(error); if (r < 0) return -1; left = Operation(Op::ADD, left, r); }
+            else if (Accept('-')) { s32 r = ParseTerm(error); if (r < 0) return -1; left = Operation(Op::SUB, left, r); }
+            else break;
+        }
+        return left;
+    }
+
+    // term := unary (('*' | '/') unary)*
+    s32 ParseTerm(std::string& error)
+    {
+        s32 left = ParseUnary(error);
+        while (left >= 0)
+        {
+            if      (Accept('*')) { s32 r = ParseUnary(error); if (r < 0) return -1; left = Operation(Op::MUL, left, r); }
+            else if (Accept('/')) { s32 r = ParseUnary(error); if (r < 0) return -1; left = Operation(Op::DIV, left, r); }
+            else break;
+        }
+        return left;
+    }
+
+    // unary := '-' unary | power
+    s32 ParseUnary(std::string& error)
+    {
+        if (Accept('-'))
+        {
+            s32 a = ParseUnary(error);
+            return a < 0 ? -1 : Operation(Op::NEG, a);
+        }
+        if (Accept('+')) return ParseUnary(error);
+        return ParsePower(error);
+    }
+
+    // power := primary ('^' unary)?, right associative
+    s32 ParsePower(std::string& error)
+    {
+        s32 base = ParsePrimary(error);
+        if (base >= 0 && Accept('^'))
+        {
+            s32 exponent = ParseUnary(error);
+            return exponent < 0 ? -1 : Operation(Op::POW, base, exponent);
+        }
+        return base;
+    }
+
+    // primary := number | variable | function '(' expression (',' expression)? ')' | '(' expression ')'
+    s32 ParsePrimary(std::string& error)
+    {
+        SkipSpace();
+        if (pos >= source.size())
+        {
+            error = "unexpected end of expression";
+            return -1;
+        }
+
+        if (Accept('('))
+        {
+            s32 e = ParseExpression(error);
+            if (e >= 0 && !Accept(')'))
+            {
+                error = "missing ')' at " + std::to_string(pos);
+                return -1;
+            }
+            return e;
+        }
+
+        char c = source[pos];
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+        {
+            const char* start = source.c_str() + pos;
+            char* end = nullptr;
+            f64 value = std::strtod(start, &end);
+            if (end == start)
+            {
+                error = "bad number at " + std::to_string(pos);
+                return -1;
+            }
+            pos += end - start;
+            return Leaf(value);
+        }
+
+        if (!std::isalpha(static_cast<unsigned char>(c)))
+        {
+            error = "unexpected '" + std::string(1, c) + "' at " + std::to_string(pos);
+            return -1;
+        }
+
+        size_t start = pos;
+        while (pos < source.size() && (std::isalnum(static_cast<unsigned char>(source[pos])) || source[pos] == '_')) pos++;
+        std::string name = source.substr(start, pos - start);
+
+        if (name == "phase") return Variable(PHASE);
+        if (name == "t")     return Variable(TIME);
+        if (name == "freq")  return Variable(FREQ);
+        if (name == "note")  return Variable(NOTE);
+        if (name == "pi")    return Leaf(PI);
+
+        struct Function { const char* name; Op op; };
+        static const Function functions[] = {
+            { "sin", Op::SIN }, { "cos", Op::COS }, { "tan", Op::TAN }, { "tanh", Op::TANH }, { "abs", Op::ABS },
+            { "floor", Op::FLOOR }, { "fract", Op::FRACT }, { "sqrt", Op::SQRT }, { "exp", Op::EXP }, { "log", Op::LOG },
+            { "sign", Op::SIGN }, { "min", Op::MIN }, { "max", Op::MAX }, { "pow", Op::POW },
+        };
+        auto f = std::find_if(std::begin(functions), std::end(functions), [&name](const Function& f) { return name == f.name; });
+        if (f == std::end(functions))
+        {
+            error = "unknown name '" + name + "'";
+            return -1;
+        }
+
+        if (!Accept('('))
+        {
+            error = "expected '(' after " + name;
+            return -1;
+        }
+        s32 a = ParseExpression(error);
+        if (a < 0) return -1;
+        s32 b = -1;
+        if (!IsUnary(f->op))
+        {
+            if (!Accept(','))
+            {
+                error = name + " takes two arguments";
+                return -1;
+            }
+            b = ParseExpression(error);
+            if (b < 0) return -1;
+        }
+        if (!Accept(')'))
+        {
+            error = "missing ')' after " + name + " arguments";
+            return -1;
+        }
+        return Operation(f->op, a, b);
+    }
+
+private:
+    std::vector<Node> nodes;
+    size_t pos = 0;
+    u8 uses = 0;
+    u8 result = 0;
+    bool valid = false;
+};
+
+// Band-limited wavetable: one cycle resynthesized at several harmonic limits (one per octave),
+// the oscillator picks the table whose highest harmonic stays below Nyquist.
+// Wavetable synthesis: https://www.earlevel.com/main/2012/05/03/a-wavetable-oscillator%e2%80%94introduction/
+struct Wavetable
+{
+    static constexpr u32 SIZE      = 2048;
+    static constexpr u32 LEVELS    = 11;  // highest harmonic SIZE/2 >> level: 1024 down to 1
+    static constexpr u32 HARMONICS = SIZE / 2;
+
+    std::vector<f64> tables; // LEVELS tables of SIZE + 1 samples, the last repeats the first
+
+    bool Empty() const { return tables.empty(); }
+
+    // Off the audio thread: sample one cycle, take its harmonics with a DFT and sum them back per level
+    void Bake(const Expression& expression)
+    {
+        std::vector<f64> cycle(SIZE), phase(SIZE), time(SIZE, 0.0);
+        for (u32 i = 0; i < SIZE; i++) phase[i] = f64(i) / SIZE;
+        expression.Evaluate(phase.data(), time.data(), 0.0, 0.0, cycle.data(), SIZE);
+
+        std::vector<f64> cosine(SIZE), sine(SIZE);
+        for (u32 i = 0; i < SIZE; i++)
+        {
+            cosine[i] = std::cos(2.0 * PI * i / SIZE);
+            sine[i]   = std::sin(2.0 * PI * i / SIZE);
+        }
+
+        f64 dc = 0.0;
+        for (f64 x : cycle) dc += x;
+        dc /= SIZE;
+
+        std::vector<f64> re(HARMONICS + 1, 0.0), im(HARMONICS + 1, 0.0);
+        for (u32 h = 1; h <= HARMONICS; h++)
+        {
+            for (u32 i = 0; i < SIZE; i++)
+            {
+                u32 index = (h * i) & (SIZE - 1);
+                re[h] += cycle[i] * cosine[index];
+                im[h] += cycle[i] * sine[index];
+            }
+            // Nyquist bin is shared by both halves of the spectrum
+            f64 scale = (h == HARMONICS) ? 1.0 / SIZE : 2.0 / SIZE;
+            re[h] *= scale;
+            im[h] *= scale;
+        }
+
+        tables.assign(LEVELS * (SIZE + 1), 0.0);
+        for (u32 level = 0; level < LEVELS; level++)
+        {
+            f64* table = &tables[level * (SIZE + 1)];
+            u32 top = HARMONICS >> level;
+            for (u32 i = 0; i < SIZE; i++)
+            {
+                f64 x = dc;
+                for (u32 h = 1; h <= top; h++)
+                {
+                    u32 index = (h * i) & (SIZE - 1);
+                    x += re[h] * cosine[index] + im[h] * sine[index];
+                }
+                table[i] = x;
+            }
+            table[SIZE] = table[0];
+        }
+    }
+
+    // Table with every harmonic below Nyquist for this fundamental
+    u32 Level(f64 frequency, f64 sample_rate) const
+    {
+        f64 highest = frequency > 0.0 ? 0.5 * sample_rate / frequency : f64(HARMONICS);
+        u32 level = 0;
+        while (level + 1 < LEVELS && f64(HARMONICS >> level) > highest) level++;
+        return level;
+    }
+
+    f64 Lookup(u32 level, f64 phase) const
+    {
+        const f64* table = &tables[level * (SIZE + 1)];
+        f64 position = (phase - std::floor(phase)) * SIZE;
+        u32 index = std::min(u32(position), SIZE - 1);
+        f64 frac = position - index;
+        return table[index] + frac * (table[index + 1] - table[index]);
+    }
+};
+
+// Compiled custom waveform, swapped as a whole so the audio thread never sees a half edited program
+struct CustomWave
+{
+    Expression expression;
+    Wavetable wavetable; // baked when requested and the expression only depends on phase
+};
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <complex>
+#include <utility>
+
+#include "../../Core/Common.h"
+
+// Fast Fourier Transform: iterative radix-2, twiddles and bit reversal precomputed for one size,
+// so a transform on the audio thread does no trigonometry and no allocation.
+// Cooley-Tukey FFT: https://en.wikipedia.org/wiki/Cooley%E2%80%93Tukey_FFT_algorithm
+// Understanding the FFT: https://www.dsprelated.com/showarticle/800.php
+struct FFT
+{
+    using Complex = std::complex<f64>;
+
+    // Size must be a power of two
+    void Init(u32 n)
+    {
+        size = n;
+        bits = 0;
+        while ((1u << bits) < n) bits++;
+
+        twiddle.resize(n / 2);
+        for (u32 i = 0; i < n / 2; i++)
+            twiddle[i] = std::polar(1.0, -2.0 * PI * i / n);
+
+        reverse.resize(n);
+        for (u32 i = 0; i < n; i++)
+        {
+            u32 r = 0;
+            for (u32 b = 0; b < bits; b++)
+                r |= ((i >> b) & 1u) << (bits - 1 - b);
+            reverse[i] = r;
+        }
+    }
+
+    // In place, size entries. The inverse is scaled by 1 / size, so Inverse(Forward(x)) == x
+    void Forward(Complex* data) const { Transform(data, false); }
+    void Inverse(Complex* data) const { Transform(data, true); }
+
+    void Transform(Complex* data, bool inverse) const
+    {
+        for (u32 i = 0; i < size; i++)
+            if (i < reverse[i])
+                std::swap(data[i], data[reverse[i]]);
+
+        for (u32 length = 2; length <= size; length <<= 1)
+        {
+            u32 half   = length / 2;
+            u32 stride = size / length;
+            for (u32 start = 0; start < size; start += length)
+            {
+                for (u32 k = 0; k < half; k++)
+                {
+                    Complex w = inverse ? std::conj(twiddle[k * stride]) : twiddle[k * stride];
+                    Complex a = data[start + k];
+                    Complex b = data[start + k + half] * w;
+                    data[start + k]        = a + b;
+                    data[start + k + half] = a - b;
+                }
+            }
+        }
+
+        if (inverse)
+        {
+            f64 scale = 1.0 / size;
+            for (u32 i = 0; i < size; i++)
+                data[i] *= scale;
+        }
+    }
+
+    u32 size = 0;
+    u32 bits = 0;
+    std::vector<Complex> twiddle;
+    std::vector<u32> reverse;
+};
\ No newline at end of file
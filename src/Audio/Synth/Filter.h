@@ -1,7 +1,7 @@
 #pragma once
 
 #include <algorithm>
-#include <complex>
+#include <cmath>
 #include <vector>
 
 #include "../../Core/Common.h"
@@ -10,6 +10,20 @@
 // MusicDSP Filters: https://www.musicdsp.org/en/latest/Filters/index.html
 // DSP CPP Filters: https://github.com/dimtass/DSP-Cpp-filters
 
+// Bilinear prewarping tan(pi x) of a normalized frequency x = f / fs, for cutoffs moved at audio or control rate
+// without std::tan: a [5/4] Pade approximant on [0, 1/4], the upper half from tan(pi x) = 1 / tan(pi (1/2 - x)).
+// Relative error below 2e-8 up to 0.4999
+// Pade approximant: https://en.wikipedia.org/wiki/Pad%C3%A9_approximant
+inline f64 prewarp(f64 x)
+{
+    x = std::clamp(x, 0.0, 0.4999);
+    const bool upper = x > 0.25;
+    f64 y  = PI * (upper ? 0.5 - x : x);
+    f64 y2 = y * y;
+    f64 t  = y * (945.0 + y2 * (y2 - 105.0)) / (945.0 + y2 * (15.0 * y2 - 420.0));
+    return upper ? 1.0 / t : t;
+}
+
 struct VAFilter
 {
     enum class Type {
@@ -31,6 +45,11 @@ struct VAFilter
     f64 state_1 = 0.0;
     f64 state_2 = 0.0;
 
+    // Glide of g and R toward a modulated cutoff, one Step per frame
+    f64 g_step = 0.0;
+    f64 R_step = 0.0;
+    u32 glide  = 0;
+
 public:
     void CalcCoefs(f64 cutoff, f64 reso)
     {
@@ -40,6 +59,37 @@ public:
         g = std::tan(PI * frequency * 1.0 / SAMPLE_RATE);
         R = std::min(1.0 - resonance, 0.999);
         denom_inv = 1.0 / (1.0 + (2.0 * R * g) + g * g);
+        glide = 0;
+    }
+
+    // Coefficients for a modulated cutoff and resonance, frequency and resonance keep the base values.
+    // Cheap enough for every control block: no std::tan, one division. Over samples frames g and R glide
+    // there linearly from where they are, the SVF stays stable all along as both stay positive
+    void SetCutoffFast(f64 cutoff, f64 reso, u32 samples = 0)
+    {
+        f64 g_target = prewarp(cutoff / SAMPLE_RATE);
+        f64 R_target = std::min(1.0 - reso, 0.999);
+        if (samples == 0)
+        {
+            g = g_target;
+            R = R_target;
+            denom_inv = 1.0 / (1.0 + (2.0 * R * g) + g * g);
+            glide = 0;
+            return;
+        }
+        g_step = (g_target - g) / samples;
+        R_step = (R_target - R) / samples;
+        glide  = samples;
+    }
+
+    // Next frame of a glide, once per frame however many voices share the filter
+    void Step()
+    {
+        if (glide == 0) return;
+        g += g_step;
+        R += R_step;
+        denom_inv = 1.0 / (1.0 + (2.0 * R * g) + g * g);
+        glide--;
     }
 
     void Reset()
@@ -66,34 +116,6 @@ public:
         case Type::HIGH_PASS: return high_pass;
         }
     }
-
-    f64 TransferFunction(f64 frequency)
-    {
-        f64 omega = 2.0 * PI * frequency / SAMPLE_RATE;
-        f64 gain  = 0.0;
-
-        switch (type)
-        {
-        case Type::LOW_PASS:
-            gain = (g * g) / (1.0 + 2.0 * R * g + omega * omega);
-            break;
-
-        case Type::BAND_PASS:
-            gain = (g * omega) / (omega * omega + 2.0 * R * omega + 1.0);
-            break;
-
-        case Type::HIGH_PASS:
-            gain = 1.0 / (1.0 + 2.0 * R * g + omega * omega);
-            break;
-
-        case Type::OFF:
-        default:
-            gain = 1.0;
-            break;
-        }
-
-        return gain;
-    }
 };
 
 // Biquad Filter: https://en.wikipedia.org/wiki/Digital_biquad_filter
@@ -140,19 +162,36 @@ struct BqFilter
 
     f64 output;
 
+    // Peak and shelf gain of the last CalcCoefs, kept for SetCutoffFast
+    f64 gain = 1.0;
+    f64 beta = std::sqrt(2.0);
+
     void CalcCoefs(f64 cutoff, f64 reso, f64 gain_db = 0.0)
     {
         resonance = reso;
         frequency = cutoff;
 
         f64 omega = 2.0 * PI * frequency * 1.0 / SAMPLE_RATE;
-        f64 sin_omega = std::sin(omega);
-        f64 cos_omega = std::cos(omega);
+        gain = dB_to_volume(0.5 * gain_db);
+        beta = std::sqrt(2.0 * gain);
+        Design(std::sin(omega), std::cos(omega), reso);
+    }
 
-        f64 gain = dB_to_volume(0.5 * gain_db);
+    // Coefficients for a modulated cutoff and resonance, frequency, resonance and gain keep the base values.
+    // No sin, cos, pow or sqrt: both come from t = tan(omega / 2), sin = 2t / (1 + t^2), cos = (1 - t^2) / (1 + t^2)
+    void SetCutoffFast(f64 cutoff, f64 reso)
+    {
+        f64 t  = prewarp(cutoff / SAMPLE_RATE);
+        f64 t2 = t * t;
+        f64 n  = 1.0 / (1.0 + t2);
+        Design(2.0 * t * n, (1.0 - t2) * n, reso);
+    }
 
+private:
+    // Audio EQ Cookbook: https://www.w3.org/TR/audio-eq-cookbook/
+    void Design(f64 sin_omega, f64 cos_omega, f64 reso)
+    {
         f64 alpha = sin_omega / (2.0 * std::max(reso, 0.001));
-        f64 beta  = std::sqrt(2.0 * gain);
 
         f64 a0 = 1.0f;
 
@@ -232,11 +271,24 @@ struct BqFilter
         }
 
         // Normalize
-        b0 /= a0;
-        b1 /= a0;
-        b2 /= a0;
-        a1 /= a0;
-        a2 /= a0;
+        f64 a0_inv = 1.0 / a0;
+        b0 *= a0_inv;
+        b1 *= a0_inv;
+        b2 *= a0_inv;
+        a1 *= a0_inv;
+        a2 *= a0_inv;
+    }
+
+public:
+
+    // Share the coefficients of another filter, keeping this filter's state (stereo pairs)
+    void CopyCoefs(const BqFilter& other)
+    {
+        type      = other.type;
+        frequency = other.frequency;
+        resonance = other.resonance;
+        b0 = other.b0; b1 = other.b1; b2 = other.b2;
+        a1 = other.a1; a2 = other.a2;
     }
 
     void Reset() 
@@ -260,30 +312,70 @@ struct BqFilter
 
         return y;
     }
+};
+
 
-    f64 TransferFunction(f64 freq)
+// Circular delay line: owns its storage, or borrows a slice of a preallocated pool so voices never allocate
+struct DelayLine
+{
+    std::vector<f64> storage;
+    f64* buffer = nullptr;
+    s32 size = 0;
+    s32 offset = 0;
+
+    DelayLine() = default;
+    DelayLine(const DelayLine& other) { *this = other; }
+    DelayLine& operator=(const DelayLine& other)
     {
-        f64 omega     = 2.0 * PI * freq / sample_rate;
-        f64 cos_omega = std::cos(omega);
-        f64 sin_omega = std::sin(omega);
+        storage = other.storage;
+        buffer  = other.storage.empty() ? other.buffer : storage.data();
+        size    = other.size;
+        offset  = other.offset;
+        return *this;
+    }
 
-        std::complex<f64> z1 = std::polar(1.0, -omega);
-        std::complex<f64> z2 = std::polar(1.0, -2.0 * omega);
+    // Own storage of n samples, reallocates only past the reserved capacity
+    void Resize(s32 n)
+    {
+        storage.resize(n);
+        buffer = storage.data();
+        size = n;
+        offset %= size;
+    }
 
-        std::complex<f64> numerator   = b0 + b1 * z1 + b2 * z2;
-        std::complex<f64> denominator = 1.0 + a1 * z1 + a2 * z2;
-        std::complex<f64> gain        = numerator / denominator;
+    void Reserve(s32 n)
+    {
+        storage.reserve(n);
+        buffer = storage.data();
+    }
 
-        return std::abs(gain);
+    // Borrowed storage of n samples, cleared
+    void Attach(f64* pool, s32 n)
+    {
+        storage.clear();
+        buffer = pool;
+        size = n;
+        offset = 0;
+        std::fill(buffer, buffer + size, 0.0);
     }
-};
 
+    // Sample written size samples ago, the next one to be overwritten
+    f64 Read() const { return buffer[offset]; }
+
+    // Sample written delay samples ago, 1 to size
+    f64 Tap(s32 delay) const { return buffer[wrap(offset - delay, size)]; }
+
+    void Write(f64 x)
+    {
+        buffer[offset] = x;
+        offset = wrap(offset + 1, size);
+    }
+};
 
 // For reverb effect
 struct CombFilter 
 {
-    std::vector<f64> history;
-    s32 history_offset = 0;
+    DelayLine history;
     f64 feedback = 0.0;
     f64 damp = 0.0;
 
@@ -291,17 +383,15 @@ struct CombFilter
 
     void SetDelay(s32 delay_in_samples) 
     {
-        history.resize(delay_in_samples);
-        history_offset %= history.size();
+        history.Resize(delay_in_samples);
     }
 
     f64 Process(const f64 x)
     {
-        f64 y = history[history_offset];
+        f64 y = history.Read();
         state = lerp(y, state, damp);
 
-        history[history_offset] = x + feedback * state;
-        history_offset = wrap(history_offset + 1, history.size());
+        history.Write(x + feedback * state);
 
         return y;
     }
@@ -309,24 +399,327 @@ struct CombFilter
 
 struct AllPassFilter 
 {
-    std::vector<f64> history;
-    s32 history_offset = 0;
+    DelayLine history;
     f64 feedback = 0.0;
 
     void SetDelay(s32 delay_in_samples) 
     {
-        history.resize(delay_in_samples);
-        history_offset %= history.size();
+        history.Resize(delay_in_samples);
     }
 
     f64 Process(const f64 x)
     {
-        f64 old = history[history_offset];
+        f64 old = history.Read();
         f64 y = -x + old;
 
-        history[history_offset] = x + feedback * old;
-        history_offset = wrap(history_offset + 1, history.size());
+        history.Write(x + feedback * old);
 
         return y;
     }
+};
+
+// First order allpass interpolator for fractional delays, delay 0.1 to 1.1 samples keeps it flat and stable.
+// AllPassFilter above is the Freeverb diffuser, which is not allpass, so it cannot tune a loop.
+// Thiran allpass: https://ccrma.stanford.edu/~jos/pasp/First_Order_Allpass_Interpolation.html
+struct FractionalDelay
+{
+    f64 c  = 0.0;
+    f64 x1 = 0.0;
+    f64 y1 = 0.0;
+
+    void SetDelay(f64 delay) { c = (1.0 - delay) / (1.0 + delay); }
+
+    // Exact phase delay at one frequency, omega in radians per sample
+    void SetDelay(f64 delay, f64 omega) { c = std::sin(0.5 * omega * (1.0 - delay)) / std::sin(0.5 * omega * (1.0 + delay)); }
+
+    void Reset() { x1 = y1 = 0.0; }
+
+    f64 Process(const f64 x)
+    {
+        f64 y = c * x + x1 - c * y1;
+        x1 = x;
+        y1 = y;
+        return y;
+    }
+};
+
+// Tanh as a 7/6 continued fraction, within 2e-5 below |x| = 4.97 where it is clamped to 1.
+// Lambert's continued fraction: https://varietyofsound.wordpress.com/2011/02/14/efficient-tanh-computation-using-lamberts-continued-fraction/
+inline f64 fast_tanh(f64 x)
+{
+    x = std::clamp(x, -4.97, 4.97);
+    f64 x2 = x * x;
+    f64 p = x * (135135.0 + x2 * (17325.0 + x2 * (378.0 + x2)));
+    f64 q = 135135.0 + x2 * (62370.0 + x2 * (3150.0 + x2 * 28.0));
+    return std::clamp(p / q, -1.0, 1.0);
+}
+
+// Polyphase half band FIR for 2x resampling. Every other tap is zero and the center is 1/2, so one phase
+// is a plain delay and the other a symmetric FIR of 2M taps: Kaiser windowed sinc, designed once per M.
+// Up and down together delay by 2M - 1 samples of the lower rate.
+// Half band filters: https://www.dsprelated.com/showarticle/1247.php
+template <u32 M, u32 BETA>
+struct Halfband
+{
+    static constexpr u32 TAPS = 2 * M;
+
+    // Newest first, written twice so TAPS entries are contiguous from pos
+    template <u32 SIZE>
+    struct History
+    {
+        f64 data[2 * SIZE] = {};
+        u32 pos = 0;
+
+        void Push(f64 x)
+        {
+            pos = pos == 0 ? SIZE - 1 : pos - 1;
+            data[pos] = data[pos + SIZE] = x;
+        }
+
+        const f64* Recent() const { return data + pos; }
+    };
+
+    struct Up
+    {
+        History<TAPS> x;
+
+        // One sample in, two out at twice the rate
+        void Process(f64 in, f64& even, f64& odd)
+        {
+            even = Halfband::Convolve(in, x.Recent());
+            odd  = M > 1 ? x.Recent()[M - 2] : in;
+            x.Push(in);
+        }
+    };
+
+    struct Down
+    {
+        History<TAPS> even;
+        History<M> odd;
+
+        // Two samples in at twice the rate, one out
+        f64 Process(f64 a, f64 b)
+        {
+            f64 y = 0.5 * (Halfband::Convolve(a, even.Recent()) + odd.Recent()[M - 1]);
+            even.Push(a);
+            odd.Push(b);
+            return y;
+        }
+    };
+
+    // The newest sample and the history before it through the FIR phase, twice its taps for the gain of 2 an
+    // upsampler needs. The history is read before the newest sample is written, so no load waits on that store,
+    // and two sums of two lanes keep the additions independent.
+    static f64 Convolve(f64 newest, const f64* x)
+    {
+        const f64* c = table.c + 1;
+        u32 k = 0;
+#if defined(SYNTH_SSE2)
+        __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd();
+        for (; k + 4 <= TAPS - 1; k += 4)
+        {
+            a = _mm_add_pd(a, _mm_mul_pd(_mm_loadu_pd(c + k),     _mm_loadu_pd(x + k)));
+            b = _mm_add_pd(b, _mm_mul_pd(_mm_loadu_pd(c + k + 2), _mm_loadu_pd(x + k + 2)));
+        }
+        alignas(16) f64 lanes[2];
+        _mm_store_pd(lanes, _mm_add_pd(a, b));
+        f64 sum = table.c[0] * newest + lanes[0] + lanes[1];
+#elif defined(SYNTH_NEON)
+        float64x2_t a = vdupq_n_f64(0.0), b = vdupq_n_f64(0.0);
+        for (; k + 4 <= TAPS - 1; k += 4)
+        {
+            a = vfmaq_f64(a, vld1q_f64(c + k),     vld1q_f64(x + k));
+            b = vfmaq_f64(b, vld1q_f64(c + k + 2), vld1q_f64(x + k + 2));
+        }
+        f64 sum = table.c[0] * newest + vaddvq_f64(vaddq_f64(a, b));
+#else
+        f64 sum = table.c[0] * newest;
+#endif
+        for (; k < TAPS - 1; k++)
+            sum += c[k] * x[k];
+        return sum;
+    }
+
+    struct Table
+    {
+        f64 c[TAPS];
+        Table()
+        {
+            auto bessel_i0 = [](f64 x) {
+                f64 sum = 1.0, term = 1.0;
+                for (s32 k = 1; k < 50; k++)
+                {
+                    term *= (0.5 * x / k) * (0.5 * x / k);
+                    sum += term;
+                }
+                return sum;
+            };
+            const f64 center = TAPS - 1.0;
+            for (u32 k = 0; k < M; k++)
+            {
+                f64 d = 2.0 * k - center; // odd distance from the center, in samples of the higher rate
+                f64 window = bessel_i0(BETA * std::sqrt(1.0 - (d / center) * (d / center))) / bessel_i0(BETA);
+                c[k] = c[TAPS - 1 - k] = std::sin(0.5 * PI * d) / (0.5 * PI * d) * window;
+            }
+        }
+    };
+    // Designed at startup, never on the audio thread
+    static inline const Table table;
+};
+
+// Per voice state of a ladder: four stage integrators and the resampler histories. The oversampling factor
+// is chosen on the first block and kept for the life of the voice, so it never switches under a sounding note.
+struct LadderVoice
+{
+    using Stage1 = Halfband<12, 8>; // 1x to 2x, -75 dB past 0.32 of the higher rate
+    using Stage2 = Halfband<4, 6>;  // 2x to 4x, -60 dB past 0.455, the band above 0.25 is already empty
+
+    u32 factor = 0; // 0 until the first block
+    f64 s[4] = {};
+    Stage1::Up   up1;
+    Stage1::Down down1;
+    Stage2::Up   up2[2];
+    Stage2::Down down2[2];
+};
+
+// Zero delay feedback ladder: four one pole low pass stages in a loop, the input and the feedback saturating
+// together as in the transistor ladder. The loop is solved every sample with two Newton steps from the linear
+// solution. Drive saturates harder without raising the level, and above a few dB runs the filter at 2x or 4x
+// so the harmonics it makes do not alias.
+// The Art of VA Filter Design (Zavalishin): https://www.native-instruments.com/fileadmin/ni_media/downloads/pdf/VAFilterDesign_2.1.0.pdf
+// Moog ladder filter: https://www.musicdsp.org/en/latest/Filters/24-moog-vcf.html
+struct LadderFilter
+{
+    enum class Oversampling
+    {
+        AUTO,
+        X1,
+        X2,
+        X4,
+        COUNT
+    };
+    static constexpr const char* OVERSAMPLING_NAMES[] = { "Auto", "1x", "2x", "4x" };
+
+    // Drive, as a gain, from which the automatic choice oversamples
+    static constexpr f64 DRIVE_2X = 2.0; // +6 dB
+    static constexpr f64 DRIVE_4X = 8.0; // +18 dB
+
+    f64 frequency;
+    f64 resonance;   // 0 to 1, self oscillation from about 0.95
+    f64 sample_rate;
+    f64 drive = 0.0; // dB
+    s32 oversampling = static_cast<s32>(Oversampling::AUTO);
+
+    // Coefficients, at 1x, 2x and 4x
+    f64 G[3] = {};      // one pole gain g / (1 + g)
+    f64 linear[3] = {}; // 1 / (1 + k G^4), the loop solved with tanh(x) = x
+    f64 k = 0.0;        // feedback, the loop gain is 1 at 4
+    f64 gain = 1.0;     // drive
+    f64 makeup = 1.0;   // 1 / gain, small signals pass at the same level whatever the drive
+
+public:
+    void CalcCoefs(f64 cutoff, f64 reso)
+    {
+        resonance = reso;
+        frequency = cutoff;
+
+        gain = dB_to_volume(drive);
+        makeup = 1.0 / gain;
+        SetCutoffFast(cutoff, reso);
+    }
+
+    // Coefficients for a modulated cutoff and resonance, frequency, resonance and drive keep the base values
+    void SetCutoffFast(f64 cutoff, f64 reso)
+    {
+        // Past 0.95 the loop gain exceeds 1 and the saturation holds the oscillation
+        k = 4.2 * std::clamp(reso, 0.0, 1.0);
+        for (u32 i = 0; i < 3; i++)
+        {
+            f64 g = prewarp(std::min(cutoff, 0.49 * SAMPLE_RATE) / (SAMPLE_RATE * (1 << i)));
+            G[i] = g / (1.0 + g);
+            linear[i] = 1.0 / (1.0 + k * G[i] * G[i] * G[i] * G[i]);
+        }
+    }
+
+    // Oversampling a new voice would start with
+    u32 Factor() const
+    {
+        switch (static_cast<Oversampling>(oversampling))
+        {
+        case Oversampling::X1: return 1;
+        case Oversampling::X2: return 2;
+        case Oversampling::X4: return 4;
+        default:               return gain < DRIVE_2X ? 1 : (gain < DRIVE_4X ? 2 : 4);
+        }
+    }
+
+    // One voice block in place
+    void Process(LadderVoice& v, f64* block, u32 samples) const
+    {
+        if (v.factor == 0) v.factor = Factor();
+
+        if (v.factor == 1)
+        {
+            for (u32 i = 0; i < samples; i++)
+                block[i] = Tick(v, block[i], 0);
+        }
+        else if (v.factor == 2)
+        {
+            for (u32 i = 0; i < samples; i++)
+            {
+                f64 a, b;
+                v.up1.Process(block[i], a, b);
+                a = Tick(v, a, 1);
+                b = Tick(v, b, 1);
+                block[i] = v.down1.Process(a, b);
+            }
+        }
+        else
+        {
+            for (u32 i = 0; i < samples; i++)
+            {
+                f64 x[2], y[2];
+                v.up1.Process(block[i], x[0], x[1]);
+                for (u32 j = 0; j < 2; j++)
+                {
+                    f64 a, b;
+                    v.up2[j].Process(x[j], a, b);
+                    a = Tick(v, a, 2);
+                    b = Tick(v, b, 2);
+                    y[j] = v.down2[j].Process(a, b);
+                }
+                block[i] = v.down1.Process(y[0], y[1]);
+            }
+        }
+    }
+
+private:
+    // One sample at the oversampled rate, coefficients of rate r
+    f64 Tick(LadderVoice& v, f64 x, u32 r) const
+    {
+        // The loop output is y = G^4 u + S, S what the stage integrators add
+        const f64 g  = G[r];
+        const f64 g2 = g * g;
+        const f64 g4 = g2 * g2;
+        const f64 S  = (1.0 - g) * (g2 * g * v.s[0] + g2 * v.s[1] + g * v.s[2] + v.s[3]);
+        const f64 in = gain * x;
+
+        // u = tanh(in - k y): Newton on y - G^4 u - S = 0, from the solution with tanh(x) = x
+        f64 y = (g4 * in + S) * linear[r];
+        for (u32 i = 0; i < 2; i++)
+        {
+            f64 t = fast_tanh(in - k * y);
+            y -= (y - g4 * t - S) / (1.0 + g4 * k * (1.0 - t * t));
+        }
+
+        // Stages as trapezoidal one poles: v = G (x - s), y = v + s, s = y + v
+        f64 a = fast_tanh(in - k * y);
+        for (u32 i = 0; i < 4; i++)
+        {
+            f64 step = g * (a - v.s[i]);
+            a = step + v.s[i];
+            v.s[i] = a + step;
+        }
+        return a * makeup;
+    }
 };
\ No newline at end of file
@@ -1,16 +1,240 @@
 #pragma once
 
+#include <cmath>
+#include <algorithm>
+
 #include "../../Core/Common.h"
+#include "Envelope.h"
+
+// Frequency Modulation Synthesis (phase modulation, DX style)
+// Chowning, The Synthesis of Complex Audio Spectra by Means of Frequency Modulation: https://web.eecs.umich.edu/~fessler/course/100/misc/chowning-73-tso.pdf
+// DX7 algorithms: https://djjondent.blogspot.com/2019/10/yamaha-dx7-algorithms.html
+// Dexed (DX7 emulation): https://github.com/asb2m10/dexed
+
+// Sine lookup with linear interpolation, phases are u32 fixed point cycles so they wrap for free
+struct SineTable
+{
+	static constexpr u32 BITS  = 12;
+	static constexpr u32 SIZE  = 1 << BITS;
+	static constexpr u32 SHIFT = 32 - BITS;
+	static constexpr f64 FRACTION = 1.0 / (1 << SHIFT);
+
+	f64 table[SIZE + 1];
+
+	SineTable()
+	{
+		for (u32 i = 0; i <= SIZE; i++)
+			table[i] = std::sin(2.0 * PI * i / SIZE);
+	}
+
+	f64 Lookup(u32 phase) const
+	{
+		u32 index = phase >> SHIFT;
+		f64 frac  = (phase & ((1u << SHIFT) - 1)) * FRACTION;
+		return table[index] + frac * (table[index + 1] - table[index]);
+	}
+
+	static const SineTable& Instance()
+	{
+		static const SineTable sine;
+		return sine;
+	}
+};
+
+// Cycles to u32 fixed point phase, wraps modulation of several cycles
+static u32 cycles_to_phase(f64 cycles)
+{
+	return static_cast<u32>(static_cast<s64>(cycles * 4294967296.0));
+}
+
+// Operator bit for the algorithm tables, numbered from 1
+static constexpr u8 fm_op(s32 number) { return u8(1 << (number - 1)); }
+
+// Per-voice operator state
+struct FmVoice
+{
+	static constexpr s32 MAX_OPERATORS = 6;
+
+	u32 phase[MAX_OPERATORS] = {};
+	f64 level[MAX_OPERATORS] = {};  // envelope level reached at the end of the last block
+	f64 feedback[2] = {};           // last two outputs of the feedback operator
+};
 
 struct FrequencyModulator
 {
-	f64 amplitude;
-	f64 frequency;
+	static constexpr s32 OPERATORS = FmVoice::MAX_OPERATORS;
+	static constexpr u32 MAX_BLOCK = 64;
 
-	FrequencyModulator(f64 amp = 0.0, f64 freq = 0.0) {}
+	// Phase deviation of a full level modulator (4 pi), and of full feedback (pi), in cycles
+	static constexpr f64 MAX_INDEX    = 2.0;
+	static constexpr f64 MAX_FEEDBACK = 0.5;
 
-	f64 Modulate(f64 time_step, f64 carrier_frequency)
+	struct Operator
 	{
-		return amplitude * carrier_frequency * std::sin(frequency * 2.0 * PI * time_step);
+		f64 ratio    = 1.0;  // frequency ratio to the note
+		f64 detune   = 0.0;  // cents
+		f64 level    = 1.0;  // output level, or modulation depth for modulators
+		f64 velocity = 0.0;  // velocity sensitivity [0, 1]
+		Envelope envelope = { 0.01, 1.0, 0.8, 0.5, 1.0, Envelope::Decay::EXPONENTIAL };
+	};
+
+	// Operator graph: operators are numbered 1 to 6 as on the DX7, modulators always have a higher number
+	// than what they modulate, so evaluating from operator 6 down to 1 visits each modulator first
+	struct Algorithm
+	{
+		const char* name;
+		u8 modulators[OPERATORS]; // bit j set: operator j+1 modulates this operator
+		u8 carriers;              // bit i set: operator i+1 is heard
+		s8 feedback;              // operator index with self feedback, -1 none
+	};
+
+	static constexpr Algorithm ALGORITHMS[] = {
+		// 4 operators (DX9/TX81Z), operators 5 and 6 unused
+		{ "4-OP 1: 4>3>2>1",         { fm_op(2), fm_op(3), fm_op(4), 0, 0, 0 },            fm_op(1),                                  3 },
+		{ "4-OP 2: (3+4)>2>1",       { fm_op(2), fm_op(3) | fm_op(4), 0, 0, 0, 0 },        fm_op(1),                                  3 },
+		{ "4-OP 3: (2>1)+(4>3)",     { fm_op(2), 0, fm_op(4), 0, 0, 0 },                   fm_op(1) | fm_op(3),                       3 },
+		{ "4-OP 4: 4>(1+2+3)",       { fm_op(4), fm_op(4), fm_op(4), 0, 0, 0 },            fm_op(1) | fm_op(2) | fm_op(3),            3 },
+		{ "4-OP 5: 4>3, 1+2+3",      { 0, 0, fm_op(4), 0, 0, 0 },                          fm_op(1) | fm_op(2) | fm_op(3),            3 },
+		{ "4-OP 6: 1+2+3+4",         { 0, 0, 0, 0, 0, 0 },                                 fm_op(1) | fm_op(2) | fm_op(3) | fm_op(4), 3 },
+		// 6 operators (DX7)
+		{ "DX7 1: (2>1)+(6>5>4>3)",  { fm_op(2), 0, fm_op(4), fm_op(5), fm_op(6), 0 },     fm_op(1) | fm_op(3),                       5 },
+		{ "DX7 2: (2>1)+(6>5>4>3)",  { fm_op(2), 0, fm_op(4), fm_op(5), fm_op(6), 0 },     fm_op(1) | fm_op(3),                       1 },
+		{ "DX7 3: (3>2>1)+(6>5>4)",  { fm_op(2), fm_op(3), 0, fm_op(5), fm_op(6), 0 },     fm_op(1) | fm_op(4),                       5 },
+		{ "DX7 5: 3 pairs",          { fm_op(2), 0, fm_op(4), 0, fm_op(6), 0 },            fm_op(1) | fm_op(3) | fm_op(5),            5 },
+		{ "DX7 7: (2>1)+((4+5)>3)",  { fm_op(2), 0, fm_op(4) | fm_op(5), 0, fm_op(6), 0 }, fm_op(1) | fm_op(3),                       5 },
+		{ "DX7 19: (3>2>1)+6>(4+5)", { fm_op(2), fm_op(3), 0, fm_op(6), fm_op(6), 0 },     fm_op(1) | fm_op(4) | fm_op(5),            5 },
+		{ "DX7 22: (2>1)+6>(3+4+5)", { fm_op(2), 0, fm_op(6), fm_op(6), fm_op(6), 0 },     fm_op(1) | fm_op(3) | fm_op(4) | fm_op(5), 5 },
+		{ "DX7 31: 6>5, 1+2+3+4+5",  { 0, 0, 0, 0, fm_op(6), 0 },                          0x1F,                                      5 },
+		{ "DX7 32: all carriers",    { 0, 0, 0, 0, 0, 0 },                                 0x3F,                                      5 },
+	};
+	static constexpr s32 ALGORITHM_COUNT = sizeof(ALGORITHMS) / sizeof(ALGORITHMS[0]);
+
+public:
+	FrequencyModulator()
+	{
+		// E. Piano like default: two bell/tine pairs on algorithm 5
+		algorithm = 9;
+		const f64 ratios[OPERATORS] = { 1.0, 14.0, 1.0, 1.0, 1.0, 1.0 };
+		const f64 levels[OPERATORS] = { 0.5, 0.15, 0.5, 0.35, 0.3, 0.3 };
+		for (s32 i = 0; i < OPERATORS; i++)
+		{
+			operators[i].ratio = ratios[i];
+			operators[i].level = levels[i];
+		}
+		operators[1].envelope = { 0.001, 0.4, 0.0, 0.3, 1.0, Envelope::Decay::EXPONENTIAL };
+		operators[3].envelope = { 0.001, 1.5, 0.2, 0.4, 1.0, Envelope::Decay::EXPONENTIAL };
+		operators[5].detune   = 3.0;
+	}
+
+	// Render one control block of a voice into output, pitch ramps linearly from pitch_from to pitch_to.
+	// Envelopes are evaluated once at time (end of the block) and ramped, each operator runs as a
+	// straight loop over the block. Returns the highest carrier envelope level, zero once the voice is silent.
+	f64 Render(FmVoice& voice, f64* output, u32 samples, f64 frequency, f64 pitch_from, f64 pitch_to,
+		f64 velocity, f64 time, f64 time_on, f64 time_off, f64 sample_rate)
+	{
+		samples = std::min(samples, MAX_BLOCK);
+		const Algorithm& alg = ALGORITHMS[std::clamp(algorithm, 0, ALGORITHM_COUNT - 1)];
+		const SineTable& sine = SineTable::Instance();
+		const f64 feedback_cycles = std::clamp(feedback, 0.0, 1.0) * MAX_FEEDBACK;
+
+		// Operators that reach a carrier, the others are skipped. Modulators have higher indices than
+		// their targets, so walking upwards finds every target before its modulators: one pass covers a chain
+		u8 active = alg.carriers;
+		for (s32 op = 0; op < OPERATORS; op++)
+			for (s32 c = 0; c < OPERATORS; c++)
+				if ((active & (1 << c)) && (alg.modulators[c] & (1 << op)))
+					active |= u8(1 << op);
+
+		// Fixed point phase increment per sample at unit pitch
+		f64 pitch[MAX_BLOCK];
+		f64 pitch_step = (pitch_to - pitch_from) / samples;
+		for (u32 k = 0; k < samples; k++)
+			pitch[k] = pitch_from + (k + 1) * pitch_step;
+
+		f64 outputs[OPERATORS][MAX_BLOCK];
+		f64 modulation[MAX_BLOCK];
+		f64 carrier_level = 0.0;
+		s32 carrier_count = 0;
+		std::fill(output, output + samples, 0.0);
+
+		for (s32 op = OPERATORS - 1; op >= 0; op--)
+		{
+			if (!(active & (1 << op))) continue;
+			Operator& o = operators[op];
+			f64* out = outputs[op];
+
+			// Envelope and velocity at control rate, ramped over the block
+			f64 velocity_scale = 1.0 - std::clamp(o.velocity, 0.0, 1.0) * (1.0 - velocity);
+			f64 target = o.level * velocity_scale * o.envelope.GenerateAmplitude(time, time_on, time_off);
+			f64 level  = voice.level[op];
+			f64 step   = (target - level) / samples;
+			voice.level[op] = target;
+
+			// Sum of modulator outputs, in cycles of phase deviation
+			std::fill(modulation, modulation + samples, 0.0);
+			for (s32 m = 0; m < OPERATORS; m++)
+			{
+				if (!(alg.modulators[op] & (1 << m))) continue;
+				const f64* in = outputs[m];
+				for (u32 k = 0; k < samples; k++)
+					modulation[k] += in[k] * MAX_INDEX;
+			}
+
+			// At or above the sample rate the step reaches 2^32, so it wraps through s64 as in cycles_to_phase
+			f64 increment = frequency * o.ratio * std::exp2(o.detune / 1200.0) / sample_rate * 4294967296.0;
+			u32 phase = voice.phase[op];
+
+			if (op == alg.feedback && feedback_cycles > 0.0)
+			{
+				// Self feedback needs the previous sample, so this operator runs serially
+				f64 y1 = voice.feedback[0];
+				f64 y2 = voice.feedback[1];
+				for (u32 k = 0; k < samples; k++)
+				{
+					level += step;
+					f64 fb = 0.5 * (y1 + y2) * feedback_cycles;
+					f64 y  = level * sine.Lookup(phase + cycles_to_phase(modulation[k] + fb));
+					phase += static_cast<u32>(static_cast<s64>(increment * pitch[k]));
+					y2 = y1;
+					y1 = y;
+					out[k] = y;
+				}
+				voice.feedback[0] = y1;
+				voice.feedback[1] = y2;
+			}
+			else
+			{
+				for (u32 k = 0; k < samples; k++)
+				{
+					level += step;
+					out[k] = level * sine.Lookup(phase + cycles_to_phase(modulation[k]));
+					phase += static_cast<u32>(static_cast<s64>(increment * pitch[k]));
+				}
+			}
+			voice.phase[op] = phase;
+
+			if (alg.carriers & (1 << op))
+			{
+				for (u32 k = 0; k < samples; k++)
+					output[k] += out[k];
+				carrier_level = std::max(carrier_level, target);
+				carrier_count++;
+			}
+		}
+
+		// Normalize the carriers like the oscillator mix
+		if (carrier_count > 1)
+		{
+			f64 scale = 1.0 / carrier_count;
+			for (u32 k = 0; k < samples; k++)
+				output[k] *= scale;
+		}
+
+		return carrier_level;
 	}
+
+public:
+	Operator operators[OPERATORS];
+	s32 algorithm  = 0;
+	f64 feedback   = 0.0; // [0, 1]
 };
\ No newline at end of file
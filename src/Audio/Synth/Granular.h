@@ -0,0 +1,316 @@
+#pragma once
+
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+#include "../../Core/Published.h"
+#include "Note.h"
+
+// Granular synthesis: every voice schedules short Hann windowed grains read from a source buffer, a loaded
+// recording or a capture of the synth's own recent output. Grains come from one preallocated pool and
+// the window is a table, so a dense cloud costs no allocation and no trigonometry per grain.
+// Microsound (Roads): https://mitpress.mit.edu/9780262681544/microsound/
+// Granular synthesis: https://en.wikipedia.org/wiki/Granular_synthesis
+struct GrainSource
+{
+    std::string name;
+    u32 sample_rate = 44100;
+    std::vector<f32> samples;
+    s32 root = 60; // note that plays the source at its own pitch
+
+    void Assign(const std::vector<f64>& x)
+    {
+        samples.resize(x.size());
+        for (size_t i = 0; i < x.size(); i++)
+            samples[i] = static_cast<f32>(x[i]);
+    }
+
+    // Built in source: two seconds of a C4 sawtooth opening up, so the position control is audible
+    static GrainSource Sweep(u32 sample_rate)
+    {
+        GrainSource s;
+        s.name = "Sweep";
+        s.sample_rate = sample_rate;
+        s.samples.resize(2 * sample_rate);
+        const f64 f0 = 261.6255653005986;
+        for (u32 i = 0; i < s.samples.size(); i++)
+        {
+            f64 t = f64(i) / sample_rate;
+            f64 bright = 1.0 + 14.0 * t;
+            f64 sum = 0.0;
+            for (s32 n = 1; n <= 32 && n * f0 < 0.45 * sample_rate; n++)
+                sum += std::sin(2.0 * PI * n * f0 * t) / n * std::exp(-n / bright);
+            s.samples[i] = static_cast<f32>(0.5 * sum);
+        }
+        return s;
+    }
+};
+
+struct GrainVoice
+{
+    static constexpr u32 GRAINS = 128; // grains alive in one voice
+
+    f64 on = -1.0;         // note on time of the owner, a new time restarts the voice
+    u64 block = 0;         // last block rendered, 0 never
+    f64 until_next = 0.0;  // samples before the next grain
+    u32 count = 0;
+    u16 grains[GRAINS] = {};
+};
+
+struct Granular
+{
+    static constexpr u32 MAX_GRAINS = 1024;
+    static constexpr u32 MAX_VOICES = 128;    // one per MIDI note
+    static constexpr u32 MAX_BLOCK  = 64;
+    static constexpr u32 WINDOW     = 1024;   // Hann table steps over one grain
+    static constexpr u32 CAPTURE    = 1 << 19; // live history, about 12 s at 44.1 kHz
+    static constexpr f64 MAX_RATIO  = 4.0;    // grains read at most two octaves up
+
+    enum class Source
+    {
+        RECORDING,
+        LIVE,
+        COUNT
+    };
+    static constexpr const char* SOURCE_NAMES[] = { "Recording", "Live" };
+
+public:
+    Granular()
+    {
+        // Two guard entries so the interpolation at and past the last step reads the end of the window
+        window.resize(WINDOW + 2, 0.0);
+        for (u32 i = 0; i <= WINDOW; i++)
+            window[i] = 0.5 - 0.5 * std::cos(2.0 * PI * i / WINDOW);
+
+        capture.resize(CAPTURE, 0.0f);
+
+        for (u32 g = 0; g < MAX_GRAINS; g++)
+            free_grains[g] = static_cast<u16>(MAX_GRAINS - 1 - g);
+        free_count = MAX_GRAINS;
+
+        SetSource(GrainSource::Sweep(u32(SAMPLE_RATE)));
+    }
+
+    // Any thread but the audio thread: the new recording is picked up at the next block
+    void SetSource(GrainSource s)
+    {
+        s.samples.push_back(0.0f); // interpolation guard
+        source.Publish(std::make_shared<const GrainSource>(std::move(s)));
+    }
+
+    std::shared_ptr<const GrainSource> Recording() const { return source.Latest(); }
+
+    // Audio thread: the live source records the master output unless frozen
+    bool Capturing() const { return source_type == static_cast<s32>(Source::LIVE) && !freeze; }
+
+    void Capture(f64 sample)
+    {
+        capture[head & (CAPTURE - 1)] = static_cast<f32>(sample);
+        head++;
+    }
+
+    // Audio thread, once per block: grains of voices no longer played go back to the pool
+    void Update()
+    {
+        source.Acquire();
+        block++;
+        for (GrainVoice& v : voices)
+            if (v.count > 0 && v.block + 1 < block)
+                Release(v);
+        active = MAX_GRAINS - free_count;
+    }
+
+    // Render one control block of the voice of a note, pitch ramps linearly from pitch_from to pitch_to
+    void Render(s32 note_id, f64 note_on, f64* output, u32 samples, f64 frequency, f64 pitch_from, f64 pitch_to, f64 sample_rate)
+    {
+        samples = std::min(samples, MAX_BLOCK);
+        std::fill(output, output + samples, 0.0);
+
+        const bool live = source_type == static_cast<s32>(Source::LIVE);
+        const GrainSource* s = source.Current();
+        if (!live && (!s || s->samples.size() < 2)) return;
+
+        GrainVoice& v = voices[note_id & (MAX_VOICES - 1)];
+        if (v.on != note_on)
+        {
+            // A new note, or the key pressed again: keep the grains sounding through a retrigger
+            bool continuing = v.block != 0 && v.block + 1 >= block;
+            if (!continuing)
+            {
+                Release(v);
+                v.until_next = 0.0;
+            }
+            v.on = note_on;
+        }
+        v.block = block;
+
+        // Grains overlap density * size times on average, their sum is kept near the level of one
+        const f64 length   = std::clamp(size, 0.005, 0.5) * sample_rate;
+        const f64 interval = sample_rate / std::clamp(density, 1.0, 2000.0);
+        const f64 gain     = 1.0 / std::sqrt(std::max(1.0, length / interval));
+        const s32 root     = live ? 60 : s->root;
+        const f64 rate     = live ? 1.0 : s->sample_rate / sample_rate;
+
+        // New grains at their exact sample in the block
+        f64 pitch_step = (pitch_to - pitch_from) / samples;
+        for (; v.until_next < samples; v.until_next += interval)
+        {
+            u32 offset = static_cast<u32>(std::max(0.0, v.until_next));
+            f64 ratio = frequency / note_freq(root) * std::exp2(pitch / 12.0) * (pitch_from + offset * pitch_step);
+            Spawn(v, live, s, offset, length, std::clamp(ratio, 0.0, MAX_RATIO) * rate, gain, sample_rate);
+        }
+        v.until_next -= samples;
+
+        // Each grain in two passes: read positions for the whole block, then gather and mix
+        for (u32 i = 0; i < v.count;)
+        {
+            Grain& g = pool[v.grains[i]];
+            bool done = live ? RenderGrain<true>(g, capture.data(), CAPTURE, output, samples)
+                             : RenderGrain<false>(g, s->samples.data(), s->samples.size(), output, samples);
+            if (done)
+            {
+                free_grains[free_count++] = v.grains[i];
+                v.grains[i] = v.grains[--v.count];
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+private:
+    struct Grain
+    {
+        f64 position  = 0.0; // source frame
+        f64 increment = 1.0; // source frames per output sample
+        f64 phase     = 0.0; // window position in table steps, the grain ends at WINDOW
+        f64 step      = 0.0; // table steps per output sample
+        f64 gain      = 0.0;
+        u32 delay     = 0;   // samples into the block before the grain starts
+    };
+
+    void Release(GrainVoice& v)
+    {
+        for (u32 i = 0; i < v.count; i++)
+            free_grains[free_count++] = v.grains[i];
+        v.count = 0;
+    }
+
+    // Cheap generator for spray, the audio thread only
+    f64 Random()
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed * (1.0 / 4294967296.0);
+    }
+
+    void Spawn(GrainVoice& v, bool live, const GrainSource* s, u32 offset, f64 length, f64 increment, f64 gain, f64 sample_rate)
+    {
+        // Pool or voice full: the grain is dropped, never allocated
+        if (free_count == 0 || v.count == GrainVoice::GRAINS || increment <= 0.0) return;
+
+        Grain& g = pool[free_grains[--free_count]];
+        v.grains[v.count++] = static_cast<u16>(&g - pool);
+
+        f64 span = length * increment;
+        f64 jitter = spray * sample_rate;
+        if (live)
+        {
+            // Back from the write head far enough that the grain never reads past it
+            f64 history = CAPTURE - span - 2.0;
+            f64 back = span + std::clamp(position, 0.0, 1.0) * 0.5 * history + Random() * jitter;
+            // Kept positive, the ring index wraps the same
+            g.position = static_cast<f64>(head + offset) - std::min(back, history);
+            if (g.position < 0.0) g.position += CAPTURE;
+        }
+        else
+        {
+            f64 frames = static_cast<f64>(s->samples.size() - 1);
+            g.position = std::clamp(position * frames + (2.0 * Random() - 1.0) * jitter * s->sample_rate / sample_rate, 0.0, frames);
+        }
+        g.increment = increment;
+        g.phase     = 0.0;
+        g.step      = WINDOW / length;
+        g.gain      = gain;
+        g.delay     = offset;
+    }
+
+    // One grain over a block, true when it has ended. RING reads the capture history modulo its size,
+    // otherwise frames past the recording read silence.
+    template <bool RING>
+    bool RenderGrain(Grain& g, const f32* data, size_t frames, f64* output, u32 samples)
+    {
+        const u32 start = std::min(g.delay, samples);
+        g.delay = 0;
+        const u32 count = std::min<u32>(samples - start, static_cast<u32>(std::ceil((WINDOW - g.phase) / g.step)));
+
+        // Pass one, plain arithmetic over aligned arrays that vectorizes
+        alignas(64) f64 read[MAX_BLOCK];
+        alignas(64) f64 win[MAX_BLOCK];
+        for (u32 k = 0; k < count; k++)
+        {
+            read[k] = g.position + k * g.increment;
+            win[k]  = std::min(g.phase + k * g.step, f64(WINDOW));
+        }
+
+        // Past the end of a recording the grain reads silence: stop the lookups there
+        u32 valid = count;
+        if constexpr (!RING)
+        {
+            f64 left = (static_cast<f64>(frames - 1) - g.position) / g.increment;
+            valid = left <= 0.0 ? 0 : static_cast<u32>(std::min<f64>(count, std::ceil(left)));
+        }
+
+        // Pass two, table and source lookups without branches
+        const f64* w = window.data();
+        const size_t mask = frames - 1;
+        f64* out = output + start;
+        for (u32 k = 0; k < valid; k++)
+        {
+            size_t i = static_cast<size_t>(read[k]);
+            f64 f = read[k] - static_cast<f64>(i);
+            f64 a, b;
+            if constexpr (RING) { a = data[i & mask]; b = data[(i + 1) & mask]; }
+            else                { a = data[i];        b = data[i + 1]; }
+
+            u32 j = static_cast<u32>(win[k]);
+            f64 wf = win[k] - j;
+            out[k] += g.gain * (w[j] + wf * (w[j + 1] - w[j])) * (a + f * (b - a));
+        }
+
+        g.position += count * g.increment;
+        g.phase    += count * g.step;
+        return g.phase >= WINDOW;
+    }
+
+public:
+    // Controls, read once per voice block
+    f64 position = 0.3;   // recording: 0 start to 1 end, live: 0 now to 1 about six seconds ago
+    f64 spray    = 0.02;  // random position offset, seconds
+    f64 pitch    = 0.0;   // semitones over the key
+    f64 density  = 80.0;  // grains per second per voice
+    f64 size     = 0.08;  // grain length, seconds
+    s32 source_type = static_cast<s32>(Source::RECORDING);
+    bool freeze  = false; // live: stop recording, the grains keep reading the last history
+    std::atomic<u32> active = 0; // grains sounding, for display
+
+private:
+    Published<GrainSource> source;
+    std::vector<f64> window;
+    std::vector<f32> capture;
+    u64 head  = 0;
+    u64 block = 0;
+    u32 seed  = 0x9E3779B9u;
+
+    Grain pool[MAX_GRAINS];
+    u16 free_grains[MAX_GRAINS] = {};
+    u32 free_count = 0;
+    GrainVoice voices[MAX_VOICES];
+};
\ No newline at end of file
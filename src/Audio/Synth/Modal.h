@@ -0,0 +1,543 @@
+#pragma once
+
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <complex>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+#include "../../Core/Published.h"
+#include "FFT.h"
+#include "Filter.h"
+
+// Modal synthesis: a struck object rings as a sum of exponentially decaying modes, each one a two pole
+// resonator excited by a mallet pulse. A voice keeps its resonators as lanes of a structure of arrays,
+// updated two per SIMD register, and culls the modes that have rung out, so a bell gets cheaper as it decays.
+// Modal representation: https://ccrma.stanford.edu/~jos/pasp/Modal_Representation.html
+// Modes of a free bar: https://en.wikipedia.org/wiki/Euler%E2%80%93Bernoulli_beam_theory
+// Modes of a plate: https://en.wikipedia.org/wiki/Vibration_of_plates
+struct ModalModes
+{
+    enum class Preset : u8
+    {
+        BELL,
+        BAR,
+        PLATE,
+        COUNT
+    };
+    static constexpr const char* PRESET_NAMES[] = { "Bell", "Bar", "Plate" };
+
+    std::string name;
+    std::vector<f64> ratio; // frequency over the note frequency
+    std::vector<f64> gain;  // amplitude rung by a unit strike
+    std::vector<f64> decay; // seconds to -60 dB
+    u32 serial = 0;         // set when published, voices still ringing keep their lanes while it matches
+
+    u32 Count() const { return static_cast<u32>(ratio.size()); }
+
+    void Add(f64 mode_ratio, f64 mode_gain, f64 mode_decay)
+    {
+        ratio.push_back(mode_ratio);
+        gain.push_back(mode_gain);
+        decay.push_back(mode_decay);
+    }
+
+    // Same loudness whatever the number of modes
+    void Finish()
+    {
+        constexpr f64 LEVEL = 0.5;
+        f64 power = 0.0;
+        for (f64 g : gain) power += g * g;
+        if (power > 0.0)
+            for (f64& g : gain) g *= LEVEL / std::sqrt(power);
+    }
+
+    static ModalModes Make(Preset preset, u32 count)
+    {
+        ModalModes m;
+        m.name = PRESET_NAMES[static_cast<s32>(preset)];
+        switch (preset)
+        {
+        case Preset::BAR:
+        {
+            // Free-free bar: the first roots of cos(b) cosh(b) = 1, then (2n + 1) pi / 2. Few modes fit below
+            // Nyquist, the rest are skipped when a note starts
+            const f64 roots[] = { 4.7300408, 7.8532046, 10.9956078, 14.1371655 };
+            for (u32 n = 0; n < count; n++)
+            {
+                f64 root = n < 4 ? roots[n] : (2.0 * n + 3.0) * PI / 2.0;
+                f64 r = (root / roots[0]) * (root / roots[0]);
+                m.Add(r, 1.0 / (n + 1.0), 2.5 / std::pow(r, 0.6));
+            }
+        } break;
+
+        case Preset::PLATE:
+        {
+            // Simply supported rectangular plate: modes (i, j) at i^2 + (j / aspect)^2, a dense inharmonic spread
+            constexpr f64 ASPECT = 1.37;
+            constexpr u32 SIDE = 48;
+            std::vector<f64> modes;
+            for (u32 i = 1; i <= SIDE; i++)
+                for (u32 j = 1; j <= SIDE; j++)
+                    modes.push_back((i * i + j * j / (ASPECT * ASPECT)) / (1.0 + 1.0 / (ASPECT * ASPECT)));
+            std::sort(modes.begin(), modes.end());
+            u32 seed = 0x2545F491u;
+            for (u32 n = 0; n < count && n < modes.size(); n++)
+            {
+                // Uneven levels, as from a point off the symmetry lines
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                f64 level = 0.3 + 0.7 * (seed * (1.0 / 4294967296.0));
+                m.Add(modes[n], level / std::sqrt(modes[n]), 4.0 / std::sqrt(modes[n]));
+            }
+        } break;
+
+        case Preset::BELL:
+        default:
+        {
+            // Church bell partials (hum, prime, tierce, quint, nominal...), higher ones decay faster
+            // Bell partials: https://www.hibberts.co.uk/what-makes-a-bell-sound-like-a-bell/
+            const f64 modes[] = { 0.5, 1.0, 1.183, 1.506, 2.0, 2.514, 2.662, 3.011, 4.166, 5.433, 6.796, 8.215 };
+            const u32 mode_count = sizeof(modes) / sizeof(modes[0]);
+            for (u32 n = 0; n < count; n++)
+            {
+                f64 r = n < mode_count ? modes[n] : modes[mode_count - 1] * (1.0 + 0.31 * (n - mode_count + 1));
+                m.Add(r, 1.0 / (1.0 + 0.3 * n), 8.0 / std::pow(r, 0.8));
+            }
+        } break;
+        }
+        m.Finish();
+        return m;
+    }
+
+    // Modes of a recorded strike: the strongest spectral peaks just after the attack, each one's decay from its
+    // drop between two frames. Ratios are relative to the strongest mode, which plays at the pitch of the key.
+    // Peak interpolation: https://ccrma.stanford.edu/~jos/sasp/Quadratic_Interpolation_Spectral_Peaks.html
+    static bool Analyze(const std::vector<f64>& samples, f64 sample_rate, u32 count, ModalModes& out, std::string& error)
+    {
+        constexpr u32 N = 8192;
+        constexpr f64 MAX_SECONDS = 10.0;
+        constexpr f64 MAX_DECAY   = 30.0;
+
+        if (samples.size() < 2 * N)
+        {
+            error = "recording shorter than " + std::to_string(2 * N) + " samples";
+            return false;
+        }
+        const size_t length = std::min(samples.size(), size_t(MAX_SECONDS * sample_rate));
+
+        // The first frame starts just after the loudest sample, the second one a frame later
+        size_t attack = 0;
+        for (size_t i = 0; i < length; i++)
+            if (std::abs(samples[i]) > std::abs(samples[attack])) attack = i;
+        size_t first  = std::min(attack + size_t(0.005 * sample_rate), length - 2 * N);
+        size_t second = first + N;
+
+        FFT fft;
+        fft.Init(N);
+        std::vector<f64> window(N);
+        for (u32 i = 0; i < N; i++) window[i] = 0.5 - 0.5 * std::cos(2.0 * PI * i / N);
+
+        std::vector<std::complex<f64>> spectrum(N);
+        auto magnitudes = [&](size_t start, std::vector<f64>& magnitude) {
+            for (u32 i = 0; i < N; i++) spectrum[i] = samples[start + i] * window[i];
+            fft.Forward(spectrum.data());
+            magnitude.resize(N / 2 + 1);
+            for (u32 i = 0; i <= N / 2; i++) magnitude[i] = std::abs(spectrum[i]) + 1e-12;
+        };
+        std::vector<f64> early, late;
+        magnitudes(first, early);
+        magnitudes(second, late);
+
+        // Parabola through the log magnitudes around a peak: bin offset and level
+        auto interpolate = [](const std::vector<f64>& magnitude, u32 peak, f64& offset) {
+            f64 a = std::log(magnitude[peak - 1]), b = std::log(magnitude[peak]), c = std::log(magnitude[peak + 1]);
+            f64 curve = a - 2.0 * b + c;
+            offset = curve < 0.0 ? 0.5 * (a - c) / curve : 0.0;
+            return std::exp(b - 0.25 * (a - c) * offset);
+        };
+
+        // Local maxima within 80 dB of the loudest, above 20 Hz
+        const f64 bin_hz = sample_rate / N;
+        f64 loudest = *std::max_element(early.begin(), early.end());
+        std::vector<u32> peaks;
+        for (u32 i = std::max(2u, u32(20.0 / bin_hz)); i < N / 2 - 1; i++)
+            if (early[i] > early[i - 1] && early[i] >= early[i + 1] && early[i] > loudest * 1e-4)
+                peaks.push_back(i);
+        if (peaks.empty())
+        {
+            error = "no modes found";
+            return false;
+        }
+        std::sort(peaks.begin(), peaks.end(), [&](u32 a, u32 b) { return early[a] > early[b]; });
+        peaks.resize(std::min<size_t>(peaks.size(), count));
+
+        f64 offset = 0.0;
+        interpolate(early, peaks[0], offset);
+        const f64 reference = (peaks[0] + offset) * bin_hz;
+
+        out = ModalModes();
+        const f64 frame_time = f64(N) / sample_rate;
+        const f64 since_attack = (f64(first) + N / 2 - f64(attack)) / sample_rate;
+        for (u32 peak : peaks)
+        {
+            f64 level = interpolate(early, peak, offset);
+            f64 frequency = (peak + offset) * bin_hz;
+
+            // The same peak a frame later, the strongest bin next to it where the mode has drifted
+            u32 next = peak;
+            for (u32 i = peak - 1; i <= peak + 1; i++)
+                if (late[i] > late[next]) next = i;
+            f64 late_offset = 0.0;
+            f64 drop = 20.0 * std::log10(level / interpolate(late, next, late_offset));
+            f64 decay = drop > 0.0 ? std::min(60.0 * frame_time / drop, MAX_DECAY) : MAX_DECAY;
+
+            // Hann sum is N/2, a cosine of amplitude A peaks at A/2 * N/2. Back to the strike along the decay
+            f64 amplitude = 4.0 * level / N * std::pow(10.0, 3.0 * since_attack / decay);
+            out.Add(frequency / reference, amplitude, decay);
+        }
+
+        out.Finish();
+        return true;
+    }
+};
+
+// Resonator lanes of one voice. Hot arrays are read every sample, cold ones when a lane is tuned or culled.
+// Lanes past the live count up to a whole number of SIMD passes are silent padding.
+struct alignas(64) ModalVoice
+{
+    static constexpr u32 MAX_MODES = 256; // multiple of the lanes per pass
+
+    f64 on = -1.0;      // note on time of the owner, a new time strikes again
+    u64 block = 0;      // last block rendered, 0 never
+    u32 serial = 0;     // modes the lanes were set up from
+    u32 count = 0;      // live lanes, culled modes are gone
+    u32 padded = 0;
+    bool released = false;
+    f64 pitch = 1.0;    // pitch the lanes are tuned to
+    f64 strike = 0.0;   // samples into the mallet pulse
+    f64 width = 0.0;    // mallet contact time, samples
+    f64 force = 0.0;
+    f64 x1 = 0.0, x2 = 0.0; // mallet history, the one input of every lane
+
+    alignas(64) f64 b0[MAX_MODES];
+    alignas(64) f64 a1[MAX_MODES];
+    alignas(64) f64 a2[MAX_MODES];
+    alignas(64) f64 y1[MAX_MODES];
+    alignas(64) f64 y2[MAX_MODES];
+
+    f64 frequency[MAX_MODES]; // at unit pitch
+    f64 decay[MAX_MODES];     // seconds to -60 dB while held
+    f64 norm[MAX_MODES];      // 1 / (1 + alpha) of the damping
+    u16 mode[MAX_MODES];
+};
+
+struct Modal
+{
+    static constexpr u32 MAX_VOICES = 128; // one per MIDI note
+    static constexpr u32 MAX_BLOCK  = 64;
+    static constexpr u32 MIN_MODES  = 32;
+    static constexpr u32 LANES      = 4;   // two registers of two lanes per pass, independent recurrences
+
+public:
+    Modal()
+    {
+        voices.resize(MAX_VOICES);
+        SetModes(ModalModes::Make(ModalModes::Preset::BELL, 64));
+    }
+
+    // Any thread but the audio thread: the new modes are picked up at the next block
+    void SetModes(ModalModes m)
+    {
+        m.ratio.resize(std::min(m.Count(), ModalVoice::MAX_MODES));
+        m.gain.resize(m.ratio.size());
+        m.decay.resize(m.ratio.size());
+        m.serial = ++serial;
+        modes.Publish(std::make_shared<const ModalModes>(std::move(m)));
+    }
+
+    std::shared_ptr<const ModalModes> Modes() const { return modes.Latest(); }
+
+    // Audio thread, once per block
+    void Update()
+    {
+        modes.Acquire();
+        block++;
+        active = counted;
+        counted = 0;
+    }
+
+    // Render one control block of the voice of a note. The strike and the decay of the modes are the envelope,
+    // a released voice is damped to the release time. Returns the voice level.
+    f64 Render(s32 note_id, f64 note_on, bool released, f64 velocity, f64* output, u32 samples, f64 frequency, f64 pitch, f64 sample_rate)
+    {
+        samples = std::min(samples, MAX_BLOCK);
+        std::fill(output, output + samples, 0.0);
+        const ModalModes* m = modes.Current();
+        if (!m) return 0.0;
+
+        ModalVoice& v = voices[note_id & (MAX_VOICES - 1)];
+        if (v.on != note_on)
+        {
+            v.on = note_on;
+            Strike(v, *m, frequency, pitch, velocity, sample_rate);
+        }
+        v.block = block;
+
+        if (released && !v.released)
+        {
+            v.released = true;
+            Damp(v, sample_rate);
+            Tune(v, pitch, sample_rate);
+        }
+        else if (pitch != v.pitch)
+        {
+            Tune(v, pitch, sample_rate);
+        }
+
+        // Mallet force as the band pass input difference x[n] - x[n-2]
+        alignas(64) f64 drive[MAX_BLOCK];
+        const bool driven = Drive(v, drive, samples);
+        if (driven) Resonate<true>(v, drive, output, samples);
+        else        Resonate<false>(v, nullptr, output, samples); // ringing on, no input
+
+        f64 peak = 0.0;
+        for (u32 k = 0; k < samples; k++) peak = std::max(peak, std::abs(output[k]));
+
+        if (!driven) Cull(v);
+        counted += v.count;
+        return peak;
+    }
+
+private:
+    // New strike: modes already ringing keep their lanes and are struck again, the others get a new lane
+    void Strike(ModalVoice& v, const ModalModes& m, f64 frequency, f64 pitch, f64 velocity, f64 sample_rate)
+    {
+        bool continuing = v.block != 0 && v.block + 1 >= block && v.serial == m.serial;
+        bool ringing[ModalVoice::MAX_MODES] = {};
+        if (continuing)
+        {
+            for (u32 l = 0; l < v.count; l++) ringing[v.mode[l]] = true;
+        }
+        else
+        {
+            v.count = 0;
+            v.x1 = v.x2 = 0.0;
+        }
+        v.serial = m.serial;
+
+        for (u32 i = 0; i < m.Count(); i++)
+        {
+            // Modes above Nyquist at the start of the note are never heard
+            f64 f = m.ratio[i] * frequency;
+            if (ringing[i] || f < 1.0 || f * pitch >= 0.49 * sample_rate) continue;
+            u32 l = v.count++;
+            v.mode[l] = static_cast<u16>(i);
+            v.frequency[l] = f;
+            v.b0[l] = 0.5 * m.gain[i]; // a band pass with a narrow peak rings at twice b0 after an impulse
+            v.y1[l] = v.y2[l] = 0.0;
+        }
+        for (u32 l = 0; l < v.count; l++)
+            v.decay[l] = std::max(m.decay[v.mode[l]] * decay, 0.001);
+
+        v.released = false;
+        Damp(v, sample_rate);
+        Tune(v, pitch, sample_rate);
+        Pad(v);
+
+        // Softer and slower strikes keep the mallet on longer, which dulls the upper modes
+        v.strike = 0.0;
+        v.width  = std::max(2.0, sample_rate * (0.0004 + 0.006 * (1.0 - std::clamp(hardness, 0.0, 1.0))) * (1.25 - 0.5 * velocity));
+        v.force  = velocity;
+    }
+
+    // Poles of every lane follow the band pass design of BqFilter, a1 = -2 cos(w) / (1 + alpha) and
+    // a2 = (1 - alpha) / (1 + alpha), radius sqrt(a2). Alpha follows from the decay time alone, with the bandwidth
+    // set to match, so the damping is set when a note is struck or released and a bend only moves the angle.
+    void Damp(ModalVoice& v, f64 sample_rate)
+    {
+        for (u32 l = 0; l < v.count; l++)
+        {
+            f64 t60 = v.released ? std::min(v.decay[l], release) : v.decay[l];
+            f64 radius2 = std::pow(10.0, -6.0 / (std::max(t60, 0.001) * sample_rate));
+            f64 alpha = (1.0 - radius2) / (1.0 + radius2);
+            v.norm[l] = 1.0 / (1.0 + alpha);
+            v.a2[l] = (1.0 - alpha) * v.norm[l];
+        }
+    }
+
+    // Pole angle of every lane at the pitch, one cos per lane
+    void Tune(ModalVoice& v, f64 pitch, f64 sample_rate)
+    {
+        v.pitch = pitch;
+        for (u32 l = 0; l < v.count; l++)
+        {
+            f64 f = std::min(v.frequency[l] * pitch, 0.49 * sample_rate);
+            v.a1[l] = -2.0 * std::cos(2.0 * PI * f / sample_rate) * v.norm[l];
+        }
+    }
+
+    // Silent lanes up to a whole pass
+    static void Pad(ModalVoice& v)
+    {
+        v.padded = (v.count + LANES - 1) / LANES * LANES;
+        for (u32 l = v.count; l < v.padded; l++)
+            v.b0[l] = v.a1[l] = v.a2[l] = v.y1[l] = v.y2[l] = 0.0;
+    }
+
+    // Half sine mallet pulse of unit area, false once it and the input history are over
+    static bool Drive(ModalVoice& v, f64* drive, u32 samples)
+    {
+        if (v.strike >= v.width + 2.0) return false;
+        for (u32 k = 0; k < samples; k++)
+        {
+            f64 x = v.strike < v.width ? v.force * std::sin(PI * v.strike / v.width) * PI / (2.0 * v.width) : 0.0;
+            drive[k] = x - v.x2;
+            v.x2 = v.x1;
+            v.x1 = x;
+            v.strike += 1.0;
+        }
+        return true;
+    }
+
+    // y = b0 (x[n] - x[n-2]) - a1 y1 - a2 y2 in every lane, summed into the output
+    template <bool DRIVEN>
+    static void Resonate(ModalVoice& v, const f64* drive, f64* output, u32 samples)
+    {
+        alignas(64) f64 sum[2 * MAX_BLOCK] = {};
+        u32 l = 0;
+#if defined(SYNTH_SSE2)
+        constexpr u32 R = LANES / 2;
+        for (; l < v.padded; l += LANES)
+        {
+            __m128d b0[R], a1[R], a2[R], y1[R], y2[R];
+            for (u32 r = 0; r < R; r++)
+            {
+                b0[r] = _mm_load_pd(v.b0 + l + 2 * r);
+                a1[r] = _mm_load_pd(v.a1 + l + 2 * r);
+                a2[r] = _mm_load_pd(v.a2 + l + 2 * r);
+                y1[r] = _mm_load_pd(v.y1 + l + 2 * r);
+                y2[r] = _mm_load_pd(v.y2 + l + 2 * r);
+            }
+            for (u32 k = 0; k < samples; k++)
+            {
+                // The y2 term first: only the y1 term waits on the last sample
+                __m128d x = _mm_set1_pd(DRIVEN ? drive[k] : 0.0);
+                __m128d total = _mm_load_pd(sum + 2 * k);
+                for (u32 r = 0; r < R; r++)
+                {
+                    __m128d y = DRIVEN ? _mm_sub_pd(_mm_mul_pd(b0[r], x), _mm_mul_pd(a2[r], y2[r]))
+                                       : _mm_sub_pd(_mm_setzero_pd(), _mm_mul_pd(a2[r], y2[r]));
+                    y = _mm_sub_pd(y, _mm_mul_pd(a1[r], y1[r]));
+                    y2[r] = y1[r];
+                    y1[r] = y;
+                    total = _mm_add_pd(total, y);
+                }
+                _mm_store_pd(sum + 2 * k, total);
+            }
+            for (u32 r = 0; r < R; r++)
+            {
+                _mm_store_pd(v.y1 + l + 2 * r, y1[r]);
+                _mm_store_pd(v.y2 + l + 2 * r, y2[r]);
+            }
+        }
+#elif defined(SYNTH_NEON)
+        constexpr u32 R = LANES / 2;
+        for (; l < v.padded; l += LANES)
+        {
+            float64x2_t b0[R], a1[R], a2[R], y1[R], y2[R];
+            for (u32 r = 0; r < R; r++)
+            {
+                b0[r] = vld1q_f64(v.b0 + l + 2 * r);
+                a1[r] = vld1q_f64(v.a1 + l + 2 * r);
+                a2[r] = vld1q_f64(v.a2 + l + 2 * r);
+                y1[r] = vld1q_f64(v.y1 + l + 2 * r);
+                y2[r] = vld1q_f64(v.y2 + l + 2 * r);
+            }
+            for (u32 k = 0; k < samples; k++)
+            {
+                float64x2_t total = vld1q_f64(sum + 2 * k);
+                for (u32 r = 0; r < R; r++)
+                {
+                    float64x2_t y = DRIVEN ? vmulq_n_f64(b0[r], drive[k]) : vdupq_n_f64(0.0);
+                    y = vfmsq_f64(vfmsq_f64(y, a2[r], y2[r]), a1[r], y1[r]);
+                    y2[r] = y1[r];
+                    y1[r] = y;
+                    total = vaddq_f64(total, y);
+                }
+                vst1q_f64(sum + 2 * k, total);
+            }
+            for (u32 r = 0; r < R; r++)
+            {
+                vst1q_f64(v.y1 + l + 2 * r, y1[r]);
+                vst1q_f64(v.y2 + l + 2 * r, y2[r]);
+            }
+        }
+#endif
+        for (; l < v.padded; l++)
+        {
+            f64 y1 = v.y1[l], y2 = v.y2[l];
+            for (u32 k = 0; k < samples; k++)
+            {
+                f64 y = (DRIVEN ? v.b0[l] * drive[k] : 0.0) - v.a2[l] * y2 - v.a1[l] * y1;
+                y2 = y1;
+                y1 = y;
+                sum[2 * k + (l & 1)] += y;
+            }
+            v.y1[l] = y1;
+            v.y2[l] = y2;
+        }
+
+        for (u32 k = 0; k < samples; k++)
+            output[k] = sum[2 * k] + sum[2 * k + 1];
+    }
+
+    // Lanes whose mode has decayed below the threshold are dropped, the last lane takes the place of each.
+    // A two pole resonator at angle w holds amplitude^2 = (y1^2 + y2^2 - 2 cos(w) y1 y2) / sin(w)^2
+    void Cull(ModalVoice& v)
+    {
+        const f64 floor = dB_to_volume(threshold);
+        const f64 floor2 = floor * floor;
+        for (u32 l = 0; l < v.count;)
+        {
+            f64 c = -v.a1[l] / (2.0 * std::sqrt(v.a2[l]));
+            f64 energy = v.y1[l] * v.y1[l] + v.y2[l] * v.y2[l] - 2.0 * c * v.y1[l] * v.y2[l];
+            if (energy >= floor2 * (1.0 - c * c))
+            {
+                l++;
+                continue;
+            }
+
+            u32 last = --v.count;
+            v.b0[l] = v.b0[last];
+            v.a1[l] = v.a1[last];
+            v.a2[l] = v.a2[last];
+            v.y1[l] = v.y1[last];
+            v.y2[l] = v.y2[last];
+            v.frequency[l] = v.frequency[last];
+            v.decay[l] = v.decay[last];
+            v.norm[l] = v.norm[last];
+            v.mode[l] = v.mode[last];
+        }
+        Pad(v);
+    }
+
+public:
+    // Controls, read when a note is struck, released or bent
+    f64 decay     = 1.0;   // scale of the decay times of the modes
+    f64 release   = 0.3;   // seconds to -60 dB once released
+    f64 hardness  = 0.6;   // mallet, 1 is a short bright strike
+    f64 threshold = -90.0; // dB, modes below it are culled
+    std::atomic<u32> active = 0; // resonators ringing, for display
+
+private:
+    Published<ModalModes> modes;
+    std::vector<ModalVoice> voices;
+    std::atomic<u32> serial = 0;
+    u64 block = 0;
+    u32 counted = 0;
+};
\ No newline at end of file
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+
+// Control-rate modulation
+// Slow modulators (envelopes, LFOs) are evaluated once per sub-block of CONTROL_RATE samples
+// and ramped linearly to audio rate, instead of being recomputed for every voice on every sample.
+// Control rate: https://www.earlevel.com/main/2013/06/23/envelope-generators-adsr-widget/
+static constexpr u32 CONTROL_RATE = 32;
+
+// Linear ramp from the previous control value to the next one, one step per audio sample
+struct ControlRamp
+{
+    f64 value = 0.0;
+    f64 step  = 0.0;
+
+    void Target(f64 target, u32 samples)
+    {
+        step = (target - value) / samples;
+    }
+
+    f64 Next()
+    {
+        value += step;
+        return value;
+    }
+
+    // Jump to the end of a ramp of samples steps, returns the sum of the values Next would have returned
+    f64 Skip(u32 samples)
+    {
+        f64 sum = samples * value + 0.5 * samples * (samples + 1.0) * step;
+        value += step * samples;
+        return sum;
+    }
+};
+
+// Control-rate settings of the LFO, the waveform itself comes from the LFO oscillator
+struct LfoControl
+{
+    bool key_sync      = false; // per-voice phase restarting at note on, otherwise one free running phase
+    bool tempo_sync    = false; // rate locked to tempo: one cycle every sync_beats beats
+    s32  bpm           = 120;
+    f64  sync_beats    = 1.0;
+    f64  vibrato_depth = 0.0;   // frequency modulation depth in semitones
+    f64  phase         = 0.0;   // free running phase in cycles
+
+    f64 Rate(f64 frequency) const
+    {
+        return tempo_sync ? (bpm / 60.0) / sync_beats : frequency;
+    }
+
+    // Advance a phase in cycles by dt seconds
+    static f64 Advance(f64 phase, f64 rate, f64 dt)
+    {
+        phase += rate * dt;
+        return phase - std::floor(phase);
+    }
+};
+
+// Modulation matrix: routes any source to any destination with a depth and a response curve.
+// The editable route table is compiled into flat lists of active connections, split by what the
+// destination belongs to (a voice, or the shared filter and effects), so unused routes cost nothing.
+// Modulation matrix: https://en.wikipedia.org/wiki/Modular_synthesizer#Modulation
+struct ModMatrix
+{
+    enum class Source : u8
+    {
+        NONE,
+        LFO,             // bipolar [-1, 1]
+        AMP_ENVELOPE,    // [0, 1]
+        FILTER_ENVELOPE, // [0, 1]
+        VELOCITY,        // [0, 1]
+        NOTE,            // note number / 127
+        CC,              // MIDI control change value / 127
+        COUNT
+    };
+
+    enum class Destination : u8
+    {
+        NONE,
+        PITCH,           // voice, semitones
+        VOLUME,          // voice, gain offset
+        PAN,             // voice, pan offset
+        CUTOFF,          // filter, octaves
+        RESONANCE,       // filter, fraction of the resonance range
+        DELAY_FEEDBACK,  // effect, feedback offset
+        REVERB_WET,      // effect, dB
+        COUNT
+    };
+
+    enum class Curve : u8
+    {
+        LINEAR,
+        EXPONENTIAL,
+        LOGARITHMIC,
+        S_CURVE,
+        COUNT
+    };
+
+    static constexpr const char* SOURCE_NAMES[]      = { "None", "LFO", "Amp Envelope", "Filter Envelope", "Velocity", "Note", "CC" };
+    static constexpr const char* DESTINATION_NAMES[] = { "None", "Pitch", "Volume", "Pan", "Cutoff", "Resonance", "Delay Feedback", "Reverb Wet" };
+    static constexpr const char* CURVE_NAMES[]       = { "Linear", "Exponential", "Logarithmic", "S-Curve" };
+
+    // Destination units for a depth of 1.0
+    static constexpr f64 DESTINATION_RANGE[] = { 0.0, 24.0, 1.0, 1.0, 6.0, 1.0, 1.0, 60.0 };
+
+    static constexpr s32 SOURCE_COUNT      = static_cast<s32>(Source::COUNT);
+    static constexpr s32 DESTINATION_COUNT = static_cast<s32>(Destination::COUNT);
+    static constexpr s32 MAX_ROUTES        = 8;
+
+    struct Route
+    {
+        Source source           = Source::NONE;
+        Destination destination = Destination::NONE;
+        Curve curve             = Curve::LINEAR;
+        f64 depth               = 0.0; // [-1, 1]
+        u8 cc                   = 1;   // controller number when the source is CC
+    };
+
+    struct Connection
+    {
+        Source source;
+        Destination destination;
+        Curve curve;
+        u8 cc;
+        f64 amount; // depth scaled to destination units
+    };
+
+public:
+    ModMatrix()
+    {
+        voice_connections.reserve(MAX_ROUTES);
+        global_connections.reserve(MAX_ROUTES);
+    }
+
+    // Edit routes from one thread (the GUI), then call Changed to publish a copy for the audio thread
+    void Changed()
+    {
+        std::lock_guard<std::mutex> lock(publish_mutex);
+        std::copy(std::begin(routes), std::end(routes), published);
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    void ControlChange(u8 controller, f64 value) { cc[controller & 0x7F] = std::clamp(value, 0.0, 1.0); }
+
+    // Audio thread: rebuild the connection lists after an edit. The published copy is read under
+    // try_lock, so a publish in progress only defers the rebuild to the next block.
+    void Update()
+    {
+        if (version.load(std::memory_order_acquire) == compiled_version) return;
+
+        Route snapshot[MAX_ROUTES];
+        {
+            std::unique_lock<std::mutex> lock(publish_mutex, std::try_to_lock);
+            if (!lock.owns_lock()) return;
+            compiled_version = version.load(std::memory_order_relaxed);
+            std::copy(std::begin(published), std::end(published), snapshot);
+        }
+
+        voice_connections.clear();
+        global_connections.clear();
+        std::fill(std::begin(uses), std::end(uses), false);
+        std::fill(std::begin(targets), std::end(targets), false);
+
+        for (const Route& r : snapshot)
+        {
+            if (r.source == Source::NONE || r.destination == Destination::NONE || r.depth == 0.0)
+                continue;
+
+            Connection c = { r.source, r.destination, r.curve, r.cc, r.depth * DESTINATION_RANGE[static_cast<s32>(r.destination)] };
+            if (IsVoiceDestination(r.destination)) voice_connections.push_back(c);
+            else                                   global_connections.push_back(c);
+
+            uses[static_cast<s32>(r.source)] = true;
+            targets[static_cast<s32>(r.destination)] = true;
+        }
+    }
+
+    // Accumulate the connections into outputs (DESTINATION_COUNT entries), sources holds SOURCE_COUNT entries
+    void Evaluate(const std::vector<Connection>& connections, const f64* sources, f64* outputs) const
+    {
+        for (const Connection& c : connections)
+        {
+            f64 value = (c.source == Source::CC) ? cc[c.cc] : sources[static_cast<s32>(c.source)];
+            outputs[static_cast<s32>(c.destination)] += c.amount * ApplyCurve(value, c.curve);
+        }
+    }
+
+    bool Uses(Source s) const         { return uses[static_cast<s32>(s)]; }
+    bool Targets(Destination d) const { return targets[static_cast<s32>(d)]; }
+
+    static bool IsVoiceDestination(Destination d)
+    {
+        return d == Destination::PITCH || d == Destination::VOLUME || d == Destination::PAN;
+    }
+
+    // Shape the magnitude, keep the sign of bipolar sources
+    static f64 ApplyCurve(f64 x, Curve curve)
+    {
+        f64 m = std::abs(x);
+        f64 s = (x < 0.0) ? -1.0 : 1.0;
+        switch (curve)
+        {
+        case Curve::EXPONENTIAL: return s * m * m;
+        case Curve::LOGARITHMIC: return s * std::sqrt(m);
+        case Curve::S_CURVE:     return s * m * m * (3.0 - 2.0 * m);
+        case Curve::LINEAR:
+        default:                 return x;
+        }
+    }
+
+public:
+    Route routes[MAX_ROUTES];
+    f64 cc[128] = {};
+
+    // Compiled on the audio thread
+    std::vector<Connection> voice_connections;
+    std::vector<Connection> global_connections;
+    bool uses[SOURCE_COUNT] = {};
+    bool targets[DESTINATION_COUNT] = {};
+    bool filter_modulated = false;
+
+private:
+    // Written by Changed, read by Update
+    std::mutex publish_mutex;
+    Route published[MAX_ROUTES];
+    std::atomic<u32> version = 1;
+    u32 compiled_version = 0;
+};
\ No newline at end of file
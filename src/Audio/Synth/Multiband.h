@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "../../Core/Common.h"
+#include "Filter.h"
+#include "Modulation.h"
+
+// Multiband dynamics: the mix split into 3 or 4 bands by Linkwitz-Riley crossovers, each band compressed above
+// its threshold and expanded below its gate, then summed back. A 4th order Linkwitz-Riley split is two
+// Butterworth biquads per side, and its two sides sum to the 2nd order allpass at the crossover frequency, so
+// the lower bands run through the allpass of every crossover above them and the sum of all bands is flat.
+// Left and right share the two lanes of every filter, envelope follower and gain, one kernel for both channels.
+// The envelopes follow every sample, the gain computer runs once per CONTROL_RATE samples and its gain is
+// ramped in between. A mix quieter than -120 dB on every band puts the effect to sleep until it gets louder.
+// Linkwitz-Riley crossovers: https://www.linkwitzlab.com/filters.htm
+// Compressor design: https://www.eecs.qmul.ac.uk/~josh/documents/2012/GiannoulisMassbergReiss-dynamicrangecompression-JAES2012.pdf
+
+// Two lanes of doubles, left and right
+#if defined(SYNTH_SSE2)
+using Lanes = __m128d;
+inline Lanes lanes_set(f64 l, f64 r)              { return _mm_set_pd(r, l); }
+inline Lanes lanes_splat(f64 x)                   { return _mm_set1_pd(x); }
+inline Lanes lanes_add(Lanes a, Lanes b)          { return _mm_add_pd(a, b); }
+inline Lanes lanes_sub(Lanes a, Lanes b)          { return _mm_sub_pd(a, b); }
+inline Lanes lanes_mul(Lanes a, Lanes b)          { return _mm_mul_pd(a, b); }
+inline Lanes lanes_abs(Lanes a)                   { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+// a > b ? t : f, per lane
+inline Lanes lanes_select(Lanes a, Lanes b, Lanes t, Lanes f)
+{
+    Lanes mask = _mm_cmpgt_pd(a, b);
+    return _mm_or_pd(_mm_and_pd(mask, t), _mm_andnot_pd(mask, f));
+}
+inline void lanes_get(Lanes a, f64& l, f64& r)
+{
+    alignas(16) f64 v[2];
+    _mm_store_pd(v, a);
+    l = v[0];
+    r = v[1];
+}
+#elif defined(SYNTH_NEON)
+using Lanes = float64x2_t;
+inline Lanes lanes_set(f64 l, f64 r)              { return vsetq_lane_f64(r, vdupq_n_f64(l), 1); }
+inline Lanes lanes_splat(f64 x)                   { return vdupq_n_f64(x); }
+inline Lanes lanes_add(Lanes a, Lanes b)          { return vaddq_f64(a, b); }
+inline Lanes lanes_sub(Lanes a, Lanes b)          { return vsubq_f64(a, b); }
+inline Lanes lanes_mul(Lanes a, Lanes b)          { return vmulq_f64(a, b); }
+inline Lanes lanes_abs(Lanes a)                   { return vabsq_f64(a); }
+inline Lanes lanes_select(Lanes a, Lanes b, Lanes t, Lanes f) { return vbslq_f64(vcgtq_f64(a, b), t, f); }
+inline void  lanes_get(Lanes a, f64& l, f64& r)   { l = vgetq_lane_f64(a, 0); r = vgetq_lane_f64(a, 1); }
+#else
+struct Lanes { f64 l, r; };
+inline Lanes lanes_set(f64 l, f64 r)              { return { l, r }; }
+inline Lanes lanes_splat(f64 x)                   { return { x, x }; }
+inline Lanes lanes_add(Lanes a, Lanes b)          { return { a.l + b.l, a.r + b.r }; }
+inline Lanes lanes_sub(Lanes a, Lanes b)          { return { a.l - b.l, a.r - b.r }; }
+inline Lanes lanes_mul(Lanes a, Lanes b)          { return { a.l * b.l, a.r * b.r }; }
+inline Lanes lanes_abs(Lanes a)                   { return { std::abs(a.l), std::abs(a.r) }; }
+inline Lanes lanes_select(Lanes a, Lanes b, Lanes t, Lanes f) { return { a.l > b.l ? t.l : f.l, a.r > b.r ? t.r : f.r }; }
+inline void  lanes_get(Lanes a, f64& l, f64& r)   { l = a.l; r = a.r; }
+#endif
+
+// BqFilter coefficients on a stereo pair, transposed direct form II
+struct StereoBiquad
+{
+    Lanes b0 = lanes_splat(1.0), b1 = lanes_splat(0.0), b2 = lanes_splat(0.0);
+    Lanes a1 = lanes_splat(0.0), a2 = lanes_splat(0.0);
+    Lanes s1 = lanes_splat(0.0), s2 = lanes_splat(0.0);
+
+    void SetCoefs(const BqFilter& f)
+    {
+        b0 = lanes_splat(f.b0);
+        b1 = lanes_splat(f.b1);
+        b2 = lanes_splat(f.b2);
+        a1 = lanes_splat(f.a1);
+        a2 = lanes_splat(f.a2);
+    }
+
+    void Reset()
+    {
+        s1 = lanes_splat(0.0);
+        s2 = lanes_splat(0.0);
+    }
+
+    // A decaying state that would go denormal is zero from here on
+    void Flush()
+    {
+        const Lanes tiny = lanes_splat(1e-15), zero = lanes_splat(0.0);
+        s1 = lanes_select(lanes_abs(s1), tiny, s1, zero);
+        s2 = lanes_select(lanes_abs(s2), tiny, s2, zero);
+    }
+
+    Lanes Process(Lanes x)
+    {
+        Lanes y = lanes_add(lanes_mul(b0, x), s1);
+        s1 = lanes_add(lanes_sub(lanes_mul(b1, x), lanes_mul(a1, y)), s2);
+        s2 = lanes_sub(lanes_mul(b2, x), lanes_mul(a2, y));
+        return y;
+    }
+};
+
+// 4th order Linkwitz-Riley split, the low and high sides in phase
+struct Crossover
+{
+    static constexpr f64 BUTTERWORTH = 0.7071067811865476;
+
+    StereoBiquad low[2];
+    StereoBiquad high[2];
+
+    void SetFrequency(f64 frequency)
+    {
+        BqFilter filter;
+        filter.type = BqFilter::Type::LOW_PASS;
+        filter.CalcCoefs(frequency, BUTTERWORTH);
+        low[0].SetCoefs(filter);
+        low[1].SetCoefs(filter);
+        filter.type = BqFilter::Type::HIGH_PASS;
+        filter.CalcCoefs(frequency, BUTTERWORTH);
+        high[0].SetCoefs(filter);
+        high[1].SetCoefs(filter);
+    }
+
+    // The allpass the two sides sum to, for the bands that do not go through this crossover
+    static void Compensation(StereoBiquad& allpass, f64 frequency)
+    {
+        BqFilter filter;
+        filter.type = BqFilter::Type::ALL_PASS;
+        filter.CalcCoefs(frequency, BUTTERWORTH);
+        allpass.SetCoefs(filter);
+    }
+
+    void Split(Lanes x, Lanes& lo, Lanes& hi)
+    {
+        lo = low[1].Process(low[0].Process(x));
+        hi = high[1].Process(high[0].Process(x));
+    }
+
+    void Reset()
+    {
+        for (u32 i = 0; i < 2; i++)
+        {
+            low[i].Reset();
+            high[i].Reset();
+        }
+    }
+
+    void Flush()
+    {
+        for (u32 i = 0; i < 2; i++)
+        {
+            low[i].Flush();
+            high[i].Flush();
+        }
+    }
+};
+
+struct MultibandDynamics
+{
+    static constexpr u32 MIN_BANDS = 3;
+    static constexpr u32 MAX_BANDS = 4;
+    static constexpr f64 KNEE      = 6.0;   // dB, compression knee width
+    static constexpr f64 RANGE     = 60.0;  // dB, largest gain reduction
+    static constexpr f64 SILENCE   = 1e-6;  // -120 dB
+
+    struct Band
+    {
+        f64 threshold = -18.0; // dB, compression above
+        f64 ratio     = 2.0;   // 1 is off
+        f64 gate      = -60.0; // dB, downward expansion below
+        f64 expansion = 1.0;   // 1 is off
+        f64 attack    = 10.0;  // ms
+        f64 release   = 120.0; // ms
+        f64 makeup    = 0.0;   // dB
+
+        // Gain reduction of the last control period, for display
+        f64 reduction = 0.0;   // dB
+
+        // Envelope follower, one lane per channel
+        Lanes envelope = lanes_splat(0.0);
+        ControlRamp gain = { 1.0, 0.0 };
+    };
+
+    u32 bands = MIN_BANDS;
+    f64 crossovers[MAX_BANDS - 1] = { 200.0, 2000.0, 8000.0 }; // Hz
+    Band band[MAX_BANDS];
+
+public:
+    // One stereo sample of the master bus
+    void Process(f64& left, f64& right)
+    {
+        if (idle)
+        {
+            if (std::abs(left) < SILENCE && std::abs(right) < SILENCE) return;
+            idle = false;
+            tick = 0;
+        }
+        if (tick == 0 && Changed()) Design();
+
+        Lanes split[MAX_BANDS];
+        Split(lanes_set(left, right), split);
+
+        Lanes y = lanes_splat(0.0);
+        for (u32 b = 0; b < bands; b++)
+        {
+            Band& d = band[b];
+            Lanes level = lanes_abs(split[b]);
+            Lanes coef  = lanes_select(level, d.envelope, attack_coef[b], release_coef[b]);
+            d.envelope  = lanes_add(level, lanes_mul(coef, lanes_sub(d.envelope, level)));
+            y = lanes_add(y, lanes_mul(split[b], lanes_splat(d.gain.Next())));
+        }
+        lanes_get(y, left, right);
+
+        if (++tick == CONTROL_RATE)
+        {
+            tick = 0;
+            Control();
+        }
+    }
+
+    void Reset()
+    {
+        for (u32 c = 0; c < MAX_BANDS - 1; c++)
+        {
+            crossover[c].Reset();
+            for (u32 b = 0; b < MAX_BANDS; b++)
+                compensation[b][c].Reset();
+        }
+        for (u32 b = 0; b < MAX_BANDS; b++)
+        {
+            band[b].envelope = lanes_splat(0.0);
+            band[b].gain     = { 1.0, 0.0 };
+        }
+        tick = 0;
+    }
+
+private:
+    // Each crossover takes the high side of the one below it, the bands under it get its allpass
+    void Split(Lanes x, Lanes* split)
+    {
+        Lanes rest = x;
+        for (u32 c = 0; c + 1 < bands; c++)
+        {
+            for (u32 b = 0; b < c; b++)
+                split[b] = compensation[b][c].Process(split[b]);
+            crossover[c].Split(rest, split[c], rest);
+        }
+        split[bands - 1] = rest;
+    }
+
+    // End of a control period: gains of the bands that are not silent, ramped across the next period
+    void Control()
+    {
+        bool silent = true;
+        for (u32 b = 0; b < bands; b++)
+        {
+            Band& d = band[b];
+            f64 l, r;
+            lanes_get(d.envelope, l, r);
+            f64 level = std::max(l, r);
+            if (level < SILENCE)
+            {
+                // Nothing to hear in this band, hold the gain
+                d.gain.Target(d.gain.value, CONTROL_RATE);
+                continue;
+            }
+            silent = false;
+
+            f64 reduction = GainComputer(d, volume_to_dB(level));
+            d.reduction = reduction;
+            d.gain.Target(dB_to_volume(reduction + d.makeup), CONTROL_RATE);
+        }
+
+        if (silent)
+        {
+            // Asleep until the input is above the silence again, the filters start from rest
+            idle = true;
+            for (u32 c = 0; c < MAX_BANDS - 1; c++)
+            {
+                crossover[c].Reset();
+                for (u32 b = 0; b < MAX_BANDS; b++)
+                    compensation[b][c].Reset();
+            }
+            return;
+        }
+
+        // The quiet bands of a loud mix decay towards denormals, which are slow on x86
+        for (u32 c = 0; c + 1 < bands; c++)
+        {
+            crossover[c].Flush();
+            for (u32 b = 0; b < c; b++)
+                compensation[b][c].Flush();
+        }
+        const Lanes tiny = lanes_splat(1e-15), zero = lanes_splat(0.0);
+        for (u32 b = 0; b < bands; b++)
+            band[b].envelope = lanes_select(band[b].envelope, tiny, band[b].envelope, zero);
+    }
+
+    // Gain in dB for a level in dB: soft knee compression above the threshold, expansion below the gate
+    static f64 GainComputer(const Band& d, f64 x)
+    {
+        f64 y     = x;
+        f64 over  = x - d.threshold;
+        f64 slope = 1.0 / std::max(d.ratio, 1.0) - 1.0;
+        if (2.0 * over > KNEE)
+            y += slope * over;
+        else if (2.0 * over > -KNEE)
+            y += slope * (over + 0.5 * KNEE) * (over + 0.5 * KNEE) / (2.0 * KNEE);
+
+        f64 under = d.gate - x;
+        if (under > 0.0)
+            y -= (std::max(d.expansion, 1.0) - 1.0) * under;
+
+        return std::max(y - x, -RANGE);
+    }
+
+    bool Changed() const
+    {
+        if (bands != designed_bands) return true;
+        for (u32 c = 0; c < MAX_BANDS - 1; c++)
+            if (crossovers[c] != designed_crossovers[c]) return true;
+        for (u32 b = 0; b < MAX_BANDS; b++)
+            if (band[b].attack != designed_attack[b] || band[b].release != designed_release[b]) return true;
+        return false;
+    }
+
+    void Design()
+    {
+        bands = std::clamp(bands, MIN_BANDS, MAX_BANDS);
+        if (bands != designed_bands) Reset();
+
+        // Crossovers kept in order, a little apart
+        f64 frequency = 20.0;
+        for (u32 c = 0; c < MAX_BANDS - 1; c++)
+        {
+            frequency = std::clamp(crossovers[c], 1.1 * frequency, 0.45 * SAMPLE_RATE);
+            crossover[c].SetFrequency(frequency);
+            for (u32 b = 0; b < MAX_BANDS; b++)
+                Crossover::Compensation(compensation[b][c], frequency);
+            designed_crossovers[c] = crossovers[c];
+        }
+
+        for (u32 b = 0; b < MAX_BANDS; b++)
+        {
+            attack_coef[b]  = lanes_splat(std::exp(-1000.0 / (std::max(band[b].attack,  0.01) * SAMPLE_RATE)));
+            release_coef[b] = lanes_splat(std::exp(-1000.0 / (std::max(band[b].release, 0.01) * SAMPLE_RATE)));
+            designed_attack[b]  = band[b].attack;
+            designed_release[b] = band[b].release;
+        }
+        designed_bands = bands;
+    }
+
+private:
+    Crossover    crossover[MAX_BANDS - 1];
+    StereoBiquad compensation[MAX_BANDS][MAX_BANDS - 1]; // [band][crossover above it]
+    Lanes attack_coef[MAX_BANDS];
+    Lanes release_coef[MAX_BANDS];
+
+    u32 designed_bands = 0;
+    f64 designed_crossovers[MAX_BANDS - 1] = {};
+    f64 designed_attack[MAX_BANDS] = {};
+    f64 designed_release[MAX_BANDS] = {};
+
+    u32  tick = 0;
+    bool idle = false;
+};
\ No newline at end of file
@@ -1,6 +1,15 @@
 #pragma once
 #include "../../Core/Common.h"
+#include "Modulation.h"
+#include "FrequencyModulator.h"
+#include "Tuning.h"
+#include "Filter.h"
+#include "Distortion.h"
 #include <glfw3.h>
+#include <string>
+#include <cctype>
+#include <limits>
+#include <charconv>
 
 struct note
 {
@@ -9,10 +18,30 @@ struct note
     f64 off = 0.0;  // Time note was deactivated
     s32 channel = 0;
     bool active = false;
+    f64 pan = 0.0;  // Voice position in the stereo field, -1 left to 1 right
+    f64 velocity = 1.0;
 
     f64 phase_acc = 0.0;
     f64 amplitude = 0.0;
     bool retriggered = false;
+
+    // Control-rate modulation
+    f64 clock = 0.0;              // Oscillator time since note on, runs faster or slower under vibrato
+    f64 lfo_phase = 0.0;          // Key synced LFO phase in cycles
+    ControlRamp envelope;         // Amplitude envelope
+    ControlRamp tremolo;          // LFO amplitude modulation
+    ControlRamp pitch = { 1.0 };  // LFO and modulation matrix frequency ratio
+    f64 pan_mod = 0.0;            // Modulation matrix pan offset
+    u32 seed = 0;                 // Per note on, scatters the unison phases
+
+    // Frequency modulation voice
+    FmVoice fm;
+
+    // Ladder filter state, the ladder filters every voice apart
+    LadderVoice ladder;
+
+    // Distortion state, shaping the voice before the filter
+    DistortionVoice distortion;
 };
 
 // https://pages.mtu.edu/~suits/NoteFreqCalcs.html
@@ -21,24 +50,18 @@ struct note
 
 // https://www.music.mcgill.ca/~gary/307/week1/node28.html
 // MIDI 128 notes mapping formula: f_n = 440 * 2^ (n-69)/12
-static f64 note_freq(s32 note) { return 440.0 * std::pow(2.0, (note - 69) / 12.0); } // A4 = 440Hz
+//static f64 note_freq(s32 note) { return 440.0 * std::pow(2.0, (note - 69) / 12.0); } // A4 = 440Hz
+
+// Frequency from the active tuning table, 12-TET with A4 = 440Hz unless a Scala tuning is loaded
+static f64 note_freq(s32 note) { return Tuning::Instance().Frequency(note); }
+
+// Inverse of 12-TET note_freq, fractional
+static f64 frequency_to_note(f64 freq) { return freq > 0.0 ? 69.0 + 12.0 * std::log2(freq / 440.0) : 0.0; }
 
 #undef max
 static u32 closest_note_from_frequency(f64 freq)
 {
-    f64 min_diff = std::numeric_limits<f64>::max();
-    u32 closest_note_id = 0;
-    for (s32 i = 0; i <= 127; i++)
-    {
-        f64 n_freq = note_freq(i);
-        f64 diff = std::abs(freq - n_freq);
-        if (diff < min_diff)
-        {
-            min_diff = diff;
-            closest_note_id = i;
-        }
-    }
-    return closest_note_id;
+    return Tuning::Instance().ClosestNote(freq);
 }
 
 // MIDI note representation
@@ -51,6 +74,36 @@ static std::string note_name(u32 note)
     return n;
 }
 
+// Leading decimal digits of text from i on, -1 when there are none or they overflow
+static s32 parse_digits(const std::string& text, size_t i)
+{
+    s32 value = -1;
+    auto [end, error] = std::from_chars(text.data() + i, text.data() + text.size(), value);
+    return error == std::errc() ? value : -1;
+}
+
+// Parse a note name such as "C4", "C#4" or "Db4" (same octave numbering as note_name), or a plain MIDI number.
+// -1 when it is neither
+static s32 note_from_name(const std::string& name)
+{
+    if (name.empty()) return -1;
+    if (std::isdigit(static_cast<unsigned char>(name[0]))) return parse_digits(name, 0);
+
+    static const s32 tones[7] = { 9, 11, 0, 2, 4, 5, 7 }; // A B C D E F G
+    char letter = static_cast<char>(std::toupper(static_cast<unsigned char>(name[0])));
+    if (letter < 'A' || letter > 'G') return -1;
+
+    s32 tone = tones[letter - 'A'];
+    size_t i = 1;
+    if (i < name.size() && name[i] == '#') { tone++; i++; }
+    else if (i < name.size() && name[i] == 'b') { tone--; i++; }
+    if (i >= name.size() || !std::isdigit(static_cast<unsigned char>(name[i]))) return -1;
+
+    s32 octave = parse_digits(name, i);
+    if (octave < 0 || octave > (std::numeric_limits<s32>::max() - 11) / 12) return -1;
+    return octave * 12 + tone;
+}
+
 enum class Note 
 {
     C       = 0,
@@ -1,14 +1,52 @@
 #pragma once
 
-#include <functional>
+#include <limits>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <algorithm>
 
 #include "../../Core/Common.h"
 #include "../../Core/Random.h"
+#include "../../Core/Published.h"
 #include "Wave.h"
+#include "Expression.h"
 #include "Note.h"
 
+// Oscillator state the voice loop rarely touches: kept apart so the parameter records stay small
+struct OscillatorCold
+{
+    std::string name;
+    randf64 rand;
+
+    // CUSTOM waveform, published whole: the audio thread acquires it once per block and the voices read
+    // it through the pointer taken then. Replaced programs are freed by the next compile, on the GUI thread.
+    Published<CustomWave> custom;
+
+    // Compile off the audio thread, bake a band-limited wavetable when asked and the expression is periodic
+    bool SetCustomExpression(const std::string& text, bool bake, std::string& error)
+    {
+        auto wave = std::make_shared<CustomWave>();
+        if (!wave->expression.Compile(text, error))
+            return false;
+
+        if (bake)
+        {
+            if (!wave->expression.Periodic())
+            {
+                error = "only expressions of phase alone can be baked into a wavetable";
+                return false;
+            }
+            wave->wavetable.Bake(wave->expression);
+        }
 
-struct Oscillator
+        custom.Publish(std::move(wave));
+        return true;
+    }
+};
+
+// Oscillator parameters read every block, packed in the first cache line
+struct alignas(64) Oscillator
 {
 public:
     enum class Type
@@ -20,23 +58,36 @@ public:
         WAVE_ANLG_SAWTOOTH,
         NOISE_WHITE,
         CUSTOM,
+        COUNT
+    };
+
+    // Block kernel: fills output with one oscillator sample per entry of times (voice clock in seconds)
+    using Kernel = void (*)(OscillatorCold& cold, const f64* times, f64* output, u32 samples, f64 amp, f64 freq, f64 volume, f64 sample_rate);
+
+    // Unison: detuned copies of the waveform as SIMD lanes over the one voice clock. Copy l reads the phase
+    // frequency[l] * t + offset[l], so the copies need no phase state of their own.
+    // Supersaw: https://www.adamszabo.com/internet/adam_szabo_how_to_emulate_the_super_saw.pdf
+    static constexpr u32 MAX_UNISON = 16;
+
+    struct UnisonLanes
+    {
+        u32 count  = 1;  // copies
+        u32 padded = 2;  // count rounded up to whole SIMD registers, padding lanes have zero weight
+        alignas(64) f64 frequency[MAX_UNISON] = {};
+        alignas(64) f64 offset[MAX_UNISON]    = {};
+        alignas(64) f64 weight[MAX_UNISON]    = {};
     };
 
+    // Even lanes mix into the first output row, odd lanes into the second one when stereo
+    using UnisonKernel = void (*)(const UnisonLanes& lanes, const f64* times, f64* output, u32 samples, u32 stride, bool stereo);
+
 public:
     Oscillator(f64 volume = 1.0, s32 pitch = 0, Type waveform = Type::WAVE_SINE) 
-        : m_wave(), m_volume(volume), m_pitch(pitch), m_waveform(waveform), m_output(0.0), m_custom(nullptr) {}
+        : m_volume(volume), m_wave(), m_pitch(pitch), m_waveform(waveform), m_output(0.0) {}
 
 public:
-    f64 GenerateWave(f64 time_step, note& n)
-    {
-        m_wave.frequency = note_freq(n.id + m_pitch);
-        f64 output = GenerateWave(time_step, m_wave.amplitude, m_wave.frequency);
-        //f64 output = GenerateWavePhase(n.phase_acc, m_wave.amplitude, m_wave.frequency);
-        return output;
-    }
-
     // BUG: Phase restart causing clicks due to the time dependence, move to phase accumulation logic
-    f64 GenerateWave(f64 time_step, f64 amp, f64 freq)
+    f64 GenerateWave(f64 time_step, f64 amp, f64 freq, OscillatorCold& cold)
     {
         f64 phase = 2.0 * PI * freq * time_step;
  
@@ -68,12 +119,11 @@ public:
         } break;
 
         case Type::NOISE_WHITE:
-            m_output = rand.normal(0.0, 1.0);
+            m_output = cold.rand.normal(0.0, 1.0);
             break;
 
         case Type::CUSTOM: // Function pointer for custom wave synthesis
-            if (m_custom) m_output = m_custom(time_step);
-            else          m_output = 0.0;
+            m_output = CustomSample(cold, time_step, freq);
             break;
 
         default:
@@ -86,13 +136,360 @@ public:
         return m_output;
     }
 
+    // Control rate LFO: the bare waveform in [-1, 1] at phase cycles, 0 when muted. Unlike GenerateWave
+    // it leaves out the volume and clamp, so vibrato and matrix depths downstream get their full range.
+    f64 LfoShape(f64 phase, OscillatorCold& cold) const
+    {
+        if (m_mute) return 0.0;
+
+        const f64 angle = 2.0 * PI * phase;
+        switch (m_waveform)
+        {
+        case Type::WAVE_SINE:          return std::sin(angle);
+        case Type::WAVE_SQUARE:        return std::sin(angle) > 0.0 ? 1.0 : -1.0;
+        case Type::WAVE_TRIANGLE:      return (2.0 / PI) * std::asin(std::sin(angle));
+        case Type::WAVE_DIGI_SAWTOOTH: return 2.0 * (phase - std::floor(phase)) - 1.0;
+        case Type::WAVE_ANLG_SAWTOOTH:
+        {
+            f64 acc = 0.0;
+            for (f64 n = 1.0; n < 50.0; n++)
+                acc += std::sin(angle * n) / n;
+            return std::clamp(acc * (2.0 / PI), -1.0, 1.0);
+        }
+        case Type::NOISE_WHITE:        return std::clamp(cold.rand.normal(0.0, 1.0), -1.0, 1.0);
+        default:                       return 0.0;
+        }
+    }
+
+    // Block rendering: the waveform, mute and clamp are resolved once per block into a kernel,
+    // so parameter changes from the GUI take effect at the next block boundary.
+    // With two channels the block has a second row at output + stride (see Channels).
+    void GenerateBlock(OscillatorCold& cold, const f64* times, f64* output, u32 samples, s32 note_id, f64 sample_rate,
+        u32 seed = 0, u32 channels = 1, u32 stride = 0)
+    {
+        m_wave.frequency = note_freq(note_id + m_pitch);
+
+        UnisonKernel unison = SelectUnisonKernel();
+        if (unison)
+        {
+            UnisonLanes lanes;
+            SetupUnison(lanes, seed);
+            unison(lanes, times, output, samples, stride, channels == 2);
+        }
+        else
+        {
+            SelectKernel()(cold, times, output, samples, m_wave.amplitude, m_wave.frequency, m_volume, sample_rate);
+            if (channels == 2) std::copy(output, output + samples, output + stride);
+        }
+        if (samples > 0) m_output = output[samples - 1];
+    }
+
+    // Output rows: unison with a stereo spread splits its copies between a left and a right row
+    u32 Channels() const { return (m_unison > 1 && m_spread > 0.0) ? 2 : 1; }
+
+    Kernel SelectKernel() const
+    {
+        static constexpr Kernel kernels[static_cast<s32>(Type::COUNT)][2] = {
+            { &BlockKernel<Type::WAVE_SINE,          false>, &BlockKernel<Type::WAVE_SINE,          true> },
+            { &BlockKernel<Type::WAVE_SQUARE,        false>, &BlockKernel<Type::WAVE_SQUARE,        true> },
+            { &BlockKernel<Type::WAVE_TRIANGLE,      false>, &BlockKernel<Type::WAVE_TRIANGLE,      true> },
+            { &BlockKernel<Type::WAVE_DIGI_SAWTOOTH, false>, &BlockKernel<Type::WAVE_DIGI_SAWTOOTH, true> },
+            { &BlockKernel<Type::WAVE_ANLG_SAWTOOTH, false>, &BlockKernel<Type::WAVE_ANLG_SAWTOOTH, true> },
+            { &BlockKernel<Type::NOISE_WHITE,        false>, &BlockKernel<Type::NOISE_WHITE,        true> },
+            { &BlockKernel<Type::CUSTOM,             false>, &BlockKernel<Type::CUSTOM,             true> },
+        };
+
+        s32 type = static_cast<s32>(m_waveform);
+        if (m_mute || m_volume == 0.0 || type < 0 || type >= static_cast<s32>(Type::COUNT))
+            return &SilenceKernel;
+
+        // The clamp is only compiled in when the waveform peak times the volume can leave [-1, 1]
+        bool clamp = Peak(m_waveform, m_wave.amplitude) * std::abs(m_volume) > 1.0;
+        return kernels[type][clamp];
+    }
+
+    // Unison kernel, none for a single copy or waveforms without a phase (noise, expressions of time)
+    UnisonKernel SelectUnisonKernel() const
+    {
+        static constexpr UnisonKernel kernels[static_cast<s32>(Type::COUNT)][2] = {
+            { &UnisonBlock<Type::WAVE_SINE,          false>, &UnisonBlock<Type::WAVE_SINE,          true> },
+            { &UnisonBlock<Type::WAVE_SQUARE,        false>, &UnisonBlock<Type::WAVE_SQUARE,        true> },
+            { &UnisonBlock<Type::WAVE_TRIANGLE,      false>, &UnisonBlock<Type::WAVE_TRIANGLE,      true> },
+            { &UnisonBlock<Type::WAVE_DIGI_SAWTOOTH, false>, &UnisonBlock<Type::WAVE_DIGI_SAWTOOTH, true> },
+            { &UnisonBlock<Type::WAVE_ANLG_SAWTOOTH, false>, &UnisonBlock<Type::WAVE_ANLG_SAWTOOTH, true> },
+            { nullptr, nullptr },
+            { nullptr, nullptr },
+        };
+
+        s32 type = static_cast<s32>(m_waveform);
+        if (m_unison <= 1 || m_mute || m_volume == 0.0 || type < 0 || type >= static_cast<s32>(Type::COUNT))
+            return nullptr;
+
+        // Copies add up in power, the peak can reach sqrt(count) times one copy
+        u32 count = std::min(m_unison, MAX_UNISON);
+        bool clamp = Peak(m_waveform, m_wave.amplitude) * std::abs(m_volume) * std::sqrt(f64(count)) > 1.0;
+        return kernels[type][clamp];
+    }
+
+    // Copies spread evenly over +-detune cents, phases from a golden ratio sequence on the note seed
+    void SetupUnison(UnisonLanes& lanes, u32 seed) const
+    {
+        const f64 golden = 0.6180339887498949;
+        lanes.count  = std::clamp(m_unison, 1u, MAX_UNISON);
+        lanes.padded = (lanes.count + 1) & ~1u;
+
+        f64 amp = (m_waveform == Type::WAVE_SQUARE) ? 1.0 : m_wave.amplitude;
+        f64 weight = amp * m_volume / std::sqrt(f64(lanes.count));
+        for (u32 l = 0; l < lanes.count; l++)
+        {
+            f64 position = (lanes.count > 1) ? 2.0 * l / (lanes.count - 1) - 1.0 : 0.0;
+            f64 sequence = (f64(seed) * MAX_UNISON + l) * golden;
+            lanes.frequency[l] = m_wave.frequency * std::exp2(position * m_detune / 1200.0);
+            lanes.offset[l]    = m_random_phase ? sequence - std::floor(sequence) : 0.0;
+            lanes.weight[l]    = weight;
+        }
+    }
+
+    // Phases of every lane at one time of the voice clock, in cycles [0, 1): times are since note on
+    // and positive, so truncation is the floor
+    static void UnisonPhases(const UnisonLanes& lanes, f64 t, f64* phase)
+    {
+        u32 l = 0;
+#if defined(SYNTH_SSE2)
+        __m128d time = _mm_set1_pd(t);
+        for (; l < lanes.padded; l += 2)
+        {
+            __m128d x = _mm_add_pd(_mm_mul_pd(_mm_load_pd(lanes.frequency + l), time), _mm_load_pd(lanes.offset + l));
+            _mm_store_pd(phase + l, _mm_sub_pd(x, _mm_cvtepi32_pd(_mm_cvttpd_epi32(x))));
+        }
+#elif defined(SYNTH_NEON)
+        float64x2_t time = vdupq_n_f64(t);
+        for (; l < lanes.padded; l += 2)
+        {
+            float64x2_t x = vfmaq_f64(vld1q_f64(lanes.offset + l), vld1q_f64(lanes.frequency + l), time);
+            vst1q_f64(phase + l, vsubq_f64(x, vrndq_f64(x)));
+        }
+#endif
+        for (; l < lanes.padded; l++)
+        {
+            f64 x = lanes.frequency[l] * t + lanes.offset[l];
+            phase[l] = x - f64(s32(x));
+        }
+    }
+
+    // Every copy of a waveform at its phase in cycles, same shapes as BlockKernel, times the lane weights.
+    // The loops run across the lanes so the compiler can vectorize them. The analog saw sums its partials with
+    // the recurrence sin(n x) = 2 cos(x) sin((n - 1) x) - sin((n - 2) x): a sine and a cosine per lane, not 49 sines
+    template <Type W>
+    static void Shapes(const UnisonLanes& lanes, const f64* phase, f64* wave)
+    {
+        const u32 count = lanes.padded;
+        if constexpr (W == Type::WAVE_ANLG_SAWTOOTH)
+        {
+            alignas(64) f64 twice_cos[MAX_UNISON];
+            alignas(64) f64 previous[MAX_UNISON];
+            alignas(64) f64 current[MAX_UNISON];
+            alignas(64) f64 acc[MAX_UNISON];
+            for (u32 l = 0; l < count; l++)
+            {
+                f64 x = 2.0 * PI * phase[l];
+                twice_cos[l] = 2.0 * std::cos(x);
+                previous[l]  = 0.0;
+                current[l]   = std::sin(x);
+                acc[l]       = current[l];
+            }
+            for (u32 n = 2; n < 50; n++)
+            {
+                const f64 inverse = 1.0 / n;
+                for (u32 l = 0; l < count; l++)
+                {
+                    f64 next = twice_cos[l] * current[l] - previous[l];
+                    previous[l] = current[l];
+                    current[l]  = next;
+                    acc[l]     += next * inverse;
+                }
+            }
+            for (u32 l = 0; l < count; l++)
+                wave[l] = acc[l] * (2.0 / PI) * lanes.weight[l];
+        }
+        else
+        {
+            for (u32 l = 0; l < count; l++)
+                wave[l] = Shape<W>(phase[l]) * lanes.weight[l];
+        }
+    }
+
+    // One copy of a waveform at a phase in cycles, without the amplitude
+    template <Type W>
+    static f64 Shape(f64 phase)
+    {
+        if constexpr (W == Type::WAVE_SINE)
+            return std::sin(2.0 * PI * phase);
+        else if constexpr (W == Type::WAVE_SQUARE)
+            return phase < 0.5 ? 1.0 : -1.0;
+        else if constexpr (W == Type::WAVE_TRIANGLE)
+        {
+            f64 x = phase + 0.75;
+            x -= f64(s32(x));
+            return (PI / 2.0) * (4.0 * std::abs(x - 0.5) - 1.0);
+        }
+        else if constexpr (W == Type::WAVE_DIGI_SAWTOOTH)
+            return 2.0 * phase - 1.0;
+        else
+            return 0.0;
+    }
+
+    template <Type W, bool CLAMP>
+    static void UnisonBlock(const UnisonLanes& lanes, const f64* times, f64* output, u32 samples, u32 stride, bool stereo)
+    {
+        alignas(64) f64 phase[MAX_UNISON];
+        alignas(64) f64 wave[MAX_UNISON];
+        for (u32 k = 0; k < samples; k++)
+        {
+            UnisonPhases(lanes, times[k], phase);
+            Shapes<W>(lanes, phase, wave);
+
+            f64 even = 0.0;
+            f64 odd  = 0.0;
+            for (u32 l = 0; l < lanes.padded; l += 2)
+            {
+                even += wave[l];
+                odd  += wave[l + 1];
+            }
+
+            if (stereo)
+            {
+                if constexpr (CLAMP)
+                {
+                    even = std::clamp(even, -1.0, 1.0);
+                    odd  = std::clamp(odd,  -1.0, 1.0);
+                }
+                output[k]          = even;
+                output[stride + k] = odd;
+            }
+            else
+            {
+                f64 s = even + odd;
+                if constexpr (CLAMP) s = std::clamp(s, -1.0, 1.0);
+                output[k] = s;
+            }
+        }
+    }
+
+    // Largest magnitude GenerateWave can produce before volume
+    static f64 Peak(Type waveform, f64 amp)
+    {
+        switch (waveform)
+        {
+        case Type::WAVE_SINE:          return std::abs(amp);
+        case Type::WAVE_SQUARE:        return 1.0;
+        case Type::WAVE_TRIANGLE:      return std::abs(amp) * PI / 2.0;
+        case Type::WAVE_DIGI_SAWTOOTH: return std::abs(amp);
+        case Type::WAVE_ANLG_SAWTOOTH: return 1.2; // Gibbs overshoot of the 49 partial sum
+        default:                       return std::numeric_limits<f64>::infinity();
+        }
+    }
+
+    // Same waveforms as GenerateWave, one tight loop per waveform and clamp flag
+    template <Type W, bool CLAMP>
+    static void BlockKernel(OscillatorCold& cold, const f64* times, f64* output, u32 samples, f64 amp, f64 freq, f64 volume, f64 sample_rate)
+    {
+        if constexpr (W == Type::CUSTOM)
+        {
+            CustomBlock(cold, times, output, samples, freq, sample_rate);
+            for (u32 k = 0; k < samples; k++)
+            {
+                f64 s = output[k] * volume;
+                if constexpr (CLAMP) s = std::clamp(s, -1.0, 1.0);
+                output[k] = s;
+            }
+            return;
+        }
+
+        const f64 w = 2.0 * PI * freq;
+        for (u32 k = 0; k < samples; k++)
+        {
+            f64 phase = w * times[k];
+            f64 s = 0.0;
+
+            if constexpr (W == Type::WAVE_SINE)
+                s = amp * std::sin(phase);
+            else if constexpr (W == Type::WAVE_SQUARE)
+                s = amp * std::sin(phase) > 0 ? 1.0 : -1.0;
+            else if constexpr (W == Type::WAVE_TRIANGLE)
+                s = amp * std::asin(std::sin(phase));
+            else if constexpr (W == Type::WAVE_DIGI_SAWTOOTH)
+                s = amp * (2.0 / PI) * (freq * PI * fmod(times[k], 1.0 / freq) - (PI / 2.0));
+            else if constexpr (W == Type::WAVE_ANLG_SAWTOOTH)
+            {
+                f64 acc = 0.0;
+                for (f64 n = 1.0; n < 50.0; n++)
+                    acc += std::sin(phase * n) / n;
+                s = acc * (2.0 / PI);
+            }
+            else if constexpr (W == Type::NOISE_WHITE)
+                s = cold.rand.normal(0.0, 1.0);
+
+            s *= volume;
+            if constexpr (CLAMP) s = std::clamp(s, -1.0, 1.0);
+            output[k] = s;
+        }
+    }
+
+    // CUSTOM: the baked wavetable when there is one, otherwise the bytecode over the whole block.
+    // The program is the one acquired for this block (see Published), the mip level the one for the engine rate
+    static void CustomBlock(OscillatorCold& cold, const f64* times, f64* output, u32 samples, f64 freq, f64 sample_rate)
+    {
+        const CustomWave* wave = cold.custom.Current();
+        if (!wave)
+        {
+            std::fill(output, output + samples, 0.0);
+            return;
+        }
+
+        f64 phase[Expression::MAX_BLOCK];
+        for (u32 offset = 0; offset < samples; offset += Expression::MAX_BLOCK)
+        {
+            u32 n = std::min(Expression::MAX_BLOCK, samples - offset);
+            for (u32 k = 0; k < n; k++)
+            {
+                f64 cycles = freq * times[offset + k];
+                phase[k] = cycles - std::floor(cycles);
+            }
+
+            if (!wave->wavetable.Empty())
+            {
+                u32 level = wave->wavetable.Level(freq, sample_rate);
+                for (u32 k = 0; k < n; k++)
+                    output[offset + k] = wave->wavetable.Lookup(level, phase[k]);
+            }
+            else
+            {
+                wave->expression.Evaluate(phase, times + offset, freq, frequency_to_note(freq), output + offset, n);
+            }
+        }
+    }
+
+    // The per sample paths run at the compile time rate
+    static f64 CustomSample(OscillatorCold& cold, f64 time, f64 freq)
+    {
+        f64 output = 0.0;
+        CustomBlock(cold, &time, &output, 1, freq, SAMPLE_RATE);
+        return output;
+    }
+
+    static void SilenceKernel(OscillatorCold&, const f64*, f64* output, u32 samples, f64, f64, f64, f64)
+    {
+        std::fill(output, output + samples, 0.0);
+    }
+
     void SetVolume(f64 amplitude) { m_volume = std::clamp(amplitude, 0.0, 1.0);  m_wave.SetAmplitude(amplitude); }
     void SetWaveform(Type w) { m_waveform = w; }
 
     // BUG: Phase accumulation following 
     // Direct Digital Synthesis or Numerically controlled oscillator
     // does not work as intended, because of note structre handling, introduce note.phase?
-    f64 GenerateWavePhase(f64& phase_acc, f64 amp, f64 freq)
+    f64 GenerateWavePhase(f64& phase_acc, f64 amp, f64 freq, OscillatorCold& cold)
     {
         phase_inc = (2.0 * PI) * freq / SAMPLE_RATE;
         phase_acc += phase_inc;
@@ -129,14 +526,11 @@ public:
         break;
 
         case Type::NOISE_WHITE:
-            m_output = rand.normal(0.0, 1.0);
+            m_output = cold.rand.normal(0.0, 1.0);
             break;
 
         case Type::CUSTOM:
-            if (m_custom)
-                m_output = m_custom(phase_acc);
-            else
-                m_output = 0.0;
+            m_output = CustomSample(cold, freq > 0.0 ? phase_acc / (2.0 * PI * freq) : 0.0, freq);
             break;
 
         default:
@@ -150,14 +544,22 @@ public:
     }
 
 public:
+    // Hot: read by the voice loop
     f64     m_volume;
+    f64     m_pan = 0.0;
+    Wave    m_wave;
     s32     m_pitch;
-    f64     m_output;
     Type    m_waveform;
-    Wave    m_wave;
-    randf64 rand;
-    std::function<f64(f64 time_step)> m_custom;
-    bool m_mute = false;
+    bool    m_mute = false;
+
+    // Unison
+    u32     m_unison = 1;          // copies, 1 to MAX_UNISON
+    f64     m_detune = 20.0;       // cents from the centre copy to the outermost ones
+    f64     m_spread = 0.5;        // stereo width of the copies [0, 1]
+    bool    m_random_phase = true; // copies start at scattered phases instead of together
+
+    // Written back once per block
+    f64     m_output;
 
     // Phase logic
     f64 phase_inc = 0.0;
@@ -176,6 +578,7 @@ static std::string wave_str(Oscillator::Type type)
     case Oscillator::Type::WAVE_ANLG_SAWTOOTH: n = "ANALOG SAWTOOTH"; break;
     case Oscillator::Type::NOISE_WHITE:        n = "WHITE";           break;
     case Oscillator::Type::CUSTOM:             n = "CUSTOM";          break;
+    default:                                                          break;
     }
     return n;
-}
+}
\ No newline at end of file
@@ -11,12 +11,14 @@ struct Reverb
 {
 	// Freeverb constants
 	static constexpr f64 MAX_SPREAD          = 100;
+	static constexpr s32 STEREO_SPREAD       = 23;
+	static constexpr s32 NUM_CHANNELS        = 2;
 	static constexpr s32 NUM_COMB_FILTERS    = 8;
 	static constexpr s32 NUM_ALLPASS_FILTERS = 4;
-	// Parallel Low-pass Feedback Comb Filters
-	CombFilter    comb_filters[NUM_COMB_FILTERS];
-	// Serial All-pass Feedback Filters
-	AllPassFilter allpass_filters[NUM_ALLPASS_FILTERS];
+	// Parallel Low-pass Feedback Comb Filters, one bank per channel
+	CombFilter    comb_filters[NUM_CHANNELS][NUM_COMB_FILTERS];
+	// Serial All-pass Feedback Filters, one chain per channel
+	AllPassFilter allpass_filters[NUM_CHANNELS][NUM_ALLPASS_FILTERS];
 	// Reverb parameters
 	f64 room;
 	f64 spread;
@@ -24,55 +26,81 @@ struct Reverb
 	f64 decay;
 	f64 dry;
 	f64 wet;
+	f64 wet_mod = 0.0; // modulation offset in dB
+	f64 width = 1.0;
 
 	// Config
 	void ComputeFilterDelays() 
 	{
 		s32 comb_filter_delays[NUM_COMB_FILTERS] = { 1557, 1617, 1491, 1422, 1277, 1356, 1188, 1116 };
-		for (s32 i = 0; i < NUM_COMB_FILTERS; i++)
-		{
-			comb_filters[i].SetDelay(room * (comb_filter_delays[i] + spread * MAX_SPREAD));
-			comb_filters[i].damp = damp;
-		}
+		s32 allpass_delays[NUM_ALLPASS_FILTERS]  = { 225, 556, 441, 341 };
 
-		// Compute comb feedbacks
-		for (s32 i = 0; i < NUM_COMB_FILTERS; i++)
+		// The right channel runs slightly longer delays to decorrelate the sides
+		for (s32 c = 0; c < NUM_CHANNELS; c++)
 		{
-			f64 delay_in_seconds = comb_filters[i].history.size() * 1.0 / SAMPLE_RATE;
-			comb_filters[i].feedback = std::pow(10.0, -3.0 * delay_in_seconds / decay);
+			f64 stereo_offset = c * STEREO_SPREAD;
+			for (s32 i = 0; i < NUM_COMB_FILTERS; i++)
+			{
+				comb_filters[c][i].SetDelay(room * (comb_filter_delays[i] + spread * MAX_SPREAD + stereo_offset));
+				comb_filters[c][i].damp = damp;
+			}
+
+			// Compute comb feedbacks
+			for (s32 i = 0; i < NUM_COMB_FILTERS; i++)
+			{
+				f64 delay_in_seconds = comb_filters[c][i].history.size * 1.0 / SAMPLE_RATE;
+				comb_filters[c][i].feedback = std::pow(10.0, -3.0 * delay_in_seconds / decay);
+			}
+
+			// Compute all pass feedbacks
+			for (s32 i = 0; i < NUM_ALLPASS_FILTERS; i++)
+			{
+				allpass_filters[c][i].SetDelay(room * (allpass_delays[i] + spread * MAX_SPREAD + stereo_offset));
+				allpass_filters[c][i].feedback = 0.5;
+			}
 		}
+	}
 
-		// Compute all pass feedbacks
-		s32 allpass_delays[NUM_ALLPASS_FILTERS] = { 225, 556, 441, 341 };
-		for (s32 i = 0; i < NUM_ALLPASS_FILTERS; i++)
+	// Reserve the histories for the largest room so later parameter changes never reallocate
+	void Reserve(f64 max_room)
+	{
+		s32 max_delay = s32(max_room * (1617 + MAX_SPREAD + STEREO_SPREAD)) + 1;
+		for (s32 c = 0; c < NUM_CHANNELS; c++)
 		{
-			allpass_filters[i].SetDelay(room * (allpass_delays[i] + spread * MAX_SPREAD));
-			allpass_filters[i].feedback = 0.5;
+			for (s32 i = 0; i < NUM_COMB_FILTERS; i++)    comb_filters[c][i].history.Reserve(max_delay);
+			for (s32 i = 0; i < NUM_ALLPASS_FILTERS; i++) allpass_filters[c][i].history.Reserve(max_delay);
 		}
 	}
 
-	f64 Process(f64 sample)
+	// Mono sum in, stereo out: width blends the two tanks, 0 is mono and 1 fully separated
+	void Process(f64& left, f64& right)
 	{
 		f64 linear_dry = dB_to_volume(dry);
-		f64 linear_wet = dB_to_volume(wet);
-		f64 output = 0.0;
+		f64 linear_wet = dB_to_volume(std::min(wet + wet_mod, 0.0));
+		f64 input = 0.5 * (left + right);
+		f64 output[NUM_CHANNELS] = {};
 
-		// Apply Comb Filters in parallel
-		for (s32 i = 0; i < NUM_COMB_FILTERS; i++)
-			output += comb_filters[i].Process(sample);
+		for (s32 c = 0; c < NUM_CHANNELS; c++)
+		{
+			// Apply Comb Filters in parallel
+			for (s32 i = 0; i < NUM_COMB_FILTERS; i++)
+				output[c] += comb_filters[c][i].Process(input);
 
-		// Normalize
-		output /= NUM_COMB_FILTERS;
+			// Normalize
+			output[c] /= NUM_COMB_FILTERS;
 
-		// Apply All Pass Filters in series
-		for (s32 i = 0; i < NUM_ALLPASS_FILTERS; i++)
-			output = allpass_filters[i].Process(output);
+			// Apply All Pass Filters in series
+			for (s32 i = 0; i < NUM_ALLPASS_FILTERS; i++)
+				output[c] = allpass_filters[c][i].Process(output[c]);
 
-		// Normalize
-		output /= NUM_ALLPASS_FILTERS;
+			// Normalize
+			output[c] /= NUM_ALLPASS_FILTERS;
+		}
 
-		output = linear_dry * sample + linear_wet * output;
+		f64 wet_direct = linear_wet * (0.5 + 0.5 * width);
+		f64 wet_cross  = linear_wet * (0.5 - 0.5 * width);
 
-		return output;
+		left  = linear_dry * left  + wet_direct * output[0] + wet_cross * output[1];
+		right = linear_dry * right + wet_direct * output[1] + wet_cross * output[0];
 	}
 };
\ No newline at end of file
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+#include "../../Core/Published.h"
+#include "SoundFont.h"
+#include "Note.h"
+
+// Sampler voice playing SoundFont 2 banks. The sample pool is memory-mapped, a note starts from the
+// preloaded attack and a reader thread streams the rest of each region into a ring per layer,
+// so the audio thread never touches a page of the file that may not be resident.
+// Resampling is 4 point cubic Hermite over the unrolled stream (start to loop end, then the loop).
+// Streaming sample playback: https://www.kvraudio.com/forum/viewtopic.php?t=384637
+// Hermite interpolation: https://www.musicdsp.org/en/latest/Other/93-hermite-interpollation.html
+struct SamplerLayer
+{
+    static constexpr u32 RING = 8192; // frames, power of two
+
+    // Audio thread
+    u32 region     = 0;
+    u32 generation = 0;
+    f64 position   = 0.0; // in the unrolled stream, frames
+    f64 gain       = 0.0;
+    f64 ratio      = 1.0; // stream frames per output sample at unit pitch
+
+    // Audio thread to reader: region << 32 | bank serial << 24 | generation << 8 | active
+    std::atomic<u64> request  = 0;
+    // Audio thread to reader: generation << 48 | oldest stream frame still read
+    std::atomic<u64> consumed = 0;
+    // Reader to audio thread: generation << 48 | stream frames written, the ring holds the last RING of them
+    std::atomic<u64> filled   = 0;
+
+    // Reader thread
+    u32 reader_generation = ~0u;
+    u64 written = 0;
+
+    s16 ring[RING] = {};
+};
+
+struct SamplerVoice
+{
+    static constexpr u32 LAYERS = 4; // stereo pairs and velocity crossfades play several regions per key
+
+    f64 on = -1.0;  // note on time of the owner, a new time restarts the voice
+    u32 serial = 0; // bank the layers were started from
+    u32 layers = 0;
+    SamplerLayer layer[LAYERS];
+};
+
+struct Sampler
+{
+    static constexpr u32 MAX_VOICES = 128; // one per MIDI note
+    static constexpr u32 MAX_BLOCK  = 64;
+    static constexpr u32 CHUNK      = 2048; // frames the reader copies into a ring at a time
+
+public:
+    ~Sampler() { StopReader(); }
+
+    // Any thread but the audio thread: maps the bank, the voices switch to it at the next block
+    bool Load(const std::string& filename, std::string& error)
+    {
+        auto bank = std::make_shared<SoundFont>();
+        if (!bank->Load(filename, error))
+            return false;
+
+        std::printf("INFO: SoundFont %s: %zu presets, %zu regions, %.1f MB mapped, %.1f MB preloaded\n", bank->name.c_str(),
+            bank->presets.size(), bank->regions.size(), bank->file.size / 1048576.0, bank->preload.size() * 2.0 / 1048576.0);
+        // Voices and their rings are allocated with the first bank, before the audio thread can see one
+        if (!voices) voices = std::make_unique<SamplerVoice[]>(MAX_VOICES);
+        preset = 0;
+        font.Publish(std::move(bank));
+        if (streaming) StartReader();
+        return true;
+    }
+
+    std::shared_ptr<const SoundFont> Font() const { return font.Latest(); }
+
+    // Audio thread, once per block
+    void Update()
+    {
+        font.Acquire();
+        current_preset = preset.load();
+    }
+
+    // Render one control block of the voice of a note, pitch ramps linearly from pitch_from to pitch_to
+    void Render(s32 note_id, f64 note_on, f64 velocity, f64* output, u32 samples, f64 frequency, f64 pitch_from, f64 pitch_to, f64 sample_rate)
+    {
+        samples = std::min(samples, MAX_BLOCK);
+        std::fill(output, output + samples, 0.0);
+        const SoundFont* bank = font.Current();
+        if (!bank) return;
+
+        SamplerVoice& v = voices[note_id & (MAX_VOICES - 1)];
+        if (v.on != note_on || v.serial != bank->serial)
+            Start(v, *bank, note_id, velocity, frequency, sample_rate);
+        v.on = note_on;
+
+        for (u32 l = 0; l < v.layers; l++)
+            RenderLayer(v.layer[l], *bank, output, samples, pitch_from, pitch_to);
+    }
+
+    // Reader thread: fills the ring of every active layer up to RING frames ahead of its voice.
+    // This is the only place the sample pool past the preload is read, so page faults stay here.
+    void ReadAhead()
+    {
+        while (reader_running)
+        {
+            // A replaced bank stays retired in the publisher until neither this pass nor a block holds it
+            std::shared_ptr<const SoundFont> bank = font.Latest();
+
+            bool idle = true;
+            for (u32 v = 0; v < MAX_VOICES; v++)
+                for (SamplerLayer& layer : voices[v].layer)
+                    idle &= !Fill(layer, bank.get());
+
+            if (idle) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+private:
+    static u64 Request(u32 region, u32 serial, u32 generation, bool active)
+    {
+        return u64(region) << 32 | u64(serial & 0xFF) << 24 | u64(generation & 0xFFFF) << 8 | (active ? 1 : 0);
+    }
+
+    static u64 Stamp(u32 generation, u64 frames) { return u64(generation & 0xFFFF) << 48 | frames; }
+    static u32 StampGeneration(u64 stamp) { return static_cast<u32>(stamp >> 48); }
+    static u64 StampFrames(u64 stamp) { return stamp & ((u64(1) << 48) - 1); }
+
+    // New note on: pick the regions of the key and velocity, restart their streams
+    void Start(SamplerVoice& v, const SoundFont& bank, s32 note_id, f64 velocity, f64 frequency, f64 sample_rate)
+    {
+        u32 found[SamplerVoice::LAYERS];
+        s32 key = std::clamp(note_id, 0, 127);
+        u32 count = bank.Find(current_preset, key, std::clamp(static_cast<s32>(std::lround(velocity * 127.0)), 0, 127), found, SamplerVoice::LAYERS);
+
+        v.serial = bank.serial;
+        v.layers = count;
+        for (u32 l = 0; l < count; l++)
+        {
+            SamplerLayer& layer = v.layer[l];
+            const SoundFontRegion& r = bank.regions[found[l]];
+
+            // The note frequency carries the tuning table, the region retunes it from its root key
+            f64 cents = r.tune + (key - r.root_key) * (r.scale_tuning - 100.0);
+            layer.ratio    = frequency / note_freq(r.root_key) * std::exp2(cents / 1200.0) * r.sample_rate / sample_rate;
+            layer.gain     = r.gain;
+            layer.region   = found[l];
+            layer.position = 0.0;
+            layer.generation++;
+
+            // Consumed first: the reader reads it after it sees the request
+            layer.consumed.store(Stamp(layer.generation, 0), std::memory_order_release);
+            layer.request.store(Request(found[l], bank.serial, layer.generation, streaming), std::memory_order_release);
+        }
+    }
+
+    void RenderLayer(SamplerLayer& layer, const SoundFont& bank, f64* output, u32 samples, f64 pitch_from, f64 pitch_to)
+    {
+        const SoundFontRegion& r = bank.regions[layer.region];
+        const s16* preload = bank.preload.data() + r.preload;
+        if (r.Ended(static_cast<u64>(layer.position))) return;
+
+        // Frames of the stream this block can read
+        f64 pitch_step = (pitch_to - pitch_from) / samples;
+        f64 last = layer.position + layer.ratio * 0.5 * (pitch_from + pitch_to) * samples + 3.0;
+        u64 available = static_cast<u64>(last) + 1;
+        if (streaming && !r.Ended(r.preload_frames) && static_cast<u64>(last) >= r.preload_frames)
+        {
+            u64 filled = layer.filled.load(std::memory_order_acquire);
+            available = StampGeneration(filled) == (layer.generation & 0xFFFF) ? StampFrames(filled) : 0;
+            available = std::max<u64>(available, r.preload_frames);
+        }
+
+        // Stream frame, from the preload, the ring or the mapping when not streaming
+        auto frame = [&](s64 position) -> f64 {
+            if (position < 0 || r.Ended(position)) return 0.0;
+            if (position < r.preload_frames) return preload[position];
+            if (!streaming) return bank.Sample(r.Frame(position));
+            return static_cast<u64>(position) < available ? layer.ring[position & (SamplerLayer::RING - 1)] : 0.0;
+        };
+
+        // Underrun: the reader is behind, the block stays silent but keeps time
+        if (static_cast<u64>(last) >= available && !r.Ended(available))
+            underruns.fetch_add(1, std::memory_order_relaxed);
+
+        const f64 gain = layer.gain / 32768.0;
+        f64 position = layer.position;
+        for (u32 k = 0; k < samples; k++)
+        {
+            s64 i = static_cast<s64>(position);
+            f64 t = position - i;
+            f64 xm1 = frame(i - 1), x0 = frame(i), x1 = frame(i + 1), x2 = frame(i + 2);
+
+            // 4 point, 3rd order Hermite
+            f64 c1 = 0.5 * (x1 - xm1);
+            f64 c2 = xm1 - 2.5 * x0 + 2.0 * x1 - 0.5 * x2;
+            f64 c3 = 0.5 * (x2 - xm1) + 1.5 * (x0 - x1);
+            output[k] += gain * (((c3 * t + c2) * t + c1) * t + x0);
+
+            position += layer.ratio * (pitch_from + (k + 1) * pitch_step);
+        }
+        layer.position = position;
+
+        // The reader may now overwrite everything before the oldest frame the next block reads
+        if (streaming)
+            layer.consumed.store(Stamp(layer.generation, static_cast<u64>(std::max(0.0, position - 1.0))), std::memory_order_release);
+    }
+
+    // Top up the ring of one layer, true when frames were written
+    bool Fill(SamplerLayer& layer, const SoundFont* bank)
+    {
+        u64 request = layer.request.load(std::memory_order_acquire);
+        if (!(request & 1) || !bank || ((request >> 24) & 0xFF) != (bank->serial & 0xFF)) return false;
+
+        u32 region = static_cast<u32>(request >> 32);
+        u32 generation = static_cast<u32>(request >> 8) & 0xFFFF;
+        if (region >= bank->regions.size()) return false;
+        const SoundFontRegion& r = bank->regions[region];
+        if (generation != layer.reader_generation)
+        {
+            layer.reader_generation = generation;
+            layer.written = r.preload_frames;
+        }
+
+        u64 consumed = layer.consumed.load(std::memory_order_acquire);
+        u64 limit = (StampGeneration(consumed) == generation ? StampFrames(consumed) : 0) + SamplerLayer::RING;
+        if (!r.loop) limit = std::min(limit, r.Lead());
+        if (layer.written >= limit) return false;
+
+        u64 end = std::min<u64>(limit, layer.written + CHUNK);
+        for (u64 p = layer.written; p < end; p++)
+            layer.ring[p & (SamplerLayer::RING - 1)] = bank->Sample(r.Frame(p));
+        layer.written = end;
+        layer.filled.store(Stamp(generation, end), std::memory_order_release);
+        return true;
+    }
+
+    void StartReader()
+    {
+        if (reader_running) return;
+        reader_running = true;
+        reader = std::thread(&Sampler::ReadAhead, this);
+    }
+
+    void StopReader()
+    {
+        reader_running = false;
+        if (reader.joinable()) reader.join();
+    }
+
+public:
+    // Preset index in the bank, any thread
+    std::atomic<s32> preset = 0;
+    // Stream from a reader thread, set before the first Load. Offline rendering runs faster than real time,
+    // so it reads the mapping directly instead
+    bool streaming = true;
+    std::atomic<u64> underruns = 0;
+
+private:
+    Published<SoundFont> font;
+    s32 current_preset = 0;
+    std::unique_ptr<SamplerVoice[]> voices;
+
+    std::thread reader;
+    std::atomic<bool> reader_running = false;
+};
\ No newline at end of file
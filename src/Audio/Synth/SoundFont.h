@@ -0,0 +1,372 @@
+#pragma once
+
+#include <cmath>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+#include "../../Core/MappedFile.h"
+
+// SoundFont 2 bank: the sample pool stays in the memory-mapped file, only the parameter chunks are parsed,
+// every preset is flattened into a list of regions (one instrument zone inside one preset zone each).
+// The first PRELOAD frames a region plays are copied out at load, so a note sounds at once and the
+// rest of the sample is read from disk while the attack plays.
+// SoundFont 2.04 specification: https://www.synthfont.com/sfspec24.pdf
+struct SoundFontRegion
+{
+    u8 key_lo = 0;
+    u8 key_hi = 127;
+    u8 vel_lo = 0;
+    u8 vel_hi = 127;
+
+    // Sample frames in the smpl chunk, end and loop end are one past the last frame
+    u32 start      = 0;
+    u32 end        = 0;
+    u32 loop_start = 0;
+    u32 loop_end   = 0;
+    bool loop      = false;
+
+    u32 sample_rate    = 44100;
+    s32 root_key       = 60;
+    f64 tune           = 0.0;   // cents
+    f64 scale_tuning   = 100.0; // cents per key
+    f64 gain           = 1.0;   // initial attenuation
+    f64 pan            = 0.0;   // -1 left to 1 right
+    u32 preload        = 0;     // first frame in the preload pool
+    u32 preload_frames = 0;
+
+    // The region is played as one unrolled stream: start to loop end, then the loop forever.
+    // Frames before the stream starts repeating, the whole sample when it does not loop
+    u64 Lead() const { return loop ? loop_end - start : end - start; }
+
+    // Sample frame at a position of the unrolled stream
+    u32 Frame(u64 position) const
+    {
+        if (position < Lead()) return start + static_cast<u32>(position);
+        return loop_start + static_cast<u32>((position - Lead()) % (loop_end - loop_start));
+    }
+
+    bool Ended(u64 position) const { return !loop && position >= Lead(); }
+};
+
+struct SoundFontPreset
+{
+    std::string name;
+    u16 bank    = 0;
+    u16 program = 0;
+    u32 first   = 0; // regions [first, first + count)
+    u32 count   = 0;
+};
+
+struct SoundFont
+{
+    static constexpr u32 PRELOAD = 4096; // frames, about 90 ms at 44.1 kHz
+
+    // Generators used, numbered as in section 8.1.2 of the specification
+    enum Generator : u16
+    {
+        START_OFFSET = 0, END_OFFSET = 1, LOOP_START_OFFSET = 2, LOOP_END_OFFSET = 3, START_COARSE_OFFSET = 4,
+        END_COARSE_OFFSET = 12, PAN = 17, INSTRUMENT = 41, KEY_RANGE = 43, VEL_RANGE = 44, LOOP_START_COARSE_OFFSET = 45,
+        INITIAL_ATTENUATION = 48, LOOP_END_COARSE_OFFSET = 50, COARSE_TUNE = 51, FINE_TUNE = 52, SAMPLE_ID = 53,
+        SAMPLE_MODES = 54, SCALE_TUNING = 56, OVERRIDING_ROOT_KEY = 58, GENERATOR_COUNT = 61
+    };
+
+public:
+    // Sample frame of the pool, reading it may page fault: never on the audio thread while streaming
+    s16 Sample(u32 frame) const
+    {
+        s16 x;
+        std::memcpy(&x, samples + 2 * static_cast<size_t>(frame), 2);
+        return x;
+    }
+
+    // Regions of a preset sounding for a key and velocity, at most max_regions
+    u32 Find(s32 preset, s32 key, s32 velocity, u32* found, u32 max_regions) const
+    {
+        if (preset < 0 || preset >= static_cast<s32>(presets.size())) return 0;
+        const SoundFontPreset& p = presets[preset];
+        u32 count = 0;
+        for (u32 r = p.first; r < p.first + p.count && count < max_regions; r++)
+        {
+            const SoundFontRegion& region = regions[r];
+            if (key >= region.key_lo && key <= region.key_hi && velocity >= region.vel_lo && velocity <= region.vel_hi)
+                found[count++] = r;
+        }
+        return count;
+    }
+
+    // Map the file and parse the bank, on failure error holds the reason
+    bool Load(const std::string& filename, std::string& error)
+    {
+        if (!file.Open(filename, error))
+            return false;
+
+        const u8* data = file.data;
+        const u8* riff_end = data + file.size;
+        if (file.size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "sfbk", 4) != 0)
+        {
+            error = filename + ": not a SoundFont 2 file";
+            return false;
+        }
+
+        // Top level LIST chunks: INFO, sdta (sample data), pdta (parameters)
+        Chunk pdta[9] = {};
+        static const char* PDTA[9] = { "phdr", "pbag", "pmod", "pgen", "inst", "ibag", "imod", "igen", "shdr" };
+        for (const u8* p = data + 12; p + 12 <= riff_end;)
+        {
+            u32 size = read32(p + 4);
+            const u8* body = p + 8;
+            const u8* next = body + size + (size & 1);
+            if (next > riff_end) next = riff_end;
+
+            if (std::memcmp(p, "LIST", 4) == 0)
+            {
+                for (const u8* q = body + 4; q + 8 <= next;)
+                {
+                    u32 sub_size = std::min<u32>(read32(q + 4), static_cast<u32>(next - q - 8));
+                    if (std::memcmp(body, "sdta", 4) == 0 && std::memcmp(q, "smpl", 4) == 0)
+                    {
+                        samples = q + 8;
+                        sample_frames = sub_size / 2;
+                    }
+                    else if (std::memcmp(body, "INFO", 4) == 0 && std::memcmp(q, "INAM", 4) == 0)
+                    {
+                        name.assign(reinterpret_cast<const char*>(q + 8), strnlen(reinterpret_cast<const char*>(q + 8), sub_size));
+                    }
+                    else if (std::memcmp(body, "pdta", 4) == 0)
+                    {
+                        for (s32 i = 0; i < 9; i++)
+                            if (std::memcmp(q, PDTA[i], 4) == 0) pdta[i] = { q + 8, sub_size };
+                    }
+                    q += 8 + sub_size + (sub_size & 1);
+                }
+            }
+            p = next;
+        }
+
+        // Record sizes from section 7 of the specification, each list ends with a terminal record
+        static const u32 RECORD[9] = { 38, 4, 10, 4, 22, 4, 10, 4, 46 };
+        for (s32 i = 0; i < 9; i++)
+        {
+            if (!pdta[i].data || pdta[i].size < RECORD[i])
+            {
+                error = filename + ": missing or empty " + PDTA[i] + " chunk";
+                return false;
+            }
+            pdta[i].count = pdta[i].size / RECORD[i];
+        }
+        if (!samples || sample_frames == 0)
+        {
+            error = filename + ": no sample data";
+            return false;
+        }
+
+        const Chunk& phdr = pdta[0];
+        const Chunk& pbag = pdta[1];
+        const Chunk& pgen = pdta[3];
+        const Chunk& inst = pdta[4];
+        const Chunk& ibag = pdta[5];
+        const Chunk& igen = pdta[7];
+        const Chunk& shdr = pdta[8];
+
+        for (u32 p = 0; p + 1 < phdr.count; p++)
+        {
+            const u8* header = phdr.data + p * 38;
+            SoundFontPreset preset;
+            preset.name.assign(reinterpret_cast<const char*>(header), strnlen(reinterpret_cast<const char*>(header), 20));
+            preset.program = read16(header + 20);
+            preset.bank    = read16(header + 22);
+            preset.first   = static_cast<u32>(regions.size());
+
+            // Preset zones, the first one is global when it names no instrument
+            u32 bag_first = read16(header + 24), bag_last = read16(header + 38 + 24);
+            Zone preset_global;
+            for (u32 b = bag_first; b < bag_last && b + 1 < pbag.count; b++)
+            {
+                Zone zone = preset_global;
+                bool global = !ReadZone(pbag, pgen, b, zone);
+                if (global)
+                {
+                    if (b == bag_first) preset_global = zone;
+                    continue;
+                }
+                u32 instrument = static_cast<u16>(zone.value[INSTRUMENT]);
+                if (instrument + 1 >= inst.count) continue;
+
+                // Instrument zones, the first one is global when it names no sample
+                const u8* ih = inst.data + instrument * 22;
+                u32 ibag_first = read16(ih + 20), ibag_last = read16(ih + 22 + 20);
+                Zone instrument_global = Zone::Defaults();
+                for (u32 ib = ibag_first; ib < ibag_last && ib + 1 < ibag.count; ib++)
+                {
+                    Zone local = instrument_global;
+                    bool has_sample = ReadZone(ibag, igen, ib, local, SAMPLE_ID);
+                    if (!has_sample)
+                    {
+                        if (ib == ibag_first) instrument_global = local;
+                        continue;
+                    }
+
+                    SoundFontRegion region;
+                    if (MakeRegion(zone, local, shdr, region))
+                        regions.push_back(region);
+                }
+            }
+
+            preset.count = static_cast<u32>(regions.size()) - preset.first;
+            if (preset.count > 0) presets.push_back(preset);
+        }
+
+        if (presets.empty())
+        {
+            error = filename + ": no playable presets";
+            return false;
+        }
+
+        // Presets ordered as a MIDI bank select and program change would find them
+        std::stable_sort(presets.begin(), presets.end(), [](const SoundFontPreset& a, const SoundFontPreset& b) {
+            return a.bank != b.bank ? a.bank < b.bank : a.program < b.program;
+        });
+
+        Preload();
+        serial = next_serial().fetch_add(1) + 1;
+        if (name.empty()) name = filename;
+        return true;
+    }
+
+private:
+    struct Chunk
+    {
+        const u8* data = nullptr;
+        u32 size  = 0;
+        u32 count = 0;
+    };
+
+    // Generator values of one zone, amounts as stored (ranges are packed low byte, high byte)
+    struct Zone
+    {
+        s16 value[GENERATOR_COUNT] = {};
+        bool set[GENERATOR_COUNT]  = {};
+
+        static Zone Defaults()
+        {
+            Zone z;
+            z.value[KEY_RANGE]           = 127 << 8;
+            z.value[VEL_RANGE]           = 127 << 8;
+            z.value[SCALE_TUNING]        = 100;
+            z.value[OVERRIDING_ROOT_KEY] = -1;
+            return z;
+        }
+    };
+
+    static u32 read32(const u8* p) { return u32(p[0]) | u32(p[1]) << 8 | u32(p[2]) << 16 | u32(p[3]) << 24; }
+    static u16 read16(const u8* p) { return u16(p[0] | p[1] << 8); }
+
+    // Generators of the zone of a bag over the current values, true when the terminal generator is present
+    static bool ReadZone(const Chunk& bags, const Chunk& gens, u32 bag, Zone& zone, u16 terminal = INSTRUMENT)
+    {
+        u32 first = read16(bags.data + bag * 4), last = read16(bags.data + (bag + 1) * 4);
+        bool found = false;
+        for (u32 g = first; g < last && g + 1 < gens.count; g++)
+        {
+            const u8* gen = gens.data + g * 4;
+            u16 oper = read16(gen);
+            if (oper >= GENERATOR_COUNT) continue;
+            zone.value[oper] = static_cast<s16>(read16(gen + 2));
+            zone.set[oper]   = true;
+            found |= oper == terminal;
+        }
+        return found;
+    }
+
+    // Intersection of two packed ranges, false when empty
+    static bool Intersect(s16 a, s16 b, u8& lo, u8& hi)
+    {
+        lo = std::max(u8(a & 0xFF), u8(b & 0xFF));
+        hi = std::min(u8((a >> 8) & 0xFF), u8((b >> 8) & 0xFF));
+        return lo <= hi;
+    }
+
+    // One instrument zone under one preset zone: preset generators offset the instrument ones (section 9.4)
+    bool MakeRegion(const Zone& preset, const Zone& instrument, const Chunk& shdr, SoundFontRegion& region) const
+    {
+        u32 sample = static_cast<u16>(instrument.value[SAMPLE_ID]);
+        if (sample + 1 >= shdr.count) return false;
+        const u8* header = shdr.data + sample * 46;
+        if (read16(header + 44) & 0x8000) return false; // ROM sample
+
+        Zone full = Zone::Defaults();
+        u8 key_lo, key_hi, vel_lo, vel_hi;
+        if (!Intersect(preset.set[KEY_RANGE] ? preset.value[KEY_RANGE] : full.value[KEY_RANGE], instrument.value[KEY_RANGE], key_lo, key_hi) ||
+            !Intersect(preset.set[VEL_RANGE] ? preset.value[VEL_RANGE] : full.value[VEL_RANGE], instrument.value[VEL_RANGE], vel_lo, vel_hi))
+            return false;
+        region.key_lo = key_lo;
+        region.key_hi = std::min<u8>(key_hi, 127);
+        region.vel_lo = vel_lo;
+        region.vel_hi = std::min<u8>(vel_hi, 127);
+
+        auto offset = [&instrument](Generator fine, Generator coarse) { return s64(instrument.value[fine]) + 32768 * s64(instrument.value[coarse]); };
+        auto frame  = [this](s64 x) { return static_cast<u32>(std::clamp<s64>(x, 0, sample_frames)); };
+        region.start      = frame(read32(header + 20) + offset(START_OFFSET,      START_COARSE_OFFSET));
+        region.end        = frame(read32(header + 24) + offset(END_OFFSET,        END_COARSE_OFFSET));
+        region.loop_start = frame(read32(header + 28) + offset(LOOP_START_OFFSET, LOOP_START_COARSE_OFFSET));
+        region.loop_end   = frame(read32(header + 32) + offset(LOOP_END_OFFSET,   LOOP_END_COARSE_OFFSET));
+        if (region.end <= region.start) return false;
+
+        // Modes 1 and 3 loop, 3 should play on to the end after the release: the amplitude envelope ends it here
+        s16 mode = instrument.value[SAMPLE_MODES] & 3;
+        region.loop = (mode == 1 || mode == 3) && region.loop_start >= region.start &&
+            region.loop_end <= region.end && region.loop_end > region.loop_start;
+
+        region.sample_rate = std::max<u32>(read32(header + 36), 1);
+        u8 original_key = header[40];
+        s8 correction   = static_cast<s8>(header[41]);
+        region.root_key = instrument.value[OVERRIDING_ROOT_KEY] >= 0 ? instrument.value[OVERRIDING_ROOT_KEY] : (original_key <= 127 ? original_key : 60);
+
+        region.tune = 100.0 * (instrument.value[COARSE_TUNE] + preset.value[COARSE_TUNE]) +
+            instrument.value[FINE_TUNE] + preset.value[FINE_TUNE] + correction;
+        region.scale_tuning = instrument.value[SCALE_TUNING] + preset.value[SCALE_TUNING];
+
+        // Attenuation in centibels, pan in tenths of a percent
+        f64 attenuation = std::max(0, instrument.value[INITIAL_ATTENUATION] + preset.value[INITIAL_ATTENUATION]);
+        region.gain = std::pow(10.0, -attenuation / 200.0);
+        region.pan  = std::clamp((instrument.value[PAN] + preset.value[PAN]) / 500.0, -1.0, 1.0);
+        return true;
+    }
+
+    // Copy the first frames every region plays, these pages are the only ones read at load
+    void Preload()
+    {
+        size_t total = 0;
+        for (SoundFontRegion& r : regions)
+        {
+            r.preload_frames = static_cast<u32>(r.loop ? PRELOAD : std::min<u64>(PRELOAD, r.Lead()));
+            r.preload = static_cast<u32>(total);
+            total += r.preload_frames;
+        }
+
+        preload.resize(total);
+        for (const SoundFontRegion& r : regions)
+            for (u32 i = 0; i < r.preload_frames; i++)
+                preload[r.preload + i] = Sample(r.Frame(i));
+    }
+
+    static std::atomic<u32>& next_serial()
+    {
+        static std::atomic<u32> serial = 0;
+        return serial;
+    }
+
+public:
+    std::string name;
+    MappedFile file;
+    const u8* samples = nullptr;  // smpl chunk in the mapping, 16 bit little endian frames
+    u32 sample_frames = 0;
+    std::vector<SoundFontPreset> presets;
+    std::vector<SoundFontRegion> regions;
+    std::vector<s16> preload;
+    u32 serial = 0;               // tells banks apart, 0 is no bank
+};
\ No newline at end of file
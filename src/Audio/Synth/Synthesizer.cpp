@@ -10,9 +10,9 @@ Synthesizer::Synthesizer()
     // Oscillator
     // Harpischord
     /*
-    oscillators["OSC1"] = Oscillator(0.8,  0, Oscillator::Type::WAVE_SINE);
-    oscillators["OSC2"] = Oscillator(0.3, 12, Oscillator::Type::WAVE_ANLG_SAWTOOTH);
-    oscillators["OSC3"] = Oscillator(0.1, 24, Oscillator::Type::WAVE_ANLG_SAWTOOTH);
+    AddOscillator("OSC1", Oscillator(0.8,  0, Oscillator::Type::WAVE_SINE));
+    AddOscillator("OSC2", Oscillator(0.3, 12, Oscillator::Type::WAVE_ANLG_SAWTOOTH));
+    AddOscillator("OSC3", Oscillator(0.1, 24, Oscillator::Type::WAVE_ANLG_SAWTOOTH));
     m_amp_envelope = {
         .attack_time       = 0.3,
         .decay_time        = 1.0,
@@ -23,9 +23,9 @@ Synthesizer::Synthesizer()
     };
     */
     // Organ
-    oscillators["OSC1"] = Oscillator(0.8,  0, Oscillator::Type::WAVE_SINE);
-    oscillators["OSC2"] = Oscillator(0.3, 12, Oscillator::Type::WAVE_SINE);
-    oscillators["OSC3"] = Oscillator(0.1, 24, Oscillator::Type::WAVE_SINE);
+    AddOscillator("OSC1", Oscillator(0.8,  0, Oscillator::Type::WAVE_SINE));
+    AddOscillator("OSC2", Oscillator(0.3, 12, Oscillator::Type::WAVE_SINE));
+    AddOscillator("OSC3", Oscillator(0.1, 24, Oscillator::Type::WAVE_SINE));
     // ADSR
     m_amp_envelope = {
         .attack_time = 0.2,
@@ -35,6 +35,14 @@ Synthesizer::Synthesizer()
         .start_amplitude = 1.0,
         .decay_function = Envelope::Decay::EXPONENTIAL
     };
+    m_filter_envelope = {
+        .attack_time = 0.1,
+        .decay_time = 0.5,
+        .sustain_amplitude = 0.5,
+        .release_time = 1.0,
+        .start_amplitude = 1.0,
+        .decay_function = Envelope::Decay::EXPONENTIAL
+    };
 
     // LFO
     m_lfo = Oscillator(0.01, 0, Oscillator::Type::WAVE_SINE);
@@ -58,11 +66,23 @@ Synthesizer::Synthesizer()
     };
     m_vafilter.CalcCoefs(2000.0, 0.5);
 
+    m_ladder = {
+        .frequency        = 2000.0,
+        .resonance        = 0.5,
+        .sample_rate      = SAMPLE_RATE,
+    };
+    m_ladder.CalcCoefs(2000.0, 0.5);
+
+    // Distortion
+    m_distortion.Update();
+    m_master_distortion.Update();
+
     // Delay
     m_delay.bpm          = 120;
     m_delay.beat         = 3;
     m_delay.beat_per_bar = 4;
     m_delay.feedback     = 0.7;
+    m_delay.ping_pong    = false;
     m_delay.offset       = 0;
 
     // Reverb
@@ -72,6 +92,7 @@ Synthesizer::Synthesizer()
     m_reverb.decay  = 1.0;
     m_reverb.dry    = 0.0;
     m_reverb.wet    = 0.0;
+    m_reverb.width  = 1.0;
 
     m_reverb.ComputeFilterDelays();
 
@@ -85,55 +106,69 @@ f64 Synthesizer::Synthesize(f64 time_step, note n, bool& note_finished)
     return 0.0;
 }
 
-void Synthesizer::ProcessNoteInput(f64 time, s32 key, s32 note_id)
+bool Synthesizer::NoteOn(f64 time, s32 note_id, f64 velocity)
 {
-    Input& input = Input::Instance();
-
     // Check if note is already active
     auto note_found = std::find_if(notes.begin(), notes.end(), [note_id](const note& n) { return n.id == note_id; });
     if (note_found == notes.end())
     {
-        if (input.IsKeyHeld(key))
-        {
-            // Note is not active, so create and add a new note
-            note n;
-            n.id = note_id;
-            n.on = time;
-            n.off = -1.0;
-            n.channel = 0;
-            n.active = true;
-            notes.emplace_back(n);
-
-            // UI link
-            m_piano.down(note_id, 1);
-            //std::cout << note_id << std::endl;
-        }
+        // Note is not active, so create and add a new note
+        note n;
+        n.id = note_id;
+        n.on = time;
+        n.off = -1.0;
+        n.channel = 0;
+        n.active = true;
+        n.pan = std::clamp(m_pan_spread * (note_id - 60) / 48.0, -1.0, 1.0);
+        n.velocity = velocity;
+        n.seed = ++m_note_seed;
+        notes.emplace_back(n);
+        return true;
+    }
+    else if (note_found->off > note_found->on)
+    {
+        // Note has been pressed again during release phase
+        note_found->on = time;
+        note_found->off = -1.0;
+        note_found->active = true;
+        note_found->retriggered = true;
+        note_found->velocity = velocity;
+        note_found->clock = 0.0;
+        note_found->lfo_phase = 0.0;
+        note_found->seed = ++m_note_seed;
+        return true;
+    }
+    return false;
+}
+
+void Synthesizer::NoteOff(f64 time, s32 note_id)
+{
+    auto note_found = std::find_if(notes.begin(), notes.end(), [note_id](const note& n) { return n.id == note_id; });
+    if (note_found != notes.end() && note_found->off < note_found->on)
+        note_found->off = time;
+}
+
+void Synthesizer::ControlChange(u8 controller, f64 value)
+{
+    m_mod_matrix.ControlChange(controller, value);
+}
+
+void Synthesizer::ProcessNoteInput(f64 time, s32 key, s32 note_id)
+{
+    Input& input = Input::Instance();
+
+    bool note_found = std::any_of(notes.begin(), notes.end(), [note_id](const note& n) { return n.id == note_id; });
+    if (input.IsKeyHeld(key))
+    {
+        // UI link, only when the key struck the note
+        if (NoteOn(time, note_id)) m_piano.down(note_id, 1);
     }
-    else
+    else if (note_found)
     {
-        if (input.IsKeyHeld(key))
-        {
-            // Key is still held, so do nothing
-            if (note_found->off > note_found->on)
-            {
-                // Key has been pressed again during release phase
-                note_found->on = time;
-                note_found->active = true;
-                note_found->retriggered = true;
-
-                // UI link
-                m_piano.down(note_found->id, 1);
-            }
-        }
-        else
-        {
-            if (note_found->off < note_found->on)
-                note_found->off = time;
-
-            // UI link
-            m_piano.up(note_found->id);
-            //std::cout << note_id << std::endl;
-        }
+        NoteOff(time, note_id);
+
+        // UI link
+        m_piano.up(note_id);
     }
 }
 
@@ -206,14 +241,41 @@ f64 Synthesizer::GetMasterVolume()
     return m_master_volume;
 }
 
-Oscillator& Synthesizer::GetOscillator(std::string id)
+s32 Synthesizer::AddOscillator(const std::string& name, const Oscillator& osc)
+{
+    if (m_oscillator_count >= MAX_OSCILLATORS)
+    {
+        std::printf("ERROR: Oscillator %s: all %d slots in use\n", name.c_str(), MAX_OSCILLATORS);
+        return -1;
+    }
+
+    s32 slot = m_oscillator_count++;
+    oscillators[slot] = osc;
+    oscillators_cold[slot].name = name;
+    return slot;
+}
+
+s32 Synthesizer::FindOscillator(const std::string& name) const
+{
+    for (u32 slot = 0; slot < m_oscillator_count; slot++)
+        if (oscillators_cold[slot].name == name)
+            return slot;
+    return -1;
+}
+
+u32 Synthesizer::OscillatorCount() const
+{
+    return m_oscillator_count;
+}
+
+Oscillator& Synthesizer::GetOscillator(u32 slot)
 {
-    return oscillators[id];
+    return oscillators[slot];
 }
 
-std::unordered_map<std::string, Oscillator>& Synthesizer::GetOscillators()
+OscillatorCold& Synthesizer::GetOscillatorCold(u32 slot)
 {
-    return oscillators;
+    return oscillators_cold[slot];
 }
 
 const WaveData& Synthesizer::GetWaveData()
@@ -60,8 +60,9 @@
 */
 #pragma once
 
+#include <array>
 #include <vector>
-#include <unordered_map>
+#include <string>
 #include <glfw3.h>
 
 #include "../../Core/Common.h"
@@ -69,17 +70,25 @@
 #include "../../GUI/Piano.h"
 
 #include "Oscillator.h"
+#include "FrequencyModulator.h"
+#include "Tonewheel.h"
+#include "Additive.h"
+#include "Sampler.h"
+#include "Granular.h"
+#include "Waveguide.h"
+#include "Modal.h"
 #include "Envelope.h"
+#include "Modulation.h"
 #include "Filter.h"
+#include "Distortion.h"
 #include "Reverb.h"
 #include "Delay.h"
 #include "Equalizer.h"
+#include "Multiband.h"
 
 // FEATURES
 	// TODO: Effects: Chorus
 	// TODO: Effects: Echo
-	// TODO: Low-Frequency Oscillator: Frequency Modulation
-	// TODO: Filter Envelope
 
 	// TODO: Basic Instruments
 	// TODO: Sequencer
@@ -89,7 +98,6 @@
 	// TODO: Track
 	// TODO: Record
 	// TODO: Playback
-	// TODO: .wav output support
 	// TODO: .midi input support
 
 	// TODO: Node-based interface
@@ -127,6 +135,24 @@
 	// DONE: Select Audio Output Device: Enumerate and select from drop down menu
 	// DONE: Equalizer
 	// DONE: Graphical Equalizer
+	// DONE: .wav output support: headless offline renderer (synth_render)
+	// DONE: Stereo: per-voice and per-oscillator pan, stereo delay, reverb and equalizer
+	// DONE: Low-Frequency Oscillator: Frequency Modulation (control rate, key sync, tempo sync)
+	// DONE: Modulation matrix: LFO, envelopes, velocity, note, CC to pitch, volume, pan, filter, effects
+	// DONE: Filter Envelope (modulation matrix source)
+	// DONE: Frequency Modulation: 6 operators, DX style algorithms, feedback, operator envelopes
+	// DONE: Microtuning: Scala scales (.scl) and keyboard mappings (.kbm), precomputed tuning tables
+	// DONE: Tonewheel organ: 91 shared wheels, drawbars, cost independent of the number of keys
+	// DONE: Additive synthesis: inverse FFT overlap-add, harmonic recurrence, resynthesis of WAV files
+	// DONE: Unison: up to 16 detuned copies per oscillator in SIMD lanes, stereo spread, random phase
+	// DONE: Sampler: SoundFont 2 banks, memory-mapped sample pool, preloaded attacks, streaming from disk
+	// DONE: Granular synthesis: pooled grains from a recording or the live output, position, spray, pitch, density
+	// DONE: Physical models: Karplus-Strong pluck, plucked string and clarinet tube waveguides, pooled delay lines
+	// DONE: Modal synthesis: struck bells, bars and plates, or the modes of a recording, as culled SIMD resonator banks
+	// DONE: Ladder filter: zero-delay feedback, tanh saturation, per-voice 2x/4x polyphase oversampling under drive
+	// DONE: Linear phase equalizer: FIR of the band cascade, partitioned FFT convolution, redesigned off the audio thread
+	// DONE: Multiband dynamics: Linkwitz-Riley crossovers, per-band compression and expansion at control rate
+	// DONE: Distortion: tanh, hard clip, foldback and asymmetric curves, antiderivative anti-aliasing, per voice and master
 
 struct WaveData
 {
@@ -139,6 +165,24 @@ struct WaveData
 // Modular Synthesizer
 class Synthesizer
 {
+public:
+	// Voice engine shared by all notes
+	enum class Synthesis : u8
+	{
+		SUBTRACTIVE,
+		FREQUENCY_MODULATION,
+		TONEWHEEL,
+		ADDITIVE,
+		SAMPLER,
+		GRANULAR,
+		WAVEGUIDE,
+		MODAL,
+		COUNT
+	};
+	static constexpr const char* SYNTHESIS_NAMES[] = { "Subtractive", "FM", "Tonewheel", "Additive", "Sampler", "Granular", "Waveguide", "Modal" };
+
+	static constexpr u32 MAX_OSCILLATORS = 8;
+
 public:
 	Synthesizer();
 
@@ -148,6 +192,11 @@ public:
 	void Render();
 
 	f64 Synthesize(f64 time_step, note n, bool& note_finished);
+	// True when the note was struck, new or again from its release
+	bool NoteOn(f64 time, s32 note_id, f64 velocity = 1.0);
+	void NoteOff(f64 time, s32 note_id);
+	// MIDI CC, value in [0, 1], read by the modulation matrix
+	void ControlChange(u8 controller, f64 value);
 	// TODO: reduce to press and release, define the key map elsewhere in the application
 	void ProcessNoteInput(f64 time, s32 key, s32 note_id);
 
@@ -161,29 +210,57 @@ public:
 	const WaveData& GetWaveData();
 	void UpdateWaveData(u32 frame, f64 sample);
 
-	Oscillator& GetOscillator(std::string id);
-	std::unordered_map<std::string, Oscillator>& GetOscillators();
+	// Oscillator slots, addressed by index: the name lookup is for setup code, not per frame
+	s32 AddOscillator(const std::string& name, const Oscillator& osc); // slot, -1 when full
+	s32 FindOscillator(const std::string& name) const;
+	u32 OscillatorCount() const;
+	Oscillator& GetOscillator(u32 slot);
+	OscillatorCold& GetOscillatorCold(u32 slot);
 
 public:
 	f64 m_master_volume;
 	f64 m_max_frequency;
+	// Voice pan follows the key: low notes left, high notes right
+	f64 m_pan_spread = 0.0;
+	// Counts note ons, seeds the unison phases of each voice
+	u32 m_note_seed = 0;
 	bool m_playing;
+	Synthesis m_synthesis = Synthesis::SUBTRACTIVE;
 
 	// Notes
 	std::vector<note> notes;
 
 	// Modules
-	std::unordered_map<std::string, Oscillator> oscillators;
+	// Hot parameter records contiguous and cache aligned, cold state (names, noise generators, custom functions) apart
+	std::array<Oscillator, MAX_OSCILLATORS> oscillators;
+	std::array<OscillatorCold, MAX_OSCILLATORS> oscillators_cold;
+	u32 m_oscillator_count = 0;
 	Envelope m_amp_envelope;
 	Envelope m_filter_envelope;
 	BqFilter m_filter;
 	VAFilter m_vafilter;
+	LadderFilter m_ladder;
 	Oscillator m_lfo;
+	OscillatorCold m_lfo_cold;
+	LfoControl m_lfo_control;
+	ModMatrix m_mod_matrix;
+	FrequencyModulator m_fm;
+	Tonewheel m_tonewheel;
+	Additive m_additive;
+	Sampler m_sampler;
+	Granular m_granular;
+	Waveguide m_waveguide;
+	Modal m_modal;
 
 	// Sample Buffer for processing and visualization
 	WaveData wave_data;
 
 	bool vafilter = false;
+	bool ladder = false;
+
+	// Per voice, before the filter
+	bool distortion = false;
+	Distortion m_distortion;
 	Piano m_piano;
 
 	bool delay = false;
@@ -194,4 +271,11 @@ public:
 
 	bool eq = false;
 	Equalizer m_eq;
+
+	// Master bus, off until switched on
+	bool multiband = false;
+	MultibandDynamics m_multiband;
+
+	bool master_distortion = false;
+	Distortion m_master_distortion;
 };
\ No newline at end of file
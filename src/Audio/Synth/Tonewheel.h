@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+#include "FrequencyModulator.h"
+#include "Tuning.h"
+
+// Tonewheel organ: one fixed bank of sine generators shared by every key, as in a Hammond generator.
+// Keys only add their drawbar levels to the wheels they tap, the wheels are rendered once into a bus,
+// so holding 60 notes costs nearly the same as holding one.
+// Hammond tonewheel generator: https://electricdruid.net/technical-aspects-of-the-hammond-organ/
+// Drawbars: https://www.hammond-organ.com/drawbars
+struct Tonewheel
+{
+    static constexpr s32 WHEELS     = 91;
+    static constexpr s32 WHEEL_NOTE = 24;   // wheel 1 is C1, wheel 91 is F#8
+    static constexpr s32 DRAWBARS   = 9;
+    static constexpr u32 MAX_BLOCK  = 64;
+
+    // Drawbar footages as semitones above or below the key: 16', 5 1/3', 8', 4', 2 2/3', 2', 1 3/5', 1 1/3', 1'
+    static constexpr s32 FOOTAGE[DRAWBARS] = { -12, 7, 0, 12, 19, 24, 28, 31, 36 };
+    static constexpr const char* FOOTAGE_NAMES[DRAWBARS] = { "16'", "5 1/3'", "8'", "4'", "2 2/3'", "2'", "1 3/5'", "1 1/3'", "1'" };
+
+public:
+    // Start of a control block: forget the key levels of the previous one and read the registration
+    void BeginBlock()
+    {
+        std::fill(std::begin(target), std::end(target), 0.0);
+
+        // The drawbar mix of a key sums to one
+        f64 total = 0.0;
+        for (s32 d = 0; d < DRAWBARS; d++)
+        {
+            mix[d] = DrawbarGain(drawbars[d]);
+            total += mix[d];
+        }
+        for (s32 d = 0; d < DRAWBARS; d++)
+            mix[d] = total > 0.0 ? mix[d] / total : 0.0;
+    }
+
+    // Add one held key at the given level: nine additions, whatever the number of keys
+    void AddKey(s32 note, f64 level)
+    {
+        if (level <= 0.0) return;
+        for (s32 d = 0; d < DRAWBARS; d++)
+            target[Wheel(note + FOOTAGE[d])] += mix[d] * level;
+    }
+
+    // Render the bus for one control block, wheel levels ramp from the previous block to the keys added since
+    // BeginBlock. The whole bank ramps to the pitch ratio (the shared vibrato).
+    void Render(f64* output, u32 samples, f64 pitch_to, f64 sample_rate)
+    {
+        samples = std::min(samples, MAX_BLOCK);
+        const f64 pitch_from = pitch_ratio;
+        pitch_ratio = pitch_to;
+        const SineTable& sine = SineTable::Instance();
+        std::fill(output, output + samples, 0.0);
+
+        f64 pitch[MAX_BLOCK];
+        f64 pitch_step = (pitch_to - pitch_from) / samples;
+        for (u32 k = 0; k < samples; k++)
+            pitch[k] = pitch_from + (k + 1) * pitch_step;
+
+        for (s32 w = 0; w < WHEELS; w++)
+        {
+            f64 increment = Tuning::Instance().Frequency(WHEEL_NOTE + w) / sample_rate * 4294967296.0;
+            u32 phase = this->phase[w];
+
+            // Silent wheels keep spinning so a key pressed later joins them in phase
+            if (level[w] == 0.0 && target[w] == 0.0)
+            {
+                this->phase[w] = phase + static_cast<u32>(static_cast<s64>(increment * 0.5 * (pitch_from + pitch_to) * samples));
+                continue;
+            }
+
+            f64 g = level[w];
+            f64 step = (target[w] - g) / samples;
+            for (u32 k = 0; k < samples; k++)
+            {
+                g += step;
+                output[k] += g * sine.Lookup(phase);
+                phase += static_cast<u32>(increment * pitch[k]);
+            }
+            this->phase[w] = phase;
+            level[w] = target[w];
+        }
+    }
+
+    // Drawbar position 0 to 8, each step is 3 dB: https://electricdruid.net/technical-aspects-of-the-hammond-organ/
+    static f64 DrawbarGain(s32 position)
+    {
+        position = std::clamp(position, 0, 8);
+        return position == 0 ? 0.0 : std::pow(10.0, -3.0 * (8 - position) / 20.0);
+    }
+
+    // Wheel tapped by a note, notes past either end of the generator fold back by an octave
+    static s32 Wheel(s32 note)
+    {
+        while (note < WHEEL_NOTE)           note += 12;
+        while (note >= WHEEL_NOTE + WHEELS) note -= 12;
+        return note - WHEEL_NOTE;
+    }
+
+public:
+    // Registration, defaults to the 8', 4' and 2' mix of the oscillator organ preset
+    s32 drawbars[DRAWBARS] = { 0, 0, 8, 5, 0, 1, 0, 0, 0 };
+
+private:
+    u32 phase[WHEELS]  = {};
+    f64 level[WHEELS]  = {};  // wheel level reached at the end of the last block
+    f64 target[WHEELS] = {};  // wheel level requested by the keys of this block
+    f64 mix[DRAWBARS]  = {};  // drawbar gains of this block, normalized
+    f64 pitch_ratio    = 1.0; // vibrato reached at the end of the last block
+};
\ No newline at end of file
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+
+// Tuning tables: the frequency per note is precomputed, so pitch lookup is an array read.
+// Equal temperament by default, or any Scala scale (.scl) with an optional keyboard mapping (.kbm).
+// Tables are built off the audio thread and published, the audio thread picks up the newest one in Update.
+// Scala scale file format: https://www.huygens-fokker.org/scala/scl_format.html
+// Scala keyboard mapping: https://www.huygens-fokker.org/scala/help.htm#mappings
+// Surge tuning library: https://surge-synth-team.org/tuning-library/
+
+struct TuningTable
+{
+    // Notes below 0 and above 127 come from oscillator pitch offsets, so the table extends past MIDI
+    static constexpr s32 NOTE_MIN   = -64;
+    static constexpr s32 NOTE_COUNT = 256;
+
+    std::string name;
+    f64 frequency[NOTE_COUNT] = {};  // limited to the Nyquist frequency of the engine rate
+    bool ascending = true;           // frequencies never decrease with the note, so they can be bisected
+
+    static s32 Index(s32 note) { return std::clamp(note - NOTE_MIN, 0, NOTE_COUNT - 1); }
+};
+
+// Scale degrees in cents, the last one is the period (1200 for an octave repeating scale)
+struct Scale
+{
+    std::string description;
+    std::vector<f64> cents;
+
+    // Cents of a degree counted from the tonic, repeating every period
+    f64 Cents(s32 degree) const
+    {
+        s32 size = s32(cents.size());
+        s32 period = degree >= 0 ? degree / size : -((-degree + size - 1) / size);
+        s32 step = degree - period * size;
+        return period * cents.back() + (step == 0 ? 0.0 : cents[step - 1]);
+    }
+};
+
+// Which key plays which degree, and the reference frequency
+struct KeyboardMapping
+{
+    s32 first = 0;
+    s32 last = 127;
+    s32 middle = 60;              // key playing degree 0
+    s32 reference_note = 69;
+    f64 reference_frequency = 440.0;
+    s32 octave_degree = 0;        // degree the mapping repeats at, 0 uses the scale size
+    std::vector<s32> mapping;     // degree per key of the pattern, -1 unmapped, empty maps keys linearly
+
+    // Degree played by a key, false when the key is unmapped
+    bool Degree(s32 key, s32 scale_size, s32& degree) const
+    {
+        s32 offset = key - middle;
+        if (mapping.empty())
+        {
+            degree = offset;
+            return true;
+        }
+
+        s32 size = s32(mapping.size());
+        s32 repeats = offset >= 0 ? offset / size : -((-offset + size - 1) / size);
+        s32 entry = mapping[offset - repeats * size];
+        if (entry < 0) return false;
+
+        degree = entry + repeats * (octave_degree > 0 ? octave_degree : scale_size);
+        return true;
+    }
+};
+
+class Tuning
+{
+public:
+    static Tuning& Instance()
+    {
+        static Tuning instance;
+        return instance;
+    }
+
+    Tuning(const Tuning&) = delete;
+    void operator = (const Tuning&) = delete;
+
+public:
+    // Audio thread, once per block: switch to the newest published table
+    void Update()
+    {
+        const TuningTable* pending = m_pending.load(std::memory_order_acquire);
+        if (pending != m_active.load(std::memory_order_relaxed))
+            m_active.store(pending, std::memory_order_release);
+    }
+
+    f64 Frequency(s32 note) const { return Active().frequency[TuningTable::Index(note)]; }
+    std::string Name() const { return Active().name; }
+
+    // Nearest MIDI note to a frequency, in log distance
+    u32 ClosestNote(f64 frequency) const
+    {
+        const TuningTable& table = Active();
+        const s32 lo = TuningTable::Index(0);
+        const s32 hi = TuningTable::Index(127);
+
+        auto distance = [&table, frequency](s32 i) { return std::abs(std::log2(frequency / table.frequency[i])); };
+        s32 best = lo;
+        if (table.ascending)
+        {
+            // Bisect, then compare the two neighbours
+            const f64* begin = table.frequency + lo;
+            s32 i = s32(std::lower_bound(begin, table.frequency + hi + 1, frequency) - table.frequency);
+            best = std::min(i, hi);
+            if (best > lo && distance(best - 1) <= distance(best)) best--;
+        }
+        else
+        {
+            // Retuned keyboards need not be monotonic
+            for (s32 i = lo; i <= hi; i++)
+                if (table.frequency[i] > 0.0 && distance(i) < distance(best))
+                    best = i;
+        }
+        return u32(best - lo);
+    }
+
+    // 12 tone equal temperament around a reference pitch for A4
+    void SetEqualTemperament(f64 a4 = 440.0)
+    {
+        Scale scale = { "12-TET", {} };
+        for (s32 i = 1; i <= 12; i++) scale.cents.push_back(100.0 * i);
+
+        KeyboardMapping keyboard;
+        keyboard.reference_frequency = a4;
+        Apply(scale, keyboard, "12-TET A4 = " + std::to_string(s32(std::round(a4))) + " Hz");
+    }
+
+    // Engine rate: the tables are rebuilt when it changes. Call before the audio thread starts
+    void SetSampleRate(f64 sample_rate)
+    {
+        std::lock_guard<std::mutex> lock(m_source);
+        if (sample_rate == m_sample_rate) return;
+        m_sample_rate = sample_rate;
+        Publish(Build(m_scale, m_keyboard, m_name, m_sample_rate));
+    }
+
+    // Load a scale and an optional keyboard mapping, the current tuning stays on failure
+    bool LoadScala(const std::string& scl_path, const std::string& kbm_path, std::string& error)
+    {
+        Scale scale;
+        if (!ParseScale(scl_path, scale, error)) return false;
+
+        KeyboardMapping keyboard;
+        if (!kbm_path.empty() && !ParseKeyboardMapping(kbm_path, keyboard, error)) return false;
+
+        std::string name = scale.description.empty() ? scl_path : scale.description;
+        Apply(scale, keyboard, name);
+        std::printf("INFO: Tuning: %s (%zu notes)\n", name.c_str(), scale.cents.size());
+        return true;
+    }
+
+    static TuningTable Build(const Scale& scale, const KeyboardMapping& keyboard, const std::string& name, f64 sample_rate)
+    {
+        TuningTable table;
+        table.name = name;
+
+        const s32 size = s32(scale.cents.size());
+        s32 reference_degree = keyboard.reference_note - keyboard.middle;
+        keyboard.Degree(keyboard.reference_note, size, reference_degree);
+        const f64 reference_cents = scale.Cents(reference_degree);
+
+        f64 previous = 0.0;
+        for (s32 i = 0; i < TuningTable::NOTE_COUNT; i++)
+        {
+            s32 key = i + TuningTable::NOTE_MIN;
+            s32 degree = 0;
+            bool mapped = keyboard.Degree(key, size, degree);
+            if (key >= 0 && key <= 127 && (key < keyboard.first || key > keyboard.last)) mapped = false;
+
+            // Unmapped keys stay silent
+            f64 f = mapped ? keyboard.reference_frequency * std::exp2((scale.Cents(degree) - reference_cents) / 1200.0) : 0.0;
+            table.frequency[i] = std::min(f, 0.5 * sample_rate);
+
+            if (table.frequency[i] < previous) table.ascending = false;
+            previous = table.frequency[i];
+        }
+        return table;
+    }
+
+    static bool ParseScale(const std::string& path, Scale& scale, std::string& error)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+        {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(file, line);)
+        {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty() && line[0] == '!') continue;
+            lines.push_back(line);
+        }
+        if (lines.size() < 2)
+        {
+            error = path + ": missing description or note count";
+            return false;
+        }
+
+        scale.description = lines[0];
+        s32 count = std::atoi(lines[1].c_str());
+        if (count <= 0 || lines.size() < size_t(2 + count))
+        {
+            error = path + ": expected " + std::to_string(count) + " pitches";
+            return false;
+        }
+
+        for (s32 i = 0; i < count; i++)
+        {
+            // Cents contain a period, anything else is a ratio (a/b or a whole number)
+            std::istringstream pitch(lines[2 + i]);
+            std::string token;
+            pitch >> token;
+
+            f64 cents = 0.0;
+            if (token.find('.') != std::string::npos)
+            {
+                cents = std::atof(token.c_str());
+            }
+            else
+            {
+                size_t slash = token.find('/');
+                f64 numerator   = std::atof(token.substr(0, slash).c_str());
+                f64 denominator = slash == std::string::npos ? 1.0 : std::atof(token.substr(slash + 1).c_str());
+                if (numerator <= 0.0 || denominator <= 0.0)
+                {
+                    error = path + ": bad pitch '" + token + "'";
+                    return false;
+                }
+                cents = 1200.0 * std::log2(numerator / denominator);
+            }
+            scale.cents.push_back(cents);
+        }
+        return true;
+    }
+
+    static bool ParseKeyboardMapping(const std::string& path, KeyboardMapping& keyboard, std::string& error)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+        {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        std::vector<std::string> values;
+        for (std::string line; std::getline(file, line);)
+        {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '!') continue;
+            std::istringstream tokens(line);
+            std::string token;
+            if (tokens >> token) values.push_back(token);
+        }
+        if (values.size() < 7)
+        {
+            error = path + ": expected 7 header values";
+            return false;
+        }
+
+        s32 size = std::atoi(values[0].c_str());
+        keyboard.first               = std::atoi(values[1].c_str());
+        keyboard.last                = std::atoi(values[2].c_str());
+        keyboard.middle              = std::atoi(values[3].c_str());
+        keyboard.reference_note      = std::atoi(values[4].c_str());
+        keyboard.reference_frequency = std::atof(values[5].c_str());
+        keyboard.octave_degree       = std::atoi(values[6].c_str());
+        if (keyboard.reference_frequency <= 0.0)
+        {
+            error = path + ": bad reference frequency";
+            return false;
+        }
+
+        // Missing trailing entries are unmapped
+        keyboard.mapping.assign(std::max(size, 0), -1);
+        for (s32 i = 0; i < size && size_t(7 + i) < values.size(); i++)
+            keyboard.mapping[i] = (values[7 + i] == "x") ? -1 : std::atoi(values[7 + i].c_str());
+        return true;
+    }
+
+private:
+    Tuning()
+    {
+        SetEqualTemperament();
+        Update();
+    }
+
+    const TuningTable& Active() const { return *m_active.load(std::memory_order_acquire); }
+
+    // Keep the scale and mapping, so a new engine rate can rebuild the table
+    void Apply(const Scale& scale, const KeyboardMapping& keyboard, const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(m_source);
+        m_scale = scale;
+        m_keyboard = keyboard;
+        m_name = name;
+        Publish(Build(m_scale, m_keyboard, m_name, m_sample_rate));
+    }
+
+    // Tables are kept until exit: a retired one may still be read by a block in flight
+    void Publish(TuningTable table)
+    {
+        std::lock_guard<std::mutex> lock(m_publish);
+        m_tables.push_back(std::make_unique<TuningTable>(std::move(table)));
+        m_pending.store(m_tables.back().get(), std::memory_order_release);
+    }
+
+private:
+    std::mutex m_source;
+    Scale m_scale;
+    KeyboardMapping m_keyboard;
+    std::string m_name;
+    f64 m_sample_rate = SAMPLE_RATE;
+
+    std::mutex m_publish;
+    std::vector<std::unique_ptr<TuningTable>> m_tables;
+    std::atomic<const TuningTable*> m_pending = nullptr;
+    std::atomic<const TuningTable*> m_active  = nullptr;
+};
\ No newline at end of file
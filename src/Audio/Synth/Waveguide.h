@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+#include "Filter.h"
+#include "Note.h"
+
+// Physical models: a loop of delay line, fractional delay allpass, one pole damping (the CombFilter lowpass)
+// and loss, a few operations per sample. Every voice reads and writes its own slice of one pool.
+//   Pluck:  Karplus-Strong, the loop filled with a noise burst
+//   String: the same loop filled with a plucked string shape, the pluck position notches its harmonics
+//   Tube:   clarinet, a bore of half the period closed by a reed driven by the breath pressure
+// Karplus-Strong: https://ccrma.stanford.edu/~jos/pasp/Karplus_Strong_Algorithm.html
+// Extensions (Jaffe, Smith): https://ccrma.stanford.edu/~jos/pasp/Extended_Karplus_Strong_Algorithm.html
+// Clarinet (STK): https://ccrma.stanford.edu/software/stk/classstk_1_1Clarinet.html
+struct WaveguideVoice
+{
+    f64 on = -1.0;          // note on time of the owner, a new time restarts the voice
+    DelayLine line;         // slice of the pool
+    FractionalDelay tuning;
+    f64 damping = 0.0;      // one pole lowpass state
+    f64 delay   = 0.0;      // whole samples of the loop, the rest is in the tuning allpass
+    f64 level   = 0.0;      // string: peak of the last block, tube: breath reached
+};
+
+struct Waveguide
+{
+    static constexpr u32 MAX_VOICES = 128; // one per MIDI note
+    static constexpr s32 MAX_DELAY  = 4096; // pool slice per voice, loops down to about 11 Hz at 44.1 kHz
+
+    enum class Model
+    {
+        PLUCK,
+        STRING,
+        TUBE,
+        COUNT
+    };
+    static constexpr const char* MODEL_NAMES[] = { "Pluck", "String", "Tube" };
+
+public:
+    Waveguide()
+    {
+        pool.resize(MAX_VOICES * MAX_DELAY, 0.0);
+        for (u32 v = 0; v < MAX_VOICES; v++)
+            voices[v].line.Attach(&pool[v * MAX_DELAY], MAX_DELAY);
+    }
+
+    // Render one control block of the voice of a note. The model makes its own envelope: pressure is the
+    // amplitude envelope, blown into the tube, and a released string is damped. The loop is retuned
+    // once per block to the pitch reached at its end. Returns the voice level.
+    f64 Render(s32 note_id, f64 note_on, bool released, f64 pressure, f64 velocity, f64* output, u32 samples,
+        f64 frequency, f64 pitch, f64 sample_rate)
+    {
+        WaveguideVoice& v = voices[note_id & (MAX_VOICES - 1)];
+        const bool tube = model == static_cast<s32>(Model::TUBE);
+
+        // Tube: the round trip through the bore is half a period, the reed inverts the reflection
+        f64 period = sample_rate / std::max(frequency * pitch, 1.0);
+        f64 loop   = tube ? 0.5 * period : period;
+
+        // Damping, its phase delay at the fundamental is part of the loop
+        f64 damp  = 0.9 * (1.0 - std::clamp(brightness, 0.0, 1.0));
+        f64 omega = 2.0 * PI / period;
+        f64 lowpass_delay = std::atan2(damp * std::sin(omega), 1.0 - damp * std::cos(omega)) / omega;
+
+        // Whole samples in the line, 0.1 to 1.1 in the allpass where it is flat
+        f64 rest = std::clamp(loop - lowpass_delay, 1.1, f64(MAX_DELAY - 1));
+        v.delay = std::floor(rest - 0.1);
+        v.tuning.SetDelay(rest - v.delay, omega);
+
+        if (v.on != note_on)
+        {
+            v.on = note_on;
+            Excite(v, tube, velocity);
+        }
+
+        // Loss per trip for a 60 dB decay, the release mutes the string
+        f64 t60  = released && !tube ? std::min(decay, release) : decay;
+        f64 loss = std::pow(10.0, -3.0 * (loop / sample_rate) / std::max(t60, 0.01));
+
+        const s32 delay = static_cast<s32>(v.delay);
+        f64 peak = 0.0;
+        if (tube)
+        {
+            // Breath noise on the mouth pressure, the reed table opens as the pressure difference grows
+            // Ramps from the breath reached at the end of the last block, a fresh note starts from silence
+            f64 mouth = v.level;
+            f64 breath_step = (pressure * (0.55 + 0.45 * velocity) * breath - mouth) / samples;
+            for (u32 k = 0; k < samples; k++)
+            {
+                mouth += breath_step;
+                f64 blown = mouth * (1.0 + 0.1 * (2.0 * Random() - 1.0));
+                f64 bore  = Loop(v, delay, damp, loss);
+                f64 difference = -0.95 * bore - blown;
+                f64 reed = std::clamp(0.7 - 0.3 * difference, -1.0, 1.0);
+                v.line.Write(blown + difference * reed);
+                output[k] = bore;
+                peak = std::max(peak, std::abs(bore));
+            }
+            v.level = mouth;
+            return std::max(peak, mouth);
+        }
+
+        for (u32 k = 0; k < samples; k++)
+        {
+            f64 y = Loop(v, delay, damp, loss);
+            v.line.Write(y);
+            output[k] = y;
+            peak = std::max(peak, std::abs(y));
+        }
+        v.level = peak;
+        return peak;
+    }
+
+private:
+    // Once around the loop: line, tuning allpass, damping and loss, as the feedback of a CombFilter
+    static f64 Loop(WaveguideVoice& v, s32 delay, f64 damp, f64 loss)
+    {
+        f64 y = v.tuning.Process(v.line.Tap(delay));
+        v.damping = lerp(y, v.damping, damp);
+        return loss * v.damping;
+    }
+
+    // Cheap generator for the excitation and the breath noise, the audio thread only
+    f64 Random()
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed * (1.0 / 4294967296.0);
+    }
+
+    // Fill one period of the line with the starting displacement
+    void Excite(WaveguideVoice& v, bool tube, f64 velocity)
+    {
+        std::fill(v.line.buffer, v.line.buffer + v.line.size, 0.0);
+        v.tuning.Reset();
+        v.damping = 0.0;
+        v.level = 0.0;
+        if (tube) return;
+
+        const s32 length = static_cast<s32>(v.delay);
+        const s32 pluck  = std::max<s32>(1, static_cast<s32>(std::clamp(position, 0.02, 0.5) * length));
+        f64 smooth = 0.0;
+        f64 mean = 0.0;
+        for (s32 i = 0; i < length; i++)
+        {
+            f64 x;
+            if (model == static_cast<s32>(Model::PLUCK))
+                x = 2.0 * Random() - 1.0;
+            else
+                x = i < pluck ? f64(i) / pluck : f64(length - i) / (length - pluck); // triangle, apex at the pluck
+
+            // Softer plucks are darker
+            smooth = lerp(x, smooth, 0.8 * (1.0 - velocity) * (1.0 - brightness));
+            v.line.buffer[i] = smooth;
+            mean += smooth;
+        }
+
+        // No DC in the loop, the level follows the velocity
+        mean /= length;
+        f64 peak = 0.0;
+        for (s32 i = 0; i < length; i++)
+        {
+            v.line.buffer[i] -= mean;
+            peak = std::max(peak, std::abs(v.line.buffer[i]));
+        }
+        f64 gain = peak > 0.0 ? velocity / peak : 0.0;
+        for (s32 i = 0; i < length; i++)
+            v.line.buffer[i] *= gain;
+        v.line.offset = length;
+    }
+
+public:
+    s32 model      = static_cast<s32>(Model::PLUCK);
+    f64 decay      = 3.0;  // seconds to -60 dB while held
+    f64 release    = 0.15; // seconds to -60 dB once released (pluck and string)
+    f64 brightness = 0.5;  // 1 leaves the loop undamped
+    f64 position   = 0.2;  // string: pluck point along the string, 0.5 is the middle
+    f64 breath     = 1.0;  // tube: mouth pressure scale, the reed speaks above about 0.6
+
+    std::vector<f64> pool;
+
+private:
+    WaveguideVoice voices[MAX_VOICES];
+    u32 seed = 0x2545F491u;
+};
\ No newline at end of file
@@ -0,0 +1,241 @@
+/*
+	WAV File Writer and Reader
+
+	#include "WavFile.h"
+	int main()
+	{
+		WavFile wav(44100, 2, 16);
+		wav.Open("out.wav");
+		wav.Write(interleaved_samples.data(), frame_count);
+		wav.Close();
+
+		std::vector<f64> mono;
+		u32 rate = 0;
+		std::string error;
+		read_wav("in.wav", mono, rate, error);
+	}
+
+	References
+		WAVE PCM soundfile format: http://soundfile.sapp.org/doc/WaveFormat/
+		Multimedia Programming Interface and Data Specifications 1.0 (RIFF): https://www.mmsp.ece.mcgill.ca/Documents/AudioFormats/WAVE/WAVE.html
+*/
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include "../../Core/Common.h"
+
+static const u16 WAVE_FORMAT_PCM        = 0x0001;
+static const u16 WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+static const u16 WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+struct WavFile
+{
+	WavFile(u32 sample_rate = 44100, u16 channels = 2, u16 bits_per_sample = 16)
+		: sample_rate(sample_rate), channels(channels), bits_per_sample(bits_per_sample) {}
+
+	~WavFile()
+	{
+		if (f.is_open()) Close();
+	}
+
+	// Open the file and write a header with placeholder chunk sizes, patched on Close
+	bool Open(const std::string& filename)
+	{
+		if (bits_per_sample != 16 && bits_per_sample != 32)
+		{
+			std::cerr << "ERROR: Unsupported WAV bit depth: " << bits_per_sample << "\n";
+			return false;
+		}
+
+		f.open(filename, std::fstream::out | std::ios::binary | std::ios::trunc);
+		if (!f.is_open())
+		{
+			std::cerr << "ERROR: Could not open the file: " << filename << "\n";
+			return false;
+		}
+
+		u16 format = (bits_per_sample == 32) ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+		u16 block_align = channels * (bits_per_sample / 8);
+
+		// RIFF Chunk
+		write_str("RIFF");
+		write32(0);
+		write_str("WAVE");
+
+		// Format Chunk
+		write_str("fmt ");
+		write32(16);
+		write16(format);
+		write16(channels);
+		write32(sample_rate);
+		write32(sample_rate * block_align);
+		write16(block_align);
+		write16(bits_per_sample);
+
+		// Data Chunk
+		write_str("data");
+		write32(0);
+
+		frames_written = 0;
+		return true;
+	}
+
+	// Write interleaved frames, samples are clamped to [-1, 1]
+	void Write(const f64* samples, u32 frame_count)
+	{
+		u32 sample_count = frame_count * channels;
+		if (bits_per_sample == 32)
+		{
+			for (u32 i = 0; i < sample_count; i++)
+			{
+				f32 s = static_cast<f32>(std::clamp(samples[i], -1.0, 1.0));
+				f.write(reinterpret_cast<const char*>(&s), sizeof(f32));
+			}
+		}
+		else
+		{
+			for (u32 i = 0; i < sample_count; i++)
+			{
+				s16 s = static_cast<s16>(std::clamp(samples[i], -1.0, 1.0) * 32767.0);
+				write16(static_cast<u16>(s));
+			}
+		}
+		frames_written += frame_count;
+	}
+
+	// Patch the RIFF and data chunk sizes and close the file
+	bool Close()
+	{
+		u32 data_size = frames_written * channels * (bits_per_sample / 8);
+
+		f.seekp(4, std::ios::beg);
+		write32(36 + data_size);
+		f.seekp(40, std::ios::beg);
+		write32(data_size);
+
+		bool ok = f.good();
+		f.close();
+		return ok;
+	}
+
+public: // Helper functions
+	// Write little endian 32 bits
+	void write32(u32 n)
+	{
+		u8 bytes[4] = { u8(n), u8(n >> 8), u8(n >> 16), u8(n >> 24) };
+		f.write(reinterpret_cast<const char*>(bytes), 4);
+	}
+
+	// Write little endian 16 bits
+	void write16(u16 n)
+	{
+		u8 bytes[2] = { u8(n), u8(n >> 8) };
+		f.write(reinterpret_cast<const char*>(bytes), 2);
+	}
+
+	// Write chunk id
+	void write_str(const char* s)
+	{
+		f.write(s, 4);
+	}
+
+public:
+	u32 sample_rate;
+	u16 channels;
+	u16 bits_per_sample;
+	u32 frames_written = 0;
+
+	std::ofstream f;
+};
+
+// Read a whole PCM (8, 16, 24, 32 bits) or float (32, 64 bits) file, channels are mixed down to mono
+static bool read_wav(const std::string& filename, std::vector<f64>& samples, u32& sample_rate, std::string& error)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if (!f.is_open())
+	{
+		error = "cannot open " + filename;
+		return false;
+	}
+
+	auto read32 = [&f]() { u8 b[4] = {}; f.read(reinterpret_cast<char*>(b), 4); return u32(b[0]) | u32(b[1]) << 8 | u32(b[2]) << 16 | u32(b[3]) << 24; };
+	auto read16 = [&f]() { u8 b[2] = {}; f.read(reinterpret_cast<char*>(b), 2); return u16(b[0] | b[1] << 8); };
+	auto read_id = [&f]() { char id[5] = {}; f.read(id, 4); return std::string(id); };
+
+	if (read_id() != "RIFF" || (read32(), read_id()) != "WAVE")
+	{
+		error = filename + ": not a RIFF WAVE file";
+		return false;
+	}
+
+	u16 format = 0, channels = 0, bits = 0;
+	while (f.good())
+	{
+		std::string id = read_id();
+		u32 size = read32();
+		if (!f.good()) break;
+		std::streampos next = f.tellg() + std::streamoff(size + (size & 1));
+
+		if (id == "fmt ")
+		{
+			format      = read16();
+			channels    = read16();
+			sample_rate = read32();
+			read32();
+			read16();
+			bits        = read16();
+			// Extensible: the real format is the first two bytes of the sub format GUID
+			if (format == WAVE_FORMAT_EXTENSIBLE && size >= 26)
+			{
+				read16();
+				read16();
+				read32();
+				format = read16();
+			}
+		}
+		else if (id == "data")
+		{
+			bool pcm = format == WAVE_FORMAT_PCM && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+			bool fp  = format == WAVE_FORMAT_IEEE_FLOAT && (bits == 32 || bits == 64);
+			if (channels == 0 || (!pcm && !fp))
+			{
+				error = filename + ": unsupported format " + std::to_string(format) + ", " + std::to_string(bits) + " bits";
+				return false;
+			}
+
+			std::vector<u8> data(size);
+			f.read(reinterpret_cast<char*>(data.data()), size);
+			u32 bytes  = bits / 8;
+			u32 frames = u32(f.gcount()) / (bytes * channels);
+			samples.assign(frames, 0.0);
+
+			const u8* p = data.data();
+			for (u32 i = 0; i < frames; i++)
+			{
+				f64 sum = 0.0;
+				for (u16 c = 0; c < channels; c++, p += bytes)
+				{
+					if (fp && bits == 32)       { f32 x; std::memcpy(&x, p, 4); sum += x; }
+					else if (fp)                { f64 x; std::memcpy(&x, p, 8); sum += x; }
+					else if (bits == 8)         sum += (p[0] - 128) / 128.0;
+					else if (bits == 16)        sum += s16(p[0] | p[1] << 8) / 32768.0;
+					else if (bits == 24)        sum += s32(u32(p[0]) << 8 | u32(p[1]) << 16 | u32(p[2]) << 24) / 2147483648.0;
+					else                        sum += s32(u32(p[0]) | u32(p[1]) << 8 | u32(p[2]) << 16 | u32(p[3]) << 24) / 2147483648.0;
+				}
+				samples[i] = sum / channels;
+			}
+			return true;
+		}
+		f.seekg(next);
+	}
+
+	error = filename + ": no data chunk";
+	return false;
+}
\ No newline at end of file
@@ -6,8 +6,17 @@ Application::Application() : m_window("Sound Synthesizer", SCREEN_WIDTH, SCREEN_
 
 }
 
-bool Application::Init()
+bool Application::Init(s32 argc, char** argv)
 {
+    // Real-time options are opt-in: they need rtprio/memlock limits and lock pages for the whole session
+    for (s32 i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if      (arg == "--realtime")    m_realtime.realtime_priority = true;
+        else if (arg == "--lock-memory") m_realtime.lock_memory = true;
+        else std::printf("ERROR: Unknown option: %s\n", argv[i]);
+    }
+
     // Create resources
     Create();
 
@@ -74,6 +83,8 @@ bool Application::ShutDown()
 
 void Application::Create()
 {
+    // Best effort: failures are reported and the engine keeps running at normal priority
+    m_audio.SetRealtimeOptions(m_realtime);
     m_audio.Init(44100, 2, 8, SAMPLE_RATE/100);
 
     // How do we link synth + application?
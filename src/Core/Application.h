@@ -20,7 +20,8 @@ public:
     Application();
 
 public: // Interface
-    bool Init();
+    // --realtime asks for real-time audio thread priority, --lock-memory locks the engine buffers
+    bool Init(s32 argc = 0, char** argv = nullptr);
     bool Start();
     bool ShutDown();
 
@@ -46,8 +47,10 @@ private: // Internal
     f32 m_last_elapsed_time;
     // Window
     Window m_window;
+    // Audio thread options from the command line
+    RealtimeOptions m_realtime;
 
 private: // Simulation variables
     AudioEngine m_audio;
     GUI m_gui;
-};
+};
\ No newline at end of file
@@ -2,6 +2,14 @@
 
 // C-Standard types
 #include <cstdint>
+// SIMD instruction sets: SSE2 on x86/x64, NEON on ARM64
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SYNTH_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SYNTH_NEON
+#endif
 // Numeric types
 using u8  = uint8_t;
 using u16 = uint16_t;
@@ -0,0 +1,95 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <cerrno>
+#endif
+
+bool MappedFile::Open(const std::string& filename, std::string& error)
+{
+    Close();
+#if defined(_WIN32)
+    HANDLE f = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE)
+    {
+        error = "cannot open " + filename + " (" + std::to_string(GetLastError()) + ")";
+        return false;
+    }
+    file = f;
+
+    LARGE_INTEGER length = {};
+    if (!GetFileSizeEx(f, &length) || length.QuadPart == 0)
+    {
+        error = filename + ": empty file";
+        Close();
+        return false;
+    }
+
+    mapping = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        error = "CreateFileMapping failed (" + std::to_string(GetLastError()) + ")";
+        Close();
+        return false;
+    }
+
+    data = static_cast<const u8*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data)
+    {
+        error = "MapViewOfFile failed (" + std::to_string(GetLastError()) + ")";
+        Close();
+        return false;
+    }
+    size = static_cast<size_t>(length.QuadPart);
+    return true;
+#else
+    s32 fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "cannot open " + filename + ": " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        error = filename + ": empty file";
+        close(fd);
+        return false;
+    }
+
+    // The mapping keeps its own reference to the file
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        error = std::string("mmap: ") + std::strerror(errno);
+        return false;
+    }
+    data = static_cast<const u8*>(view);
+    size = static_cast<size_t>(st.st_size);
+    return true;
+#endif
+}
+
+void MappedFile::Close()
+{
+#if defined(_WIN32)
+    if (data)    UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file)    CloseHandle(file);
+#else
+    if (data)    munmap(const_cast<u8*>(data), size);
+#endif
+    data    = nullptr;
+    size    = 0;
+    file    = nullptr;
+    mapping = nullptr;
+}
\ No newline at end of file
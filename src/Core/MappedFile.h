@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+#include "Common.h"
+
+// Read-only memory-mapped file: the bytes are paged in from disk on first touch and can be dropped
+// by the OS again under memory pressure, so a multi-gigabyte file costs address space, not RAM.
+// Windows: CreateFileMapping + MapViewOfFile
+// POSIX:   mmap
+struct MappedFile
+{
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { Close(); }
+
+    // On failure error holds the reason
+    bool Open(const std::string& filename, std::string& error);
+    void Close();
+
+    const u8* data = nullptr;
+    size_t size = 0;
+
+private:
+    void* file    = nullptr; // Windows file and mapping handles
+    void* mapping = nullptr;
+};
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "Common.h"
+
+// Immutable state published from the GUI (or any thread but the audio thread) to the audio thread.
+// The audio thread takes the latest object once per block with Acquire and reads it through a raw pointer;
+// it only touches the shared pointer when something new was published. Replaced objects are kept in a
+// retire list and freed by a later Publish once the audio thread let go of them, never on the audio thread.
+template <typename T>
+class Published
+{
+public:
+    // Publisher: the audio thread switches to the object at its next Acquire
+    void Publish(std::shared_ptr<const T> object)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(), [](const auto& o) { return o.use_count() == 1; }), m_retired.end());
+        std::shared_ptr<const T> replaced = m_latest.exchange(std::move(object));
+        if (replaced) m_retired.push_back(std::move(replaced));
+        m_version.fetch_add(1, std::memory_order_release);
+    }
+
+    // Publisher: the last object published
+    std::shared_ptr<const T> Latest() const { return m_latest.load(); }
+
+    // Audio thread, once per block
+    const T* Acquire()
+    {
+        u32 version = m_version.load(std::memory_order_acquire);
+        if (version != m_acquired)
+        {
+            m_acquired = version;
+            m_current = m_latest.load();
+        }
+        return m_current.get();
+    }
+
+    // Audio thread: the object taken by the last Acquire
+    const T* Current() const { return m_current.get(); }
+
+    // Audio thread: the same, for a consumer that keeps it past the next Acquire. Its last reference is
+    // still dropped by a Publish, the consumer only adds one
+    const std::shared_ptr<const T>& Shared() const { return m_current; }
+
+private:
+    std::atomic<std::shared_ptr<const T>> m_latest;
+    std::atomic<u32> m_version = 0;
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<const T>> m_retired;
+
+    // Audio thread
+    std::shared_ptr<const T> m_current;
+    u32 m_acquired = 0;
+};
\ No newline at end of file
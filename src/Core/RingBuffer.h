@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "Common.h"
+
+// Lock-free single producer, single consumer ring buffer
+// Capacity is rounded up to a power of two; one thread may Write, one other thread may Read.
+template <typename T>
+class RingBuffer
+{
+public:
+    RingBuffer(u32 capacity = 0) { Resize(capacity); }
+
+public:
+    // Not thread safe: call before producer and consumer start
+    void Resize(u32 capacity)
+    {
+        u32 size = 1;
+        while (size < capacity) size <<= 1;
+        m_buffer.assign(size, T());
+        m_mask = size - 1;
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_write.store(0, std::memory_order_relaxed);
+        m_read.store(0, std::memory_order_relaxed);
+    }
+
+    u32 Capacity() const { return u32(m_buffer.size()); }
+    T* Data() { return m_buffer.data(); }
+
+    // Elements ready to be read
+    u32 ReadAvailable() const
+    {
+        return u32(m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_relaxed));
+    }
+
+    // Free space ready to be written
+    u32 WriteAvailable() const
+    {
+        return Capacity() - u32(m_write.load(std::memory_order_relaxed) - m_read.load(std::memory_order_acquire));
+    }
+
+    // Producer: write up to count elements, returns the number written
+    u32 Write(const T* data, u32 count)
+    {
+        u64 w = m_write.load(std::memory_order_relaxed);
+        u64 r = m_read.load(std::memory_order_acquire);
+        count = std::min(count, Capacity() - u32(w - r));
+
+        for (u32 i = 0; i < count; i++)
+            m_buffer[(w + i) & m_mask] = data[i];
+
+        m_write.store(w + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: read up to count elements, returns the number read
+    u32 Read(T* data, u32 count)
+    {
+        u64 r = m_read.load(std::memory_order_relaxed);
+        u64 w = m_write.load(std::memory_order_acquire);
+        count = std::min(count, u32(w - r));
+
+        for (u32 i = 0; i < count; i++)
+            data[i] = m_buffer[(r + i) & m_mask];
+
+        m_read.store(r + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    std::vector<T> m_buffer;
+    u64 m_mask = 0;
+
+    // Producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<u64> m_write = 0;
+    alignas(64) std::atomic<u64> m_read  = 0;
+};
\ No newline at end of file
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../Core/Common.h"
+#include "../Audio/Synth/Filter.h"
+
+// Amplitude responses of the filter and equalizer views, computed off the GUI thread. The views hand over the
+// coefficients every frame, a worker wakes only when they changed and publishes an immutable curve the views
+// plot until the next one. Every response is a cascade of sections B(z) / A(z) up to 4th order, evaluated at
+// log spaced points with the cos(k w) and sin(k w) of each point tabulated once:
+//   |H(e^jw)|^2 = prod |B(e^jw)|^2 / |A(e^jw)|^2, |P(e^jw)|^2 = (sum p_k cos(k w))^2 + (sum p_k sin(k w))^2
+// Frequency response: https://ccrma.stanford.edu/~jos/filters/Frequency_Response_I.html
+
+// Numerator and denominator coefficients of z^-k
+struct ResponseSection
+{
+    static constexpr u32 ORDER = 4;
+
+    f64 b[ORDER + 1] = { 1.0 };
+    f64 a[ORDER + 1] = { 1.0 };
+
+    bool operator==(const ResponseSection&) const = default;
+};
+
+struct ResponseCurve
+{
+    std::vector<f64> frequencies; // Hz
+    std::vector<f64> magnitudes;  // dB
+};
+
+// Biquad: the coefficients as they are
+inline ResponseSection response_section(const BqFilter& f)
+{
+    ResponseSection s;
+    if (f.type == BqFilter::Type::OFF) return s;
+    s.b[0] = f.b0; s.b[1] = f.b1; s.b[2] = f.b2;
+    s.a[1] = f.a1; s.a[2] = f.a2;
+    return s;
+}
+
+// State variable filter: the bilinear transform of the analog prototype it integrates, s = (1 - z^-1) / (g (1 + z^-1))
+//   LP: g^2 (1 + z^-1)^2, BP: g (1 - z^-2), HP: (1 - z^-1)^2, over (1 + 2Rg + g^2) + 2(g^2 - 1) z^-1 + (1 - 2Rg + g^2) z^-2
+inline ResponseSection response_section(const VAFilter& f)
+{
+    ResponseSection s;
+    const f64 g = f.g;
+    const f64 R = f.R;
+    switch (f.type)
+    {
+    case VAFilter::Type::LOW_PASS:  s.b[0] = g * g; s.b[1] = 2.0 * g * g; s.b[2] = g * g; break;
+    case VAFilter::Type::BAND_PASS: s.b[0] = g;     s.b[1] = 0.0;         s.b[2] = -g;    break;
+    case VAFilter::Type::HIGH_PASS: s.b[0] = 1.0;   s.b[1] = -2.0;        s.b[2] = 1.0;   break;
+    default: return s;
+    }
+    s.a[0] = 1.0 + 2.0 * R * g + g * g;
+    s.a[1] = 2.0 * (g * g - 1.0);
+    s.a[2] = 1.0 - 2.0 * R * g + g * g;
+    return s;
+}
+
+// Ladder, small signals at 1x: N^4 / (D^4 + k N^4) of the one pole N / D = g (1 + z^-1) / ((1 + g) - (1 - g) z^-1)
+inline ResponseSection response_section(const LadderFilter& f)
+{
+    ResponseSection s;
+    const f64 g  = f.G[0] / (1.0 - f.G[0]);
+    const f64 g4 = g * g * g * g;
+    const f64 p  = 1.0 + g;
+    const f64 q  = -(1.0 - g);
+    const f64 binomial[] = { 1.0, 4.0, 6.0, 4.0, 1.0 };
+    for (u32 k = 0; k <= ResponseSection::ORDER; k++)
+    {
+        s.b[k] = g4 * binomial[k];
+        s.a[k] = binomial[k] * std::pow(p, f64(4 - k)) * std::pow(q, f64(k)) + f.k * s.b[k];
+    }
+    return s;
+}
+
+class FrequencyResponse
+{
+public:
+    enum class View
+    {
+        FILTER,
+        EQUALIZER,
+        COUNT
+    };
+
+    static constexpr u32 POINTS       = 512;
+    static constexpr u32 MAX_SECTIONS = 8;
+    static constexpr f64 LOW          = 20.0;    // Hz
+    static constexpr f64 HIGH         = 20000.0; // Hz
+    static constexpr f64 FLOOR        = -100.0;  // dB
+
+public:
+    FrequencyResponse()
+    {
+        for (u32 i = 0; i < POINTS; i++)
+        {
+            frequencies[i] = LOW * std::pow(HIGH / LOW, f64(i) / (POINTS - 1));
+            f64 omega = 2.0 * PI * frequencies[i] / SAMPLE_RATE;
+            for (u32 k = 0; k < ResponseSection::ORDER; k++)
+            {
+                cosines[k][i] = std::cos((k + 1) * omega);
+                sines[k][i]   = std::sin((k + 1) * omega);
+            }
+        }
+        running = true;
+        worker = std::thread(&FrequencyResponse::Run, this);
+    }
+
+    ~FrequencyResponse()
+    {
+        running = false;
+        version++;
+        version.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    // GUI thread, every frame: the cascade a view shows. Only a change wakes the worker
+    void Request(View view, const ResponseSection* sections, u32 count)
+    {
+        Shape shape;
+        shape.count = std::min(count, MAX_SECTIONS);
+        std::copy(sections, sections + shape.count, shape.sections.begin());
+
+        Shape& last = requested[static_cast<u32>(view)];
+        if (shape == last) return;
+        last = shape;
+
+        requests[static_cast<u32>(view)].store(std::make_shared<const Shape>(shape));
+        version++;
+        version.notify_one();
+    }
+
+    // GUI thread: the latest curve of a view, null until the first is ready
+    std::shared_ptr<const ResponseCurve> Curve(View view) const
+    {
+        return curves[static_cast<u32>(view)].load();
+    }
+
+private:
+    struct Shape
+    {
+        std::array<ResponseSection, MAX_SECTIONS> sections = {};
+        u32 count = 0;
+
+        bool operator==(const Shape&) const = default;
+    };
+
+    // Sleeps until a view requests a new shape
+    void Run()
+    {
+        std::shared_ptr<const Shape> computed[static_cast<u32>(View::COUNT)];
+        u32 seen = 0;
+        while (running)
+        {
+            version.wait(seen);
+            seen = version.load();
+
+            for (u32 v = 0; v < static_cast<u32>(View::COUNT) && running; v++)
+            {
+                std::shared_ptr<const Shape> shape = requests[v].load();
+                if (!shape || shape == computed[v]) continue;
+
+                auto curve = std::make_shared<ResponseCurve>();
+                curve->frequencies.assign(frequencies, frequencies + POINTS);
+                curve->magnitudes.resize(POINTS);
+                Evaluate(*shape, curve->magnitudes.data());
+                curves[v].store(std::move(curve));
+                computed[v] = std::move(shape);
+            }
+        }
+    }
+
+    // Power ratio of the cascade at every point, two points per lane, then in dB
+    void Evaluate(const Shape& shape, f64* magnitudes) const
+    {
+        alignas(16) f64 ratio[POINTS];
+        u32 i = 0;
+#if defined(SYNTH_SSE2)
+        for (; i + 2 <= POINTS; i += 2)
+        {
+            __m128d numerator   = _mm_set1_pd(1.0);
+            __m128d denominator = _mm_set1_pd(1.0);
+            for (u32 s = 0; s < shape.count; s++)
+            {
+                numerator   = _mm_mul_pd(numerator,   Power(shape.sections[s].b, i));
+                denominator = _mm_mul_pd(denominator, Power(shape.sections[s].a, i));
+            }
+            _mm_store_pd(ratio + i, _mm_div_pd(numerator, denominator));
+        }
+#elif defined(SYNTH_NEON)
+        for (; i + 2 <= POINTS; i += 2)
+        {
+            float64x2_t numerator   = vdupq_n_f64(1.0);
+            float64x2_t denominator = vdupq_n_f64(1.0);
+            for (u32 s = 0; s < shape.count; s++)
+            {
+                numerator   = vmulq_f64(numerator,   Power(shape.sections[s].b, i));
+                denominator = vmulq_f64(denominator, Power(shape.sections[s].a, i));
+            }
+            vst1q_f64(ratio + i, vdivq_f64(numerator, denominator));
+        }
+#endif
+        for (; i < POINTS; i++)
+        {
+            f64 numerator   = 1.0;
+            f64 denominator = 1.0;
+            for (u32 s = 0; s < shape.count; s++)
+            {
+                const ResponseSection& section = shape.sections[s];
+                f64 re_b = section.b[0], im_b = 0.0;
+                f64 re_a = section.a[0], im_a = 0.0;
+                for (u32 k = 0; k < ResponseSection::ORDER; k++)
+                {
+                    re_b += section.b[k + 1] * cosines[k][i];
+                    im_b += section.b[k + 1] * sines[k][i];
+                    re_a += section.a[k + 1] * cosines[k][i];
+                    im_a += section.a[k + 1] * sines[k][i];
+                }
+                numerator   *= re_b * re_b + im_b * im_b;
+                denominator *= re_a * re_a + im_a * im_a;
+            }
+            ratio[i] = numerator / denominator;
+        }
+
+        for (u32 j = 0; j < POINTS; j++)
+            magnitudes[j] = ratio[j] > 0.0 ? std::max(10.0 * std::log10(ratio[j]), FLOOR) : FLOOR;
+    }
+
+#if defined(SYNTH_SSE2)
+    // |P(e^jw)|^2 at points i and i + 1
+    __m128d Power(const f64* p, u32 i) const
+    {
+        __m128d re = _mm_set1_pd(p[0]);
+        __m128d im = _mm_setzero_pd();
+        for (u32 k = 0; k < ResponseSection::ORDER; k++)
+        {
+            __m128d c = _mm_set1_pd(p[k + 1]);
+            re = _mm_add_pd(re, _mm_mul_pd(c, _mm_loadu_pd(cosines[k] + i)));
+            im = _mm_add_pd(im, _mm_mul_pd(c, _mm_loadu_pd(sines[k] + i)));
+        }
+        return _mm_add_pd(_mm_mul_pd(re, re), _mm_mul_pd(im, im));
+    }
+#elif defined(SYNTH_NEON)
+    float64x2_t Power(const f64* p, u32 i) const
+    {
+        float64x2_t re = vdupq_n_f64(p[0]);
+        float64x2_t im = vdupq_n_f64(0.0);
+        for (u32 k = 0; k < ResponseSection::ORDER; k++)
+        {
+            re = vfmaq_n_f64(re, vld1q_f64(cosines[k] + i), p[k + 1]);
+            im = vfmaq_n_f64(im, vld1q_f64(sines[k] + i), p[k + 1]);
+        }
+        return vaddq_f64(vmulq_f64(re, re), vmulq_f64(im, im));
+    }
+#endif
+
+private:
+    f64 frequencies[POINTS] = {};
+    f64 cosines[ResponseSection::ORDER][POINTS] = {};
+    f64 sines[ResponseSection::ORDER][POINTS] = {};
+
+    // GUI thread: the last shape of each view
+    Shape requested[static_cast<u32>(View::COUNT)];
+
+    std::atomic<std::shared_ptr<const Shape>> requests[static_cast<u32>(View::COUNT)];
+    std::atomic<std::shared_ptr<const ResponseCurve>> curves[static_cast<u32>(View::COUNT)];
+    std::atomic<u32> version = 0;
+    std::atomic<bool> running = false;
+    std::thread worker;
+};
\ No newline at end of file
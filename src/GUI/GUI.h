@@ -10,6 +10,8 @@
 
 #include "../Core/Common.h"
 #include "../Audio/Synth/Synthesizer.h"
+#include "../Audio/WAV/WavFile.h"
+#include "FrequencyResponse.h"
 
 struct ScrollingBuffer 
 {
@@ -45,6 +47,56 @@ struct ScrollingBuffer
     }
 };
 
+// Custom waveform expression being edited
+struct CustomWaveEdit
+{
+    char text[256] = "sin(2*pi*phase) + 0.3*sin(6*pi*phase)";
+    bool bake = false;
+    std::string error;
+    std::string compiled; // text of the last compile
+};
+
+// Additive spectrum being chosen or analyzed
+struct AdditiveEdit
+{
+    s32 preset = 0;
+    s32 partials = 128;
+    char wav[256] = "";
+    std::string error;
+};
+
+// Grain source recording being loaded
+struct GranularEdit
+{
+    char wav[256] = "";
+    std::string error;
+};
+
+// Modes being chosen or analyzed
+struct ModalEdit
+{
+    s32 preset = 0;
+    s32 modes = 64;
+    char wav[256] = "";
+    std::string error;
+};
+
+// SoundFont bank being loaded
+struct SamplerEdit
+{
+    char sf2[256] = "";
+    std::string error;
+};
+
+// Scala tuning files being edited
+struct TuningEdit
+{
+    char scl[256] = "";
+    char kbm[256] = "";
+    f64 a4 = 440.0;
+    std::string error;
+};
+
 static bool SliderDouble(const char* label, double* v, double v_min, double v_max, const char* format = "%.3f", ImGuiSliderFlags flags = 0)
 {
     return ImGui::SliderScalar(label, ImGuiDataType_Double, v, &v_min, &v_max, format, flags);
@@ -89,13 +141,8 @@ public:
             General(synth, audio);   
 
             // Oscillator
-            static s32 wf1 = static_cast<s32>(synth.GetOscillator("OSC1").m_waveform);
-            static s32 wf2 = static_cast<s32>(synth.GetOscillator("OSC2").m_waveform);
-            static s32 wf3 = static_cast<s32>(synth.GetOscillator("OSC3").m_waveform);
-            static bool mute1 = false, mute2 = false, mute3 = false;
-            DefaultOscillator(synth.GetOscillator("OSC1"), "OSC1", wf1, mute1);
-            DefaultOscillator(synth.GetOscillator("OSC2"), "OSC2", wf2, mute2);
-            DefaultOscillator(synth.GetOscillator("OSC3"), "OSC3", wf3, mute3);
+            for (u32 slot = 0; slot < synth.OscillatorCount(); slot++)
+                DefaultOscillator(synth.GetOscillator(slot), synth.GetOscillatorCold(slot), m_custom_edits[slot]);
 
             // Oscilloscope
             Oscilloscope(synth);
@@ -107,18 +154,57 @@ public:
             static s32 decay_function = static_cast<s32>(synth.m_amp_envelope.decay_function);
             Envelope(synth.m_amp_envelope, decay_function, "Amplitude Envelope");
 
-            // TODO: Filter Envelope
+            // Filter Envelope
+            static s32 filter_decay_function = static_cast<s32>(synth.m_filter_envelope.decay_function);
+            Envelope(synth.m_filter_envelope, filter_decay_function, "Filter Envelope");
 
             // Volume
             Mixer(synth);
 
+            // Distortion
+            DistortionWindow(synth);
+
             // Filter
             Filter(synth);
         
             // Low Frequency Oscillator
             static s32 wflfo    = static_cast<s32>(synth.m_lfo.m_waveform);
             static bool mutelfo = false;
-            LowFrequencyOscillator(synth.m_lfo, "LFO", wflfo, mutelfo);
+            LowFrequencyOscillator(synth.m_lfo, synth.m_lfo_control, "LFO", wflfo, mutelfo);
+
+            // Modulation Matrix
+            ModulationMatrix(synth);
+
+            // Additive
+            if (synth.m_synthesis == Synthesizer::Synthesis::ADDITIVE)
+                AdditiveWindow(synth.m_additive, m_additive_edit);
+
+            // Sampler
+            if (synth.m_synthesis == Synthesizer::Synthesis::SAMPLER)
+                SamplerWindow(synth.m_sampler, m_sampler_edit);
+
+            // Physical models
+            if (synth.m_synthesis == Synthesizer::Synthesis::WAVEGUIDE)
+                WaveguideWindow(synth.m_waveguide);
+
+            // Modal
+            if (synth.m_synthesis == Synthesizer::Synthesis::MODAL)
+                ModalWindow(synth.m_modal, m_modal_edit);
+
+            // Granular
+            if (synth.m_synthesis == Synthesizer::Synthesis::GRANULAR)
+                GranularWindow(synth.m_granular, m_granular_edit);
+
+            // Tuning
+            TuningWindow(m_tuning_edit);
+
+            // Frequency Modulation
+            if (synth.m_synthesis == Synthesizer::Synthesis::FREQUENCY_MODULATION)
+                FrequencyModulation(synth.m_fm);
+
+            // Tonewheel Organ
+            if (synth.m_synthesis == Synthesizer::Synthesis::TONEWHEEL)
+                TonewheelOrgan(synth.m_tonewheel);
 
             // Delay
             DelayEffect(synth);
@@ -128,6 +214,9 @@ public:
 
             // Equalizer
             Eq(synth);
+
+            // Multiband dynamics
+            Multiband(synth);
         }
     }
 
@@ -240,6 +329,11 @@ public:
             ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.25f);
             ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.25f);
             SliderDouble("Master Volume", &synth.m_master_volume, 0.0, 1.0);
+            SliderDouble("Pan Spread",    &synth.m_pan_spread,    0.0, 1.0);
+
+            s32 synthesis = static_cast<s32>(synth.m_synthesis);
+            if (ImGui::Combo("Synthesis", &synthesis, Synthesizer::SYNTHESIS_NAMES, static_cast<s32>(Synthesizer::Synthesis::COUNT)))
+                synth.m_synthesis = static_cast<Synthesizer::Synthesis>(synthesis);
         }
         ImGui::End();
     }
@@ -300,17 +394,19 @@ public:
         ImGui::End();
     }
 
-    void DefaultOscillator(Oscillator& osc, std::string label, s32& waveform, bool& mute)
+    void DefaultOscillator(Oscillator& osc, OscillatorCold& cold, CustomWaveEdit& edit)
     {
+        s32 waveform = static_cast<s32>(osc.m_waveform);
         ImVec2 osc_slider_size(20, 150);
-        ImGui::Begin(label.c_str());
+        ImGui::Begin(cold.name.c_str());
         {
-            ImGui::Text(" P   V"); ImGui::SameLine();
+            ImGui::Text(" P   V  PAN"); ImGui::SameLine();
 
             ImGui::Checkbox("Mute", &osc.m_mute);
 
             ImGui::VSliderInt("##P", osc_slider_size, &osc.m_pitch,  -24, 48);  ImGui::SameLine();
             VSliderDouble("##V",     osc_slider_size, &osc.m_volume, 0.0, 1.0); ImGui::SameLine();
+            VSliderDouble("##PAN",   osc_slider_size, &osc.m_pan,   -1.0, 1.0); ImGui::SameLine();
 
             ImGui::BeginGroup();
             ImGui::RadioButton("SINE",     &waveform, static_cast<s32>(Oscillator::Type::WAVE_SINE));
@@ -319,19 +415,49 @@ public:
             ImGui::RadioButton("DIGI SAW", &waveform, static_cast<s32>(Oscillator::Type::WAVE_DIGI_SAWTOOTH));
             ImGui::RadioButton("ANLG SAW", &waveform, static_cast<s32>(Oscillator::Type::WAVE_ANLG_SAWTOOTH));
             ImGui::RadioButton("WHITE",    &waveform, static_cast<s32>(Oscillator::Type::NOISE_WHITE));
+            ImGui::RadioButton("CUSTOM",   &waveform, static_cast<s32>(Oscillator::Type::CUSTOM));
             ImGui::EndGroup();
 
+            // Custom waveform expression, compiled here and swapped into the oscillator
+            if (waveform == static_cast<s32>(Oscillator::Type::CUSTOM))
+            {
+                ImGui::PushItemWidth(300);
+                bool enter = ImGui::InputText("##EXPR", edit.text, sizeof(edit.text), ImGuiInputTextFlags_EnterReturnsTrue);
+                ImGui::PopItemWidth();
+                ImGui::Checkbox("Wavetable", &edit.bake); ImGui::SameLine();
+                // Compiled when asked. Without a working program yet, each new text is tried once, not every frame
+                bool retry = !cold.custom.Latest() && edit.compiled != edit.text;
+                if (ImGui::Button("Compile") || enter || retry)
+                {
+                    edit.compiled = edit.text;
+                    if (cold.SetCustomExpression(edit.text, edit.bake, edit.error))
+                        edit.error.clear();
+                }
+                if (!edit.error.empty())
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", edit.error.c_str());
+            }
+
+            // Unison: noise and custom waveforms play a single copy
+            s32 unison = static_cast<s32>(osc.m_unison);
+            ImGui::PushItemWidth(150);
+            if (ImGui::SliderInt("Unison", &unison, 1, Oscillator::MAX_UNISON))
+                osc.m_unison = static_cast<u32>(unison);
+            SliderDouble("Detune", &osc.m_detune, 0.0, 100.0, "%.1f c");
+            SliderDouble("Spread", &osc.m_spread, 0.0, 1.0);
+            ImGui::PopItemWidth();
+            ImGui::Checkbox("Random Phase", &osc.m_random_phase);
+
             osc.m_waveform = static_cast<Oscillator::Type>(waveform);
         }
         ImGui::End();
     }
 
-    void LowFrequencyOscillator(Oscillator& osc, std::string label, s32& waveform, bool& mute)
+    void LowFrequencyOscillator(Oscillator& osc, LfoControl& control, std::string label, s32& waveform, bool& mute)
     {
         ImVec2 osc_slider_size(20, 150);
         ImGui::Begin(label.c_str());
         {
-            ImGui::Text(" P   V   F   A"); ImGui::SameLine();
+            ImGui::Text(" P   V   F   A  VIB"); ImGui::SameLine();
 
             ImGui::Checkbox("Mute", &osc.m_mute);
 
@@ -339,6 +465,16 @@ public:
             VSliderDouble("##V",     osc_slider_size, &osc.m_volume, 0.0, 1.0);          ImGui::SameLine();
             VSliderDouble("##F",     osc_slider_size, &osc.m_wave.frequency, 0.0, 20.0); ImGui::SameLine();
             VSliderDouble("##A",     osc_slider_size, &osc.m_wave.amplitude, 0.0, 0.01); ImGui::SameLine();
+            VSliderDouble("##VIB",   osc_slider_size, &control.vibrato_depth, 0.0, 2.0); ImGui::SameLine();
+
+            ImGui::BeginGroup();
+            ImGui::Checkbox("Key Sync",   &control.key_sync);
+            ImGui::Checkbox("Tempo Sync", &control.tempo_sync);
+            ImGui::PushItemWidth(80);
+            ImGui::SliderInt("BPM", &control.bpm, 40, 200);
+            SliderDouble("Beats",   &control.sync_beats, 0.25, 8.0);
+            ImGui::PopItemWidth();
+            ImGui::EndGroup(); ImGui::SameLine();
 
             ImGui::BeginGroup();
             ImGui::RadioButton("SINE",     &waveform, static_cast<s32>(Oscillator::Type::WAVE_SINE));
@@ -354,19 +490,386 @@ public:
         ImGui::End();
     }
 
+    void FrequencyModulation(FrequencyModulator& fm)
+    {
+        ImGui::Begin("FM Synthesis");
+        {
+            auto algorithm_name = [](void*, s32 i) { return FrequencyModulator::ALGORITHMS[i].name; };
+            ImGui::PushItemWidth(220);
+            ImGui::Combo("Algorithm", &fm.algorithm, algorithm_name, nullptr, FrequencyModulator::ALGORITHM_COUNT);
+            SliderDouble("Feedback", &fm.feedback, 0.0, 1.0);
+            ImGui::PopItemWidth();
+
+            const FrequencyModulator::Algorithm& alg = FrequencyModulator::ALGORITHMS[fm.algorithm];
+            ImGui::Text("OP   Ratio     Detune    Level     Velocity  A         D         S         R");
+            for (s32 i = 0; i < FrequencyModulator::OPERATORS; i++)
+            {
+                FrequencyModulator::Operator& op = fm.operators[i];
+                ImGui::PushID(i);
+                ImGui::Text("%d%s", i + 1, (alg.carriers & fm_op(i + 1)) ? "C" : (i == alg.feedback ? "F" : " ")); ImGui::SameLine();
+                ImGui::PushItemWidth(70);
+                SliderDouble("##RATIO", &op.ratio,                      0.5, 16.0, "%.2f");     ImGui::SameLine();
+                SliderDouble("##DT",    &op.detune,                   -50.0, 50.0, "%.1f c");   ImGui::SameLine();
+                SliderDouble("##LVL",   &op.level,                      0.0, 1.0,  "%.2f");     ImGui::SameLine();
+                SliderDouble("##VEL",   &op.velocity,                   0.0, 1.0,  "%.2f");     ImGui::SameLine();
+                SliderDouble("##A",     &op.envelope.attack_time,     0.001, 10.0, "%.3f");     ImGui::SameLine();
+                SliderDouble("##D",     &op.envelope.decay_time,       0.01, 10.0, "%.2f");     ImGui::SameLine();
+                SliderDouble("##S",     &op.envelope.sustain_amplitude, 0.0, 1.0,  "%.2f");     ImGui::SameLine();
+                SliderDouble("##R",     &op.envelope.release_time,     0.01, 10.0, "%.2f");
+                ImGui::PopItemWidth();
+                ImGui::PopID();
+            }
+        }
+        ImGui::End();
+    }
+
+    void TonewheelOrgan(Tonewheel& organ)
+    {
+        ImGui::Begin("Tonewheel Organ");
+        {
+            // Drawbars pull down, as on the console
+            for (s32 d = 0; d < Tonewheel::DRAWBARS; d++)
+            {
+                ImGui::PushID(d);
+                ImGui::BeginGroup();
+                ImGui::VSliderInt("##DRAWBAR", ImVec2(30, 160), &organ.drawbars[d], 8, 0);
+                ImGui::Text("%s", Tonewheel::FOOTAGE_NAMES[d]);
+                ImGui::EndGroup();
+                ImGui::PopID();
+                if (d + 1 < Tonewheel::DRAWBARS) ImGui::SameLine();
+            }
+
+            ImGui::Text("Registration: ");
+            for (s32 d = 0; d < Tonewheel::DRAWBARS; d++)
+            {
+                ImGui::SameLine(0.0f, d == 2 || d == 6 ? 8.0f : 0.0f);
+                ImGui::Text("%d", organ.drawbars[d]);
+            }
+        }
+        ImGui::End();
+    }
+
+    void AdditiveWindow(Additive& additive, AdditiveEdit& edit)
+    {
+        ImGui::Begin("Additive");
+        {
+            ImGui::PushItemWidth(200);
+            ImGui::Combo("Spectrum", &edit.preset, AdditiveSpectrum::PRESET_NAMES, static_cast<s32>(AdditiveSpectrum::Preset::COUNT));
+            ImGui::SliderInt("Partials", &edit.partials, 1, Additive::MAX_PARTIALS);
+            ImGui::PopItemWidth();
+            if (ImGui::Button("Apply"))
+            {
+                edit.error.clear();
+                additive.SetSpectrum(AdditiveSpectrum::Make(static_cast<AdditiveSpectrum::Preset>(edit.preset), u32(edit.partials)));
+            }
+
+            // Resynthesis of a recording
+            ImGui::PushItemWidth(260);
+            ImGui::InputText("WAV", edit.wav, sizeof(edit.wav));
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
+            if (ImGui::Button("Analyze"))
+            {
+                std::vector<f64> samples;
+                u32 rate = 0;
+                AdditiveSpectrum spectrum;
+                edit.error.clear();
+                if (read_wav(edit.wav, samples, rate, edit.error) &&
+                    AdditiveSpectrum::Analyze(samples, rate, u32(edit.partials), spectrum, edit.error))
+                {
+                    spectrum.name = edit.wav;
+                    additive.SetSpectrum(std::move(spectrum));
+                }
+            }
+            ImGui::Checkbox("Harmonic recurrence", &additive.recurrence);
+            ImGui::SameLine();
+            ImGui::Text("Latency: up to %.1f ms", 1000.0 * additive.Latency() / SAMPLE_RATE);
+
+            // First frame of the current spectrum
+            std::shared_ptr<const AdditiveSpectrum> spectrum = additive.Spectrum();
+            if (spectrum)
+            {
+                f32 levels[Additive::MAX_PARTIALS];
+                u32 count = std::min(spectrum->partials, Additive::MAX_PARTIALS);
+                for (u32 p = 0; p < count; p++) levels[p] = static_cast<f32>(spectrum->amplitude[p]);
+                ImGui::Text("%s: %u partials, %u frames%s", spectrum->name.c_str(), spectrum->partials, spectrum->frames, spectrum->harmonic ? ", harmonic" : "");
+                ImGui::PlotHistogram("##PARTIALS", levels, s32(count), 0, nullptr, 0.0f, FLT_MAX, ImVec2(400, 80));
+            }
+
+            if (!edit.error.empty())
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", edit.error.c_str());
+        }
+        ImGui::End();
+    }
+
+    void SamplerWindow(Sampler& sampler, SamplerEdit& edit)
+    {
+        ImGui::Begin("Sampler");
+        {
+            ImGui::PushItemWidth(260);
+            ImGui::InputText("SF2", edit.sf2, sizeof(edit.sf2));
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
+            if (ImGui::Button("Load"))
+            {
+                edit.error.clear();
+                sampler.Load(edit.sf2, edit.error);
+            }
+
+            std::shared_ptr<const SoundFont> bank = sampler.Font();
+            if (bank)
+            {
+                ImGui::Text("%s: %zu presets, %zu regions", bank->name.c_str(), bank->presets.size(), bank->regions.size());
+                ImGui::Text("%.1f MB mapped, %.1f MB preloaded", bank->file.size / 1048576.0, bank->preload.size() * 2.0 / 1048576.0);
+
+                s32 preset = std::clamp(sampler.preset.load(), 0, static_cast<s32>(bank->presets.size()) - 1);
+                const SoundFontPreset& p = bank->presets[preset];
+                char label[64];
+                std::snprintf(label, sizeof(label), "%03u:%03u %s", p.bank, p.program, p.name.c_str());
+                ImGui::PushItemWidth(260);
+                if (ImGui::BeginCombo("Preset", label))
+                {
+                    for (s32 i = 0; i < static_cast<s32>(bank->presets.size()); i++)
+                    {
+                        const SoundFontPreset& q = bank->presets[i];
+                        std::snprintf(label, sizeof(label), "%03u:%03u %s##%d", q.bank, q.program, q.name.c_str(), i);
+                        if (ImGui::Selectable(label, i == preset))
+                            sampler.preset = i;
+                    }
+                    ImGui::EndCombo();
+                }
+                ImGui::PopItemWidth();
+                ImGui::Text("Stream underruns: %llu", (unsigned long long)sampler.underruns.load());
+            }
+
+            if (!edit.error.empty())
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", edit.error.c_str());
+        }
+        ImGui::End();
+    }
+
+    void WaveguideWindow(Waveguide& waveguide)
+    {
+        ImGui::Begin("Waveguide");
+        {
+            ImGui::PushItemWidth(200);
+            ImGui::Combo("Model", &waveguide.model, Waveguide::MODEL_NAMES, static_cast<s32>(Waveguide::Model::COUNT));
+            SliderDouble("Decay", &waveguide.decay, 0.05, 20.0, "%.2f s", ImGuiSliderFlags_Logarithmic);
+            SliderDouble("Brightness", &waveguide.brightness, 0.0, 1.0);
+            if (waveguide.model == static_cast<s32>(Waveguide::Model::TUBE))
+            {
+                SliderDouble("Breath", &waveguide.breath, 0.0, 1.5);
+            }
+            else
+            {
+                SliderDouble("Release", &waveguide.release, 0.01, 2.0, "%.2f s", ImGuiSliderFlags_Logarithmic);
+                if (waveguide.model == static_cast<s32>(Waveguide::Model::STRING))
+                    SliderDouble("Position", &waveguide.position, 0.02, 0.5);
+            }
+            ImGui::PopItemWidth();
+        }
+        ImGui::End();
+    }
+
+    void ModalWindow(Modal& modal, ModalEdit& edit)
+    {
+        ImGui::Begin("Modal");
+        {
+            ImGui::PushItemWidth(200);
+            ImGui::Combo("Object", &edit.preset, ModalModes::PRESET_NAMES, static_cast<s32>(ModalModes::Preset::COUNT));
+            ImGui::SliderInt("Modes", &edit.modes, Modal::MIN_MODES, ModalVoice::MAX_MODES);
+            ImGui::PopItemWidth();
+            if (ImGui::Button("Apply"))
+            {
+                edit.error.clear();
+                modal.SetModes(ModalModes::Make(static_cast<ModalModes::Preset>(edit.preset), u32(edit.modes)));
+            }
+
+            // Modes of a recorded strike
+            ImGui::PushItemWidth(260);
+            ImGui::InputText("WAV", edit.wav, sizeof(edit.wav));
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
+            if (ImGui::Button("Analyze"))
+            {
+                std::vector<f64> samples;
+                u32 rate = 0;
+                ModalModes modes;
+                edit.error.clear();
+                if (read_wav(edit.wav, samples, rate, edit.error) &&
+                    ModalModes::Analyze(samples, rate, u32(edit.modes), modes, edit.error))
+                {
+                    modes.name = edit.wav;
+                    modal.SetModes(std::move(modes));
+                }
+            }
+
+            ImGui::PushItemWidth(200);
+            SliderDouble("Decay", &modal.decay, 0.05, 4.0, "x%.2f", ImGuiSliderFlags_Logarithmic);
+            SliderDouble("Release", &modal.release, 0.01, 4.0, "%.2f s", ImGuiSliderFlags_Logarithmic);
+            SliderDouble("Hardness", &modal.hardness, 0.0, 1.0);
+            SliderDouble("Threshold", &modal.threshold, -120.0, -40.0, "%.0f dB");
+            ImGui::PopItemWidth();
+
+            std::shared_ptr<const ModalModes> modes = modal.Modes();
+            if (modes)
+            {
+                f32 levels[ModalVoice::MAX_MODES];
+                u32 count = std::min(modes->Count(), ModalVoice::MAX_MODES);
+                for (u32 m = 0; m < count; m++) levels[m] = static_cast<f32>(modes->gain[m]);
+                ImGui::Text("%s: %u modes, %u resonators ringing", modes->name.c_str(), modes->Count(), modal.active.load());
+                ImGui::PlotHistogram("##MODES", levels, s32(count), 0, nullptr, 0.0f, FLT_MAX, ImVec2(400, 80));
+            }
+
+            if (!edit.error.empty())
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", edit.error.c_str());
+        }
+        ImGui::End();
+    }
+
+    void GranularWindow(Granular& granular, GranularEdit& edit)
+    {
+        ImGui::Begin("Granular");
+        {
+            ImGui::PushItemWidth(200);
+            ImGui::Combo("Source", &granular.source_type, Granular::SOURCE_NAMES, static_cast<s32>(Granular::Source::COUNT));
+            ImGui::PopItemWidth();
+            if (granular.source_type == static_cast<s32>(Granular::Source::LIVE))
+            {
+                ImGui::SameLine();
+                ImGui::Checkbox("Freeze", &granular.freeze);
+            }
+            else
+            {
+                ImGui::PushItemWidth(260);
+                ImGui::InputText("WAV", edit.wav, sizeof(edit.wav));
+                ImGui::PopItemWidth();
+                ImGui::SameLine();
+                if (ImGui::Button("Load"))
+                {
+                    std::vector<f64> samples;
+                    GrainSource recording;
+                    edit.error.clear();
+                    if (read_wav(edit.wav, samples, recording.sample_rate, edit.error))
+                    {
+                        recording.name = edit.wav;
+                        recording.Assign(samples);
+                        granular.SetSource(std::move(recording));
+                    }
+                }
+
+                std::shared_ptr<const GrainSource> recording = granular.Recording();
+                if (recording)
+                    ImGui::Text("%s: %.2f s", recording->name.c_str(), (recording->samples.size() - 1) / f64(recording->sample_rate));
+            }
+
+            ImGui::PushItemWidth(200);
+            SliderDouble("Position", &granular.position, 0.0, 1.0);
+            SliderDouble("Spray", &granular.spray, 0.0, 0.5, "%.3f s");
+            SliderDouble("Pitch", &granular.pitch, -24.0, 24.0, "%.1f st");
+            SliderDouble("Density", &granular.density, 1.0, 1000.0, "%.0f /s", ImGuiSliderFlags_Logarithmic);
+            SliderDouble("Size", &granular.size, 0.005, 0.5, "%.3f s", ImGuiSliderFlags_Logarithmic);
+            ImGui::PopItemWidth();
+            ImGui::Text("Grains: %u / %u", granular.active.load(), Granular::MAX_GRAINS);
+
+            if (!edit.error.empty())
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", edit.error.c_str());
+        }
+        ImGui::End();
+    }
+
+    void TuningWindow(TuningEdit& edit)
+    {
+        ImGui::Begin("Tuning");
+        {
+            Tuning& tuning = Tuning::Instance();
+            ImGui::Text("%s", tuning.Name().c_str());
+
+            ImGui::PushItemWidth(260);
+            ImGui::InputText("Scale (.scl)", edit.scl, sizeof(edit.scl));
+            ImGui::InputText("Keyboard (.kbm)", edit.kbm, sizeof(edit.kbm));
+            ImGui::PopItemWidth();
+            if (ImGui::Button("Load"))
+            {
+                edit.error.clear();
+                tuning.LoadScala(edit.scl, edit.kbm, edit.error);
+            }
+
+            ImGui::PushItemWidth(120);
+            SliderDouble("A4", &edit.a4, 415.0, 466.0, "%.1f Hz");
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
+            if (ImGui::Button("12-TET"))
+            {
+                edit.error.clear();
+                tuning.SetEqualTemperament(edit.a4);
+            }
+
+            if (!edit.error.empty())
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", edit.error.c_str());
+        }
+        ImGui::End();
+    }
+
+    void ModulationMatrix(Synthesizer& synth)
+    {
+        ImGui::Begin("Modulation Matrix");
+        {
+            ModMatrix& matrix = synth.m_mod_matrix;
+            bool changed = false;
+
+            ImGui::Text("Source          Destination     Curve           Depth");
+            for (s32 i = 0; i < ModMatrix::MAX_ROUTES; i++)
+            {
+                ModMatrix::Route& route = matrix.routes[i];
+                s32 source      = static_cast<s32>(route.source);
+                s32 destination = static_cast<s32>(route.destination);
+                s32 curve       = static_cast<s32>(route.curve);
+                s32 cc          = route.cc;
+
+                ImGui::PushID(i);
+                ImGui::PushItemWidth(120);
+                changed |= ImGui::Combo("##S", &source,      ModMatrix::SOURCE_NAMES,      ModMatrix::SOURCE_COUNT);                    ImGui::SameLine();
+                changed |= ImGui::Combo("##D", &destination, ModMatrix::DESTINATION_NAMES, ModMatrix::DESTINATION_COUNT);               ImGui::SameLine();
+                changed |= ImGui::Combo("##C", &curve,       ModMatrix::CURVE_NAMES,       static_cast<s32>(ModMatrix::Curve::COUNT)); ImGui::SameLine();
+                changed |= SliderDouble("##A", &route.depth, -1.0, 1.0);
+                if (route.source == ModMatrix::Source::CC)
+                {
+                    ImGui::SameLine();
+                    changed |= ImGui::SliderInt("##CC", &cc, 0, 127, "CC %d"); ImGui::SameLine();
+                    SliderDouble("##V", &matrix.cc[route.cc], 0.0, 1.0);
+                }
+                ImGui::PopItemWidth();
+                ImGui::PopID();
+
+                route.source      = static_cast<ModMatrix::Source>(source);
+                route.destination = static_cast<ModMatrix::Destination>(destination);
+                route.curve       = static_cast<ModMatrix::Curve>(curve);
+                route.cc          = static_cast<u8>(cc);
+            }
+
+            if (changed) matrix.Changed();
+        }
+        ImGui::End();
+    }
+
     void Filter(Synthesizer& synth)
     {
         ImGui::Begin("Filter Type");
         {
-            static s32 filter = synth.vafilter;
+            static s32 filter = synth.ladder ? 2 : synth.vafilter;
             ImGui::RadioButton("BIQUAD", &filter, 0); ImGui::SameLine();
-            ImGui::RadioButton("VA", &filter, 1);
-            synth.vafilter = static_cast<bool>(filter);
+            ImGui::RadioButton("VA", &filter, 1);     ImGui::SameLine();
+            ImGui::RadioButton("LADDER", &filter, 2);
+            synth.vafilter = filter == 1;
+            synth.ladder   = filter == 2;
         }
         ImGui::End();
 
         // Filter
-        if (synth.vafilter)
+        if (synth.ladder)
+            LadderFilter(synth);
+        else if (synth.vafilter)
             VAFilter(synth);
         else
             BqFilter(synth);
@@ -414,33 +917,8 @@ public:
                 prev_filter_type = filter_type;
             }
 
-            // Plot Frequency Response: Amplitude Response
-            f64 nyquist_freq = SAMPLE_RATE / 2.0;
-            const s32 sample_size = 1000;
-            std::vector<f64> frequencies(sample_size, 0.0); // Hz
-            std::vector<f64> magnitudes(sample_size, 0.0);  // dB
-            for (s32 i = 0; i < sample_size; i++)
-            {
-                f64 freq = (static_cast<f64>(i) / sample_size) * nyquist_freq;
-                frequencies[i] = freq;
-
-                f64 mag = synth.m_filter.TransferFunction(freq);
-                if (mag > 0.0) magnitudes[i] = volume_to_dB(mag);
-                else           magnitudes[i] = -100.0;
-            }
-
-            if (ImPlot::BeginPlot("Amplitude Response", ImVec2(500, 300)))
-            {
-                ImPlot::SetupAxes("Frequency (Hz)", "Gain (dB)", 0, ImPlotAxisFlags_AutoFit);
-                ImPlot::SetupAxisLimits(ImAxis_X1, 20.0, nyquist_freq, ImGuiCond_Always);
-                ImPlot::SetupAxisLimits(ImAxis_Y1, -100, 10, ImGuiCond_Always); // Y-axis limits for dB (-100 dB to 10 dB)
-                //ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Log10);           // Logarithmic scale frequency (Hz)
-
-                ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 3.0f);
-                ImPlot::PlotLine("##Filter Frequency", frequencies.data(), magnitudes.data(), frequencies.size());
-                ImPlot::PopStyleVar();
-                ImPlot::EndPlot();
-            }
+            // Amplitude Response
+            FilterResponse(response_section(synth.m_filter));
         }
         ImGui::End();
     }
@@ -482,38 +960,103 @@ public:
                 prev_filter_type = filter_type;
             }
 
-            // Plot Frequency Response: Amplitude Response
-            f64 nyquist_freq = SAMPLE_RATE / 2.0;
-            const s32 sample_size = 1000;
-            std::vector<f64> frequencies(sample_size, 0.0); // Hz
-            std::vector<f64> magnitudes(sample_size, 0.0);  // dB
-            for (s32 i = 0; i < sample_size; i++)
-            {
-                f64 freq = (static_cast<f64>(i) / sample_size) * nyquist_freq;
-                frequencies[i] = freq;
+            // Amplitude Response
+            FilterResponse(response_section(synth.m_vafilter));
+        }
+        ImGui::End();
+    }
 
-                f64 mag = synth.m_vafilter.TransferFunction(freq);
-                if (mag > 0.0) magnitudes[i] = volume_to_dB(mag);
-                else           magnitudes[i] = -100.0;
-            }
+    void LadderFilter(Synthesizer& synth)
+    {
+        ImGui::Begin("Ladder Filter");
+        {
+            static f64 resonance = 0.5;
+            static f64 cutoff_freq = 2000.0;
+            static f64 drive = synth.m_ladder.drive;
 
-            static ImPlotAxisFlags flags = ImPlotAxisFlags_NoTickLabels | ImPlotAxisFlags_NoTickMarks;
-            if (ImPlot::BeginPlot("Amplitude Response", ImVec2(500, 300)))
+            // Store previous values
+            static f64 prev_resonance = resonance;
+            static f64 prev_cutoff_freq = cutoff_freq;
+            static f64 prev_drive = drive;
+
+            ImGui::Text("   C     R   "); ImGui::SameLine();
+            ImGui::BeginGroup();
+            SliderDouble("Drive", &drive, 0.0, 36.0, "%.1f dB");
+            ImGui::Combo("Oversampling", &synth.m_ladder.oversampling, LadderFilter::OVERSAMPLING_NAMES, static_cast<s32>(LadderFilter::Oversampling::COUNT));
+            ImGui::Text("New voices run at %ux", synth.m_ladder.Factor());
+            ImGui::EndGroup();
+
+            VSliderDouble("##F", ImVec2(40, 300), &cutoff_freq, 20.0, SAMPLE_RATE / 2.0); ImGui::SameLine();
+            VSliderDouble("##R", ImVec2(20, 300), &resonance, 0.0, 1.0, "%.2f");          ImGui::SameLine();
+
+            if (resonance != prev_resonance || cutoff_freq != prev_cutoff_freq || drive != prev_drive)
             {
-                ImPlot::SetupAxes("Frequency (Hz)", "Gain (dB)", 0, ImPlotAxisFlags_AutoFit);
-                ImPlot::SetupAxisLimits(ImAxis_X1, 20.0, nyquist_freq, ImGuiCond_Always);
-                ImPlot::SetupAxisLimits(ImAxis_Y1, -100, 10, ImGuiCond_Always); // Y-axis limits for dB (-100 dB to 10 dB)
-                //ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Log10);         // Logarithmic scale frequency (Hz)
+                synth.m_ladder.drive = drive;
+                synth.m_ladder.CalcCoefs(cutoff_freq, resonance);
 
-                ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 3.0f);
-                ImPlot::PlotLine("##Filter Frequency", frequencies.data(), magnitudes.data(), frequencies.size());
-                ImPlot::PopStyleVar();
-                ImPlot::EndPlot();
+                // Update previous values
+                prev_resonance = resonance;
+                prev_cutoff_freq = cutoff_freq;
+                prev_drive = drive;
             }
+
+            // Amplitude Response
+            FilterResponse(response_section(synth.m_ladder));
+        }
+        ImGui::End();
+    }
+
+    void DistortionWindow(Synthesizer& synth)
+    {
+        ImGui::Begin("Distortion");
+        {
+            ImGui::SeparatorText("Voice");
+            ImGui::PushID("Voice");
+            ImGui::Checkbox("On", &synth.distortion);
+            DistortionControls(synth.m_distortion);
+            ImGui::PopID();
+
+            ImGui::SeparatorText("Master");
+            ImGui::PushID("Master");
+            ImGui::Checkbox("On", &synth.master_distortion);
+            DistortionControls(synth.m_master_distortion);
+            ImGui::PopID();
         }
         ImGui::End();
     }
 
+    void DistortionControls(Distortion& distortion)
+    {
+        s32 count = static_cast<s32>(Distortion::Curve::COUNT);
+        bool changed = false;
+        ImGui::Combo("Curve", &distortion.curve, Distortion::CURVE_NAMES, count);
+        ImGui::Combo("Anti-aliasing", &distortion.order, Distortion::ORDER_NAMES, 3);
+        changed |= SliderDouble("Drive", &distortion.drive, 0.0, 36.0, "%.1f dB");
+        changed |= SliderDouble("Level", &distortion.level, -36.0, 6.0, "%.1f dB");
+        if (distortion.curve == static_cast<s32>(Distortion::Curve::ASYMMETRIC))
+            changed |= SliderDouble("Asymmetry", &distortion.asymmetry, 0.0, 2.0, "%.2f");
+        if (changed) distortion.Update();
+    }
+
+    // Amplitude response of the filter being edited, curves from the response worker
+    void FilterResponse(const ResponseSection& section)
+    {
+        m_response.Request(FrequencyResponse::View::FILTER, &section, 1);
+        std::shared_ptr<const ResponseCurve> curve = m_response.Curve(FrequencyResponse::View::FILTER);
+
+        if (ImPlot::BeginPlot("Amplitude Response", ImVec2(500, 300)))
+        {
+            ImPlot::SetupAxes("Frequency (Hz)", "Gain (dB)", 0, ImPlotAxisFlags_AutoFit);
+            ImPlot::SetupAxisLimits(ImAxis_X1, FrequencyResponse::LOW, FrequencyResponse::HIGH, ImGuiCond_Always);
+            ImPlot::SetupAxisLimits(ImAxis_Y1, -100, 10, ImGuiCond_Always); // Y-axis limits for dB (-100 dB to 10 dB)
+            ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Log10);          // Logarithmic scale frequency (Hz)
+
+            ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 3.0f);
+            if (curve) ImPlot::PlotLine("##Filter Frequency", curve->frequencies.data(), curve->magnitudes.data(), curve->frequencies.size());
+            ImPlot::PopStyleVar();
+            ImPlot::EndPlot();
+        }
+    }
 
     void ReverbEffect(Synthesizer& synth)
     {
@@ -526,6 +1069,7 @@ public:
             static f64 decay  = 1.0;
             static f64 dry    = 0.0;
             static f64 wet    = 0.0;
+            static f64 width  = 1.0;
 
             static f64 prev_room = room;
             static f64 prev_spread = spread;
@@ -533,9 +1077,10 @@ public:
             static f64 prev_decay = decay;
             static f64 prev_dry = dry;
             static f64 prev_wet = wet;
+            static f64 prev_width = width;
 
             ImVec2 osc_slider_size(20, 150);
-            ImGui::Text("RM  SPR DMP DCY DRY WET"); ImGui::SameLine();
+            ImGui::Text("RM  SPR DMP DCY DRY WET WID"); ImGui::SameLine();
             ImGui::Checkbox("Mute", &synth.reverb); 
             VSliderDouble("##R",  osc_slider_size, &room,   0.1, 10.0); ImGui::SameLine();
             VSliderDouble("##S",  osc_slider_size, &spread, 0.1, 1.0);  ImGui::SameLine();
@@ -543,8 +1088,9 @@ public:
             VSliderDouble("##DC", osc_slider_size, &decay,  0.1, 1.0);  ImGui::SameLine();
             VSliderDouble("##DR", osc_slider_size, &dry,   -60.0, 0.0); ImGui::SameLine();
             VSliderDouble("##WT", osc_slider_size, &wet,   -60.0, 0.0); ImGui::SameLine();
+            VSliderDouble("##WD", osc_slider_size, &width,   0.0, 1.0); ImGui::SameLine();
 
-            if (room != prev_room || spread != prev_spread || damp != prev_damp || decay != prev_decay || dry != prev_dry || wet != prev_wet)
+            if (room != prev_room || spread != prev_spread || damp != prev_damp || decay != prev_decay || dry != prev_dry || wet != prev_wet || width != prev_width)
             {
                 synth.m_reverb.room   = room;
                 synth.m_reverb.spread = spread;
@@ -552,6 +1098,7 @@ public:
                 synth.m_reverb.decay  = decay;
                 synth.m_reverb.dry    = dry;
                 synth.m_reverb.wet    = wet;
+                synth.m_reverb.width  = width;
 
                 synth.m_reverb.ComputeFilterDelays();
 
@@ -561,6 +1108,7 @@ public:
                 prev_decay  = decay;
                 prev_dry    = dry;
                 prev_wet    = wet;
+                prev_width  = width;
             }
         }
         ImGui::End();
@@ -576,7 +1124,8 @@ public:
             ImGui::VSliderInt("##B",   osc_slider_size, &synth.m_delay.beat, 1, 16);         ImGui::SameLine();
             ImGui::VSliderInt("##BPB", osc_slider_size, &synth.m_delay.beat_per_bar, 1, 8); ImGui::SameLine();
             ImGui::VSliderInt("##BPM", osc_slider_size, &synth.m_delay.bpm, 40, 200);        ImGui::SameLine();
-            VSliderDouble("##F",       osc_slider_size, &synth.m_delay.feedback, 0.0, 1.0);
+            VSliderDouble("##F",       osc_slider_size, &synth.m_delay.feedback, 0.0, 1.0); ImGui::SameLine();
+            ImGui::Checkbox("Ping-pong", &synth.m_delay.ping_pong);
         }
         ImGui::End();
     }
@@ -610,36 +1159,11 @@ public:
             };
 
             // Graphical Band controls
-            static constexpr s32 N = 4*1024;
-            std::vector<f64> frequencies(N, 0.0); // Hz
-            std::vector<f64> magnitudes(N, 0.0);  // dB
-            for (s32 i = 0; i < N; i++) 
-            {
-                f64 freq = log_interpolate(20.0, 20000.0, (i + 0.5) / N);
-                f64 sqrt_phi = std::sin(PI * freq * (1.0 / SAMPLE_RATE));
-                f64 phi = sqrt_phi * sqrt_phi;
-                f64 response = 0.0;
-
-                for (s32 b = 0; b < NUM_BANDS; b++)
-                {
-                    const auto& band = synth.m_eq.bands[b];
-                    f64 b0 = band.filter.b0;
-                    f64 b1 = band.filter.b1;
-                    f64 b2 = band.filter.b2;
-                    f64 a1 = band.filter.a1;
-                    f64 a2 = band.filter.a2;
-
-                    f64 b012 = 0.5 *  (b0 + b1 + b2);
-                    f64 a012 = 0.5 * (1.0 + a1 + a2);
-
-                    f64 numerator   = b012 * b012 - phi * (4.0 * b0 * b2 * (1.0 - phi) + b1 * (b0 + b2));
-                    f64 denominator = a012 * a012 - phi * (4.0 * a2 * (1.0 - phi) + a1 * (1.0 + a2));
-                    response += 10.0 * (std::log10(numerator) - std::log10(denominator));
-                }
-
-                frequencies[i] = freq;
-                magnitudes[i] = response;
-            }
+            ResponseSection sections[NUM_BANDS];
+            for (s32 b = 0; b < NUM_BANDS; b++)
+                sections[b] = response_section(synth.m_eq.bands[b].filter);
+            m_response.Request(FrequencyResponse::View::EQUALIZER, sections, NUM_BANDS);
+            std::shared_ptr<const ResponseCurve> curve = m_response.Curve(FrequencyResponse::View::EQUALIZER);
 
             ImVec2 space = ImVec2(600, 300);
             if (ImPlot::BeginPlot("EQ", space))
@@ -652,7 +1176,7 @@ public:
                 ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 3.0f);
 
 
-                ImPlot::PlotLine("", frequencies.data(), magnitudes.data(), frequencies.size());
+                if (curve) ImPlot::PlotLine("", curve->frequencies.data(), curve->magnitudes.data(), curve->frequencies.size());
 
                 // Band EQ drag point
                 char label[32] = {};
@@ -675,7 +1199,7 @@ public:
                 ImPlot::EndPlot();
             }
             ImGui::SameLine();
-            static s32 mode = 0;
+            static s32 mode = synth.m_eq.bands[0].mode;
             for (s32 b = 0; b < NUM_BANDS; b++)
             {
                 Equalizer::Band& band = synth.m_eq.bands[b];
@@ -684,6 +1208,9 @@ public:
 
             ImGui::BeginGroup();
             ImGui::Checkbox("Mute",     &synth.eq);
+            bool linear_phase = synth.m_eq.linear_phase;
+            if (ImGui::Checkbox("Linear",   &linear_phase)) synth.m_eq.SetLinearPhase(linear_phase);
+            if (linear_phase) ImGui::Text("%.1f ms", 1000.0 * synth.m_eq.Latency() / SAMPLE_RATE);
             ImGui::RadioButton("LPF",   &mode, 0);
             ImGui::RadioButton("HPF",   &mode, 2);
             ImGui::RadioButton("BPF",   &mode, 1);
@@ -708,6 +1235,60 @@ public:
     }
 
 
+    void Multiband(Synthesizer& synth)
+    {
+        ImGui::Begin("Multiband");
+        {
+            MultibandDynamics& dynamics = synth.m_multiband;
+
+            ImGui::Checkbox("On", &synth.multiband); ImGui::SameLine();
+            s32 bands = s32(dynamics.bands);
+            ImGui::RadioButton("3 Bands", &bands, 3);  ImGui::SameLine();
+            ImGui::RadioButton("4 Bands", &bands, 4);
+            dynamics.bands = u32(bands);
+
+            for (u32 c = 0; c + 1 < dynamics.bands; c++)
+            {
+                ImGui::PushID(s32(c));
+                SliderDouble("Crossover", &dynamics.crossovers[c], 40.0, 16000.0, "%.0f Hz", ImGuiSliderFlags_Logarithmic);
+                ImGui::PopID();
+            }
+
+            ImVec2 slider_size(20, 150);
+            for (u32 b = 0; b < dynamics.bands; b++)
+            {
+                MultibandDynamics::Band& band = dynamics.band[b];
+                ImGui::PushID(s32(b));
+                ImGui::BeginGroup();
+                ImGui::Text("THR RAT GAT EXP ATK REL MKP");
+                VSliderDouble("##THR", slider_size, &band.threshold, -60.0, 0.0, "%.0f");  ImGui::SameLine();
+                VSliderDouble("##RAT", slider_size, &band.ratio,       1.0, 20.0, "%.1f");  ImGui::SameLine();
+                VSliderDouble("##GAT", slider_size, &band.gate,     -100.0, 0.0, "%.0f");  ImGui::SameLine();
+                VSliderDouble("##EXP", slider_size, &band.expansion,   1.0, 10.0, "%.1f");  ImGui::SameLine();
+                VSliderDouble("##ATK", slider_size, &band.attack,      0.1, 200.0, "%.1f"); ImGui::SameLine();
+                VSliderDouble("##REL", slider_size, &band.release,     5.0, 2000.0, "%.0f"); ImGui::SameLine();
+                VSliderDouble("##MKP", slider_size, &band.makeup,    -24.0, 24.0, "%.1f");
+                ImGui::Text("GR: %.1f dB", synth.multiband ? band.reduction : 0.0);
+                ImGui::EndGroup();
+                ImGui::PopID();
+                if (b + 1 < dynamics.bands) ImGui::SameLine();
+            }
+        }
+        ImGui::End();
+    }
+
+private:
+    // Custom waveform text being edited per oscillator slot
+    CustomWaveEdit m_custom_edits[Synthesizer::MAX_OSCILLATORS];
+    TuningEdit m_tuning_edit;
+    AdditiveEdit m_additive_edit;
+    SamplerEdit m_sampler_edit;
+    GranularEdit m_granular_edit;
+    ModalEdit m_modal_edit;
+
+    // Filter and equalizer curves, recomputed off the GUI thread when the coefficients change
+    FrequencyResponse m_response;
+
 private:
     ImGuiIO io;
     bool show_imgui_demo  = false;
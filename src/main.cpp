@@ -1,9 +1,9 @@
 #include "Core/Application.h"
 
-int main()
+int main(int argc, char** argv)
 {
     Application app;
-    if (app.Init()) app.Start();
+    if (app.Init(argc, argv)) app.Start();
     app.ShutDown();
     return 0;
 }
\ No newline at end of file
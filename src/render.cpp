@@ -0,0 +1,213 @@
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+#include "Audio/AudioEngine.h"
+#include "Audio/OfflineRenderer.h"
+
+// synth_render: headless offline renderer, no audio device, window or OpenGL
+static void usage()
+{
+    std::printf("usage: synth_render <input.txt|input.mid> <output.wav> [--bits 16|32] [--tail seconds] [--block samples] [--channels n] [--synthesis subtractive|fm|tonewheel|additive|sampler|granular|waveguide|modal] [--resynthesize input.wav] [--grains input.wav] [--modes input.wav] [--filter biquad|va|ladder] [--drive dB] [--eq minimum|linear] [--multiband 3|4] [--distortion tanh|clip|fold|asym] [--master-distortion tanh|clip|fold|asym] [--distortion-drive dB] [--adaa 0|1|2] [--driver offline|loopback|paced] [--period frames] [--jitter seconds] [--miss probability] [--render-ahead blocks] [--sf2 bank.sf2] [--preset n] [--scl scale.scl] [--kbm mapping.kbm]\n");
+}
+
+// Synthesis by name, case insensitive: "subtractive", "fm", "tonewheel", "additive", "sampler", "granular", "waveguide", "modal"
+static s32 synthesis_from_name(const char* name)
+{
+    for (s32 i = 0; i < static_cast<s32>(Synthesizer::Synthesis::COUNT); i++)
+    {
+        std::string a = name, b = Synthesizer::SYNTHESIS_NAMES[i];
+        std::transform(a.begin(), a.end(), a.begin(), ::tolower);
+        std::transform(b.begin(), b.end(), b.begin(), ::tolower);
+        if (a == b) return i;
+    }
+    return -1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    std::string input = argv[1];
+    std::string output = argv[2];
+    u16 bits = 16;
+    f64 tail = 2.0;
+    u32 block_samples = SAMPLE_RATE / 100;
+    u32 channels = CHANNELS;
+    s32 synthesis = static_cast<s32>(Synthesizer::Synthesis::SUBTRACTIVE);
+    std::string scl, kbm, resynthesize, sf2, grains, modes;
+    s32 preset = 0;
+    std::string filter = "biquad";
+    f64 drive = 0.0;
+    std::string eq = "minimum";
+    u32 multiband = 0;
+    std::string distortion, master_distortion;
+    f64 distortion_drive = 12.0;
+    s32 adaa = 2;
+    std::string driver = "offline";
+    LoopbackDriver::Config loopback;
+    u32 render_ahead = 0;
+
+    for (s32 i = 3; i + 1 < argc; i += 2)
+    {
+        if      (!std::strcmp(argv[i], "--bits"))     bits = u16(std::stoi(argv[i + 1]));
+        else if (!std::strcmp(argv[i], "--tail"))     tail = std::stod(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--block"))    block_samples = u32(std::max(1, std::stoi(argv[i + 1])));
+        else if (!std::strcmp(argv[i], "--channels")) channels = u32(std::max(1, std::stoi(argv[i + 1])));
+        else if (!std::strcmp(argv[i], "--synthesis") && synthesis_from_name(argv[i + 1]) >= 0) synthesis = synthesis_from_name(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--scl"))      scl = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--kbm"))      kbm = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--resynthesize")) resynthesize = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--grains"))   grains = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--modes"))    modes = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--filter"))   filter = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--drive"))    drive = std::stod(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--eq"))       eq = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--multiband")) multiband = u32(std::max(0, std::stoi(argv[i + 1])));
+        else if (!std::strcmp(argv[i], "--distortion")) distortion = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--master-distortion")) master_distortion = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--distortion-drive")) distortion_drive = std::stod(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--adaa"))     adaa = std::clamp(std::stoi(argv[i + 1]), 0, 2);
+        else if (!std::strcmp(argv[i], "--driver"))   driver = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--period"))   loopback.period_frames = u32(std::max(1, std::stoi(argv[i + 1])));
+        else if (!std::strcmp(argv[i], "--jitter"))   loopback.jitter = std::max(0.0, std::stod(argv[i + 1]));
+        else if (!std::strcmp(argv[i], "--miss"))     loopback.miss_probability = std::clamp(std::stod(argv[i + 1]), 0.0, 1.0);
+        else if (!std::strcmp(argv[i], "--render-ahead")) render_ahead = u32(std::max(0, std::stoi(argv[i + 1])));
+        else if (!std::strcmp(argv[i], "--sf2"))      sf2 = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--preset"))   preset = std::max(0, std::stoi(argv[i + 1]));
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!scl.empty())
+    {
+        std::string error;
+        if (!Tuning::Instance().LoadScala(scl, kbm, error))
+        {
+            std::printf("ERROR: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    AudioEngine audio;
+    audio.synth.m_synthesis = static_cast<Synthesizer::Synthesis>(synthesis);
+    audio.synth.vafilter = filter == "va";
+    audio.synth.ladder   = filter == "ladder";
+    audio.synth.m_ladder.drive = drive;
+    audio.synth.m_ladder.CalcCoefs(audio.synth.m_ladder.frequency, audio.synth.m_ladder.resonance);
+
+    // Linear phase equalizer, designed inline so every render is the same
+    audio.synth.m_eq.background = false;
+    audio.synth.m_eq.SetLinearPhase(eq == "linear");
+    if (audio.synth.m_eq.linear_phase)
+        std::printf("INFO: Linear phase EQ latency: %u samples (%.1f ms)\n", audio.synth.m_eq.Latency(), 1000.0 * audio.synth.m_eq.Latency() / SAMPLE_RATE);
+
+    // Multiband dynamics with the default bands
+    audio.synth.multiband = multiband != 0;
+    if (multiband) audio.synth.m_multiband.bands = multiband;
+
+    // Distortion per voice and on the master bus, by curve name
+    auto distortion_curve = [](const std::string& name) {
+        if (name == "clip") return Distortion::Curve::HARD_CLIP;
+        if (name == "fold") return Distortion::Curve::FOLDBACK;
+        if (name == "asym") return Distortion::Curve::ASYMMETRIC;
+        return Distortion::Curve::TANH;
+    };
+    audio.synth.distortion        = !distortion.empty();
+    audio.synth.master_distortion = !master_distortion.empty();
+    for (Distortion* d : { &audio.synth.m_distortion, &audio.synth.m_master_distortion })
+    {
+        d->curve = static_cast<s32>(distortion_curve(d == &audio.synth.m_distortion ? distortion : master_distortion));
+        d->order = adaa;
+        d->drive = distortion_drive;
+        d->Update();
+    }
+
+    // Additive voice playing the partials of a recording
+    if (!resynthesize.empty())
+    {
+        std::vector<f64> samples;
+        u32 rate = 0;
+        std::string error;
+        AdditiveSpectrum spectrum;
+        if (!read_wav(resynthesize, samples, rate, error) || !AdditiveSpectrum::Analyze(samples, rate, Additive::MAX_PARTIALS, spectrum, error))
+        {
+            std::printf("ERROR: %s\n", error.c_str());
+            return 1;
+        }
+        std::printf("INFO: Resynthesis: %u partials, %u frames\n", spectrum.partials, spectrum.frames);
+        audio.synth.m_additive.SetSpectrum(std::move(spectrum));
+        audio.synth.m_synthesis = Synthesizer::Synthesis::ADDITIVE;
+    }
+    // Overlap-add frames fade a note in, the harmonic recurrence path does not
+    if (audio.synth.m_synthesis == Synthesizer::Synthesis::ADDITIVE)
+        std::printf("INFO: Additive latency: up to %u samples (%.1f ms)\n", audio.synth.m_additive.Latency(), 1000.0 * audio.synth.m_additive.Latency() / SAMPLE_RATE);
+
+    // Granular voice reading a recording
+    if (!grains.empty())
+    {
+        std::vector<f64> samples;
+        GrainSource recording;
+        std::string error;
+        if (!read_wav(grains, samples, recording.sample_rate, error))
+        {
+            std::printf("ERROR: %s\n", error.c_str());
+            return 1;
+        }
+        recording.name = grains;
+        recording.Assign(samples);
+        audio.synth.m_granular.SetSource(std::move(recording));
+        audio.synth.m_synthesis = Synthesizer::Synthesis::GRANULAR;
+    }
+    // Modal voice ringing the modes of a recorded strike
+    if (!modes.empty())
+    {
+        std::vector<f64> samples;
+        u32 rate = 0;
+        std::string error;
+        ModalModes analyzed;
+        if (!read_wav(modes, samples, rate, error) || !ModalModes::Analyze(samples, rate, ModalVoice::MAX_MODES, analyzed, error))
+        {
+            std::printf("ERROR: %s\n", error.c_str());
+            return 1;
+        }
+        std::printf("INFO: Modes: %u\n", analyzed.Count());
+        analyzed.name = modes;
+        audio.synth.m_modal.SetModes(std::move(analyzed));
+        audio.synth.m_synthesis = Synthesizer::Synthesis::MODAL;
+    }
+
+    // Sampler voice playing a SoundFont preset, read straight from the mapping: no reader thread to wait for
+    if (!sf2.empty())
+    {
+        std::string error;
+        audio.synth.m_sampler.streaming = false;
+        if (!audio.synth.m_sampler.Load(sf2, error))
+        {
+            std::printf("ERROR: %s\n", error.c_str());
+            return 1;
+        }
+        audio.synth.m_sampler.preset = preset;
+        audio.synth.m_synthesis = Synthesizer::Synthesis::SAMPLER;
+    }
+    audio.InitOffline(u32(SAMPLE_RATE), channels, block_samples);
+
+    OfflineRenderer renderer(&audio);
+    if (!renderer.Load(input))
+        return 1;
+
+    // The loopback driver runs the sound card callback path, as fast as possible or paced in real time,
+    // optionally with a worker rendering blocks ahead of the callback
+    loopback.paced = driver == "paced";
+    bool ok = driver == "offline" ? renderer.Render(output, bits, tail) : renderer.RenderLoopback(output, loopback, bits, tail, render_ahead);
+    audio.Shutdown();
+
+    return ok ? 0 : 1;
+}
\ No newline at end of file